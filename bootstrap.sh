@@ -4,6 +4,7 @@ set -e # exit on error
 set -x # Enable echoing of commands
 
 mkdir -p m4
+libtoolize --copy --force
 aclocal -I m4
 autoheader
 automake --foreign --add-missing --force-missing
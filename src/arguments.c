@@ -28,6 +28,8 @@
 #include "dfu-device.h"
 #include "config.h"
 #include "arguments.h"
+#include "srec.h"
+#include "dfuse.h"
 #include "util.h"
 
 // Modes used to display the list of targets.
@@ -209,6 +211,9 @@ static struct option_mapping_structure command_map[] = {
     { "start",        com_start_app },
     { "bin2hex",      com_bin2hex   },
     { "hex2bin",      com_hex2bin   },
+    { "compile",      com_compile   },
+    { "flash-bundle", com_flash_bundle },
+    { "checksum",     com_checksum  },
     { NULL }
 };
 
@@ -349,24 +354,52 @@ static void usage()
     fprintf( stderr, PACKAGE_STRING "\n");
     fprintf( stderr, PACKAGE_URL "\n" );
     fprintf( stderr, "Usage: dfu-programmer target[:usb-bus,usb-addr] command [options] "
-                     "[global-options] [file|data]\n\n" );
+                     "[global-options] [file|data]\n" );
+    fprintf( stderr, "       dfu-programmer serve [--cache-dir=directory] "
+                     "[--keep=images] socket\n\n" );
     fprintf( stderr, "global-options:\n"
                      "        --quiet\n"
+                     "        --json           (end with a line of JSON timing each phase,\n"
+                     "                          implies --quiet)\n"
                      "        --debug level    (level is an integer specifying level of detail)\n"
                      "        Global options can be used with any command and must come\n"
-                     "        after the command and before any file or data value\n" );
+                     "        after the command and before any file or data value\n"
+                     "        Several commands separated by " COMMAND_SEPARATOR " run in order"
+                     " on one device\n"
+                     "        session, stopping at the first that fails\n" );
     fprintf( stderr, "\n" );
     fprintf( stderr, "command summary:\n" );
     fprintf( stderr, "        launch       [--no-reset]\n" );
-    fprintf( stderr, "        read         [--force] [--bin] [(flash)|--user|--eeprom]\n" );
+    fprintf( stderr, "        read         [--force] [--bin|--srec|--dfuse]\n"
+                     "                     [(flash)|--user|--eeprom]\n"
+                     "                     [--record-width=bytes] [--minimal-04]\n"
+                     "                     [--stream]\n" );
     fprintf( stderr, "        erase        [--force] [--suppress-validation]\n" );
     fprintf( stderr, "        flash        [--force] [(flash)|--user|--eeprom]\n"
+                     "                     [--bin [--offset address]]\n"
+                     "                     [--cache-dir=directory]\n"
                      "                     [--suppress-validation]\n"
                      "                     [--suppress-bootloader-mem]\n"
-                     "                     [--validate-first]\n"
-                     "                     [--erase-first]\n"
-                     "                     [--ignore-outside]\n"
-                     "                     [--serial=hexdigits:offset] {file|STDIN}\n" );
+                     "                     [--validate-first] [--if-changed]\n"
+                     "                     [--erase-first] [--plan]\n"
+                     "                     [--journal=file]\n"
+                     "                     [--ignore-outside] [--allow-overlap]\n"
+                     "                     [--serial=hexdigits:offset] [--stream]\n"
+                     "                     [--serial-file=file:offset]\n"
+                     "                     [--serial-counter=file:offset:width[b|d]]\n"
+                     "                     {file|STDIN} [file...]\n" );
+    fprintf( stderr, "        compile      [(flash)|--user|--eeprom] [--force]\n"
+                     "                     [--bin [--offset address]]\n"
+                     "                     [--allow-overlap]\n"
+                     "                     [--serial=hexdigits:offset]\n"
+                     "                     [--serial-file=file:offset]\n"
+                     "                     [--serial-counter=file:offset:width[b|d]]\n"
+                     "                     {file|STDIN} [file...]\n" );
+    fprintf( stderr, "        flash-bundle [--force] [--suppress-validation]\n"
+                     "                     [--ignore-outside] {bundle|STDIN}\n" );
+    fprintf( stderr, "        checksum     [(flash)|--user|--eeprom]\n"
+                     "                     [--pages|--extents]\n"
+                     "                     [--bin] [file|STDIN]\n" );
     fprintf( stderr, "        setsecure\n" );
     fprintf( stderr, "        configure {BSB|SBV|SSB|EB|HSB}"
                      " [--suppress-validation] data\n" );
@@ -386,15 +419,47 @@ static void usage()
 "         reset.  To jump directly into the main program use --no-reset.\n");
     fprintf( stderr,
 "   read: Read the program memory in flash and output non-blank pages in ihex\n"
-"         format.  Use --force to output the entire memory and --bin for binary\n"
-"         output.  User page and eeprom are selected using --user and --eeprom\n");
+"         format.  Use --force to output the entire memory, --bin for binary,\n"
+"         --srec for Motorola S-record and --dfuse for DfuSe (.dfu) output.\n"
+"         User page and eeprom are selected using --user and --eeprom\n"
+"         --record-width sets the data bytes per hex record (default 16, max\n"
+"         255) and --minimal-04 only writes 04 records where they are needed.\n"
+"         --stream writes ihex or binary output as each block is read.\n");
     fprintf( stderr,
 "  erase: Erase memory contents if the chip is not blank or always with --force\n");
     fprintf( stderr,
-"  flash: Flash a program onto device flash memory.  EEPROM and user page are\n"
-"         selected using --eeprom|--user flags. Use --force to ignore warning\n"
-"         when data exists in target memory region.  Bootloader configuration\n"
-"         uses last 4 to 8 bytes of user page, --force always required here.\n");
+"  flash: Flash a program onto device flash memory from an ihex, S-record,\n"
+"         DfuSe or ELF file, which may be gzip or zstd compressed (if built\n"
+"         with zlib / libzstd).  EEPROM and user page are selected using\n"
+"         --eeprom|--user flags, an ELF .eeprom section is also written when\n"
+"         flashing flash.\n"
+"         Use --bin for a raw binary, placed at --offset or the memory start.\n"
+"         --cache-dir keeps parsed images, keyed by the file's SHA-256.\n"
+"         Several files are combined into one image and programmed together,\n"
+"         overlapping data is an error unless --allow-overlap (last wins).\n"
+"         --stream programs an ihex file from STDIN page by page as it is\n"
+"         read, a record behind a page already written is an error that\n"
+"         leaves the device partly programmed.\n"
+"         --if-changed reads back only the pages the image has data for and\n"
+"         writes nothing when the device already holds it.\n"
+"         --plan counts the requests flashing would send and estimates how\n"
+"         long they take, without a device.\n"
+"         --journal records each block written to flash in a file, a run\n"
+"         with the same file and image continues after the last one.\n"
+"         --serial-file writes a file's bytes at an offset, --serial-counter\n"
+"         the number in a file (little endian, b big endian or d decimal\n"
+"         digits) and stores the next number once the unit is programmed.\n"
+"         Use --force to ignore warning when data exists in target memory\n"
+"         region.  Bootloader configuration uses last 4 to 8 bytes of user\n"
+"         page, --force always required here.\n");
+    fprintf( stderr,
+"compile: Write the requests flash would send for a file to stdout as a flash\n"
+"         bundle, without a device.  flash-bundle sends them as they are,\n"
+"         checks for blank memory unless --force and validates the result.\n");
+    fprintf( stderr,
+"checksum: Print the CRC-32 and SHA-256 of the memory as it is read, without\n"
+"         keeping a copy.  --pages or --extents add a line for each page or\n"
+"         run of pages with data.  A file is compared range by range.\n");
     fprintf( stderr, "Note: version 0.6.1 commands still supported.\n");
 }
 
@@ -551,6 +616,17 @@ static int32_t assign_global_options( struct programmer_arguments *args,
         }
     }
 
+    /* Find '--json' if it is here */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strcmp("--json", argv[i]) ) {
+            *argv[i] = '\0';
+            args->json = true;
+            /* only error messages may come before the JSON line */
+            args->quiet = 1;
+            break;
+        }
+    }
+
     /* Find '--suppress-bootloader-mem' if it is here */
     for( i = 0; i < argc; i++ ) {
         if( 0 == strcmp("--suppress-bootloader-mem", argv[i]) ) {
@@ -576,6 +652,7 @@ static int32_t assign_global_options( struct programmer_arguments *args,
                 case com_flash:
                 case com_eflash:
                 case com_user:
+                case com_flash_bundle:
                     args->com_flash_data.suppress_validation = 1;
                     break;
                 default:
@@ -606,6 +683,45 @@ static int32_t assign_global_options( struct programmer_arguments *args,
         }
     }
 
+    /* Find '--if-changed' if it is here - even though it is not
+     * used by all this is easier. */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strcmp("--if-changed", argv[i]) ) {
+            *argv[i] = '\0';
+
+            switch( args->command ) {
+                case com_flash:
+                case com_eflash:
+                case com_user:
+                    args->com_flash_data.if_changed = 1;
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+            break;
+        }
+    }
+
+    /* Find '--plan' to count what flashing would send instead */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strcmp("--plan", argv[i]) ) {
+            *argv[i] = '\0';
+
+            switch( args->command ) {
+                case com_flash:
+                case com_eflash:
+                case com_user:
+                    args->com_flash_data.plan = true;
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+            break;
+        }
+    }
+
     /* Find '--erase-first' if it is here - even though it is not
      * used by all this is easier. */
     for( i = 0; i < argc; i++ ) {
@@ -634,6 +750,7 @@ static int32_t assign_global_options( struct programmer_arguments *args,
                 case com_flash:
                 case com_eflash:
                 case com_user:
+                case com_flash_bundle:
                     args->com_flash_data.ignore_outside = 1;
                     break;
                 default:
@@ -644,6 +761,75 @@ static int32_t assign_global_options( struct programmer_arguments *args,
         }
     }
 
+    /* Find '--allow-overlap' to let later flash inputs replace data */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strcmp("--allow-overlap", argv[i]) ) {
+            *argv[i] = '\0';
+
+            switch( args->command ) {
+                case com_flash:
+                case com_eflash:
+                case com_user:
+                case com_compile:
+                    args->com_flash_data.allow_overlap = true;
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+            break;
+        }
+    }
+
+    /* Find '--pages' or '--extents' for checksums of parts of the memory */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strcmp("--pages", argv[i]) ||
+                0 == strcmp("--extents", argv[i]) ) {
+            switch( args->command ) {
+                case com_checksum:
+                    if( 'p' == argv[i][2] ) {
+                        args->com_checksum_data.pages = true;
+                    } else {
+                        args->com_checksum_data.extents = true;
+                    }
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+            *argv[i] = '\0';
+        }
+    }
+    if( com_checksum == args->command && args->com_checksum_data.pages &&
+            args->com_checksum_data.extents ) {
+        fprintf( stderr, "Use one of --pages and --extents.\n" );
+        return -2;
+    }
+
+    /* Find '--stream' to write a dump or program flash pages while the
+     * memory or STDIN is read */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strcmp("--stream", argv[i]) ) {
+            *argv[i] = '\0';
+
+            switch( args->command ) {
+                case com_read:
+                case com_dump:
+                case com_edump:
+                case com_udump:
+                    args->com_read_data.stream = true;
+                    break;
+                case com_flash:
+                    args->com_flash_data.stream = true;
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+            break;
+        }
+    }
+
     /* Find '--bin' for read binary */
     for( i = 0; i < argc; i++ ) {
         if( 0 == strcmp("--bin", argv[i]) ) {
@@ -656,6 +842,194 @@ static int32_t assign_global_options( struct programmer_arguments *args,
                 case com_udump:
                     args->com_read_data.bin = 1;
                     break;
+                case com_flash:
+                case com_eflash:
+                case com_user:
+                case com_compile:
+                    args->com_flash_data.bin = true;
+                    break;
+                case com_checksum:
+                    args->com_checksum_data.bin = true;
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+            break;
+        }
+    }
+
+    /* Find '--offset' for the address of a binary flash image */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strncmp("--offset", argv[i], 8) ) {
+            char *value;
+            char *end;
+
+            switch( args->command ) {
+                case com_flash:
+                case com_eflash:
+                case com_user:
+                case com_compile:
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+
+            if( !args->com_flash_data.bin ) {
+                fprintf( stderr, "--offset is only used with --bin\n" );
+                return -1;
+            }
+
+            if( 0 == strncmp("--offset=", argv[i], 9) ) {
+                value = &argv[i][9];
+            } else if( '\0' == argv[i][8] && (i+1) < argc ) {
+                value = argv[i+1];
+            } else {
+                return -2;
+            }
+
+            args->com_flash_data.bin_offset =
+                (uint32_t) strtoul( value, &end, 0 );
+            if( value == end || '\0' != *end ) {
+                fprintf( stderr, "invalid --offset address\n" );
+                return -2;
+            }
+            args->com_flash_data.bin_offset_set = true;
+
+            if( value == argv[i+1] ) {
+                *argv[i+1] = '\0';
+            }
+            *argv[i] = '\0';
+            break;
+        }
+    }
+
+    /* Find '--journal=<file>' for resuming a flash that was cut off */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strncmp("--journal=", argv[i], 10) ) {
+            if( com_flash != args->command ) {
+                /* not supported. */
+                return -1;
+            }
+
+            /* only the first character is blanked, the value stays */
+            args->com_flash_data.journal = &argv[i][10];
+            if( '\0' == *args->com_flash_data.journal ) {
+                fprintf( stderr, "--journal needs a file\n" );
+                return -2;
+            }
+
+            *argv[i] = '\0';
+            break;
+        }
+    }
+
+    /* Find '--cache-dir=<directory>' for keeping parsed flash images */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strncmp("--cache-dir=", argv[i], 12) ) {
+            switch( args->command ) {
+                case com_flash:
+                case com_eflash:
+                case com_user:
+                case com_compile:
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+
+            /* only the first character is blanked, the value stays */
+            args->com_flash_data.cache_dir = &argv[i][12];
+            if( '\0' == *args->com_flash_data.cache_dir ) {
+                fprintf( stderr, "--cache-dir needs a directory\n" );
+                return -2;
+            }
+
+            *argv[i] = '\0';
+            break;
+        }
+    }
+
+    /* Find '--srec' for read or bin2hex as Motorola S-records */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strcmp("--srec", argv[i]) ) {
+            *argv[i] = '\0';
+
+            switch( args->command ) {
+                case com_read:
+                    args->com_read_data.srec = true;
+                    break;
+                case com_bin2hex:
+                    args->com_convert_data.srec = true;
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+            break;
+        }
+    }
+
+    /* Find '--dfuse' for read or bin2hex as a DfuSe file */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strcmp("--dfuse", argv[i]) ) {
+            *argv[i] = '\0';
+
+            switch( args->command ) {
+                case com_read:
+                    args->com_read_data.dfuse = true;
+                    break;
+                case com_bin2hex:
+                    args->com_convert_data.dfuse = true;
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+            break;
+        }
+    }
+
+    /* Find '--record-width=<bytes>' for hex output */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strncmp("--record-width=", argv[i], 15) ) {
+            int32_t width = 0;
+
+            if( 1 != sscanf(argv[i], "--record-width=%i", &width) ||
+                    width < 1 || width > 255 ) {
+                fprintf( stderr, "record width must be from 1 to 255\n" );
+                return -1;
+            }
+            *argv[i] = '\0';
+
+            switch( args->command ) {
+                case com_read:
+                    args->com_read_data.record_width = (uint8_t) width;
+                    break;
+                case com_bin2hex:
+                    args->com_convert_data.record_width = (uint8_t) width;
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+            break;
+        }
+    }
+
+    /* Find '--minimal-04' for hex output */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strcmp("--minimal-04", argv[i]) ) {
+            *argv[i] = '\0';
+
+            switch( args->command ) {
+                case com_read:
+                    args->com_read_data.minimal_04 = true;
+                    break;
+                case com_bin2hex:
+                    args->com_convert_data.minimal_04 = true;
+                    break;
                 default:
                     /* not supported. */
                     return -1;
@@ -675,8 +1049,12 @@ static int32_t assign_global_options( struct programmer_arguments *args,
                     break;
                 case com_flash:
                 case com_user:
+                case com_compile:
                     args->com_flash_data.segment = mem_user;
                     break;
+                case com_checksum:
+                    args->com_checksum_data.segment = mem_user;
+                    break;
                 case com_bin2hex:
                     args->com_convert_data.segment = mem_user;
                     break;
@@ -699,8 +1077,12 @@ static int32_t assign_global_options( struct programmer_arguments *args,
                     break;
                 case com_flash:
                 case com_user:
+                case com_compile:
                     args->com_flash_data.segment = mem_eeprom;
                     break;
+                case com_checksum:
+                    args->com_checksum_data.segment = mem_eeprom;
+                    break;
                 case com_bin2hex:
                     args->com_convert_data.segment = mem_eeprom;
                     break;
@@ -721,6 +1103,8 @@ static int32_t assign_global_options( struct programmer_arguments *args,
                 case com_flash :
                 case com_eflash :
                 case com_user :
+                case com_compile :
+                case com_flash_bundle :
                     args->com_flash_data.force = true;
                     break;
                 case com_read :
@@ -782,7 +1166,8 @@ static int32_t assign_global_options( struct programmer_arguments *args,
             switch( args->command ) {
                 case com_flash:
                 case com_eflash:
-                case com_user: {
+                case com_user:
+                case com_compile: {
                     char *hexdigits = &argv[i][9];
                     char *offset_start = hexdigits;
                     size_t num_digits = 0;
@@ -840,6 +1225,100 @@ static int32_t assign_global_options( struct programmer_arguments *args,
         }
     }
 
+    /* Find '--serial-file=<file>:<offset>' */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strncmp("--serial-file=", argv[i], 14) ) {
+            char *file = &argv[i][14];
+            char *offset = strrchr( file, ':' );
+            char *end;
+
+            switch( args->command ) {
+                case com_flash:
+                case com_eflash:
+                case com_user:
+                case com_compile:
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+
+            // the file name can hold a ':' itself, the offset is last
+            if( NULL == offset || offset == file ) {
+                fprintf( stderr, "--serial-file needs file:offset\n" );
+                return -1;
+            }
+            *offset++ = '\0';
+            args->com_flash_data.serial_file_offset =
+                (size_t) strtoul( offset, &end, 0 );
+            if( end == offset || '\0' != *end ) {
+                fprintf( stderr, "Bad --serial-file offset '%s'\n", offset );
+                return -1;
+            }
+            args->com_flash_data.serial_file = file;
+            *argv[i] = '\0';
+            break;
+        }
+    }
+
+    /* Find '--serial-counter=<file>:<offset>:<width>[b|d]' */
+    for( i = 0; i < argc; i++ ) {
+        if( 0 == strncmp("--serial-counter=", argv[i], 17) ) {
+            char *file = &argv[i][17];
+            char *width = strrchr( file, ':' );
+            char *offset;
+            char *end;
+            unsigned long value;
+
+            switch( args->command ) {
+                case com_flash:
+                case com_eflash:
+                case com_user:
+                case com_compile:
+                    break;
+                default:
+                    /* not supported. */
+                    return -1;
+            }
+
+            if( NULL == width || width == file ) {
+                fprintf( stderr, "--serial-counter needs file:offset:width\n" );
+                return -1;
+            }
+            *width++ = '\0';
+            offset = strrchr( file, ':' );
+            if( NULL == offset || offset == file ) {
+                fprintf( stderr, "--serial-counter needs file:offset:width\n" );
+                return -1;
+            }
+            *offset++ = '\0';
+
+            args->com_flash_data.serial_counter_offset =
+                (size_t) strtoul( offset, &end, 0 );
+            if( end == offset || '\0' != *end ) {
+                fprintf( stderr, "Bad --serial-counter offset '%s'\n", offset );
+                return -1;
+            }
+
+            // 1 to 4 binary bytes, little endian unless b, or 1 to 10 digits
+            value = strtoul( width, &end, 10 );
+            args->com_flash_data.serial_counter_format = 'l';
+            if( 'b' == *end || 'd' == *end ) {
+                args->com_flash_data.serial_counter_format = *end++;
+            }
+            if( end == width || '\0' != *end || 0 == value ||
+                    value > (('d' == args->com_flash_data.serial_counter_format)
+                             ? 10 : 4) ) {
+                fprintf( stderr, "Bad --serial-counter width '%s'\n", width );
+                return -1;
+            }
+            args->com_flash_data.serial_counter_width = (uint8_t) value;
+            args->com_flash_data.serial_counter = file;
+            *argv[i] = '\0';
+            break;
+        }
+    }
+
     return 0;
 }
 
@@ -903,9 +1382,22 @@ static int32_t assign_com_flash_option( struct programmer_arguments *args,
                                         const int32_t parameter,
                                         char *value )
 {
+    size_t merge = args->com_flash_data.merge_count;
+
     /* file */
-    args->com_flash_data.original_first_char = *value;
-    args->com_flash_data.file = value;
+    if( 0 == parameter ) {
+        args->com_flash_data.original_first_char = *value;
+        args->com_flash_data.file = value;
+        return 0;
+    }
+
+    /* further files are merged into the same image */
+    if( com_flash_bundle == args->command || merge >= FLASH_MAX_INPUTS - 1 ) {
+        return -1;
+    }
+    args->com_flash_data.merge_first_char[merge] = *value;
+    args->com_flash_data.merge_file[merge] = value;
+    args->com_flash_data.merge_count++;
 
     return 0;
 }
@@ -979,11 +1471,23 @@ static int32_t assign_command_options( struct programmer_arguments *args,
             case com_flash:
             case com_eflash:
             case com_user:
-                required_params = 1;
+            case com_compile:
+            case com_flash_bundle:
+                /* one or more files */
+                required_params = param + 1;
                 if( 0 != assign_com_flash_option(args, param, argv[i]) )
                     return -3;
                 break;
 
+            case com_checksum:
+                /* an optional image to compare with */
+                required_params = 1;
+                if( 0 != param )
+                    return -3;
+                args->com_checksum_data.original_first_char = *argv[i];
+                args->com_checksum_data.file = argv[i];
+                break;
+
             case com_bin2hex:
             case com_hex2bin:
                 required_params = 1;
@@ -1042,6 +1546,7 @@ static void print_args( struct programmer_arguments *args )
     fprintf( stderr, "  vendor_id: 0x%04x\n", args->vendor_id );
     fprintf( stderr, "    command: %s\n", command );
     fprintf( stderr, "      quiet: %s\n", (0 == args->quiet) ? "false" : "true" );
+    fprintf( stderr, "       json: %s\n", args->json ? "true" : "false" );
     fprintf( stderr, "      debug: %d\n", debug );
     fprintf( stderr, "device_type: %s\n", args->device_type_string );
     fprintf( stderr, "------ command specific below ------\n" );
@@ -1062,14 +1567,40 @@ static void print_args( struct programmer_arguments *args )
         case com_flash:
         case com_eflash:
         case com_user:
+        case com_compile:
+        case com_flash_bundle:
             fprintf( stderr, "   validate: %s\n",
                      (args->com_flash_data.suppress_validation) ?
                         "false" : "true" );
             fprintf( stderr, "   hex file: %s\n", args->com_flash_data.file );
+            for( i = 0; i < args->com_flash_data.merge_count; i++ ) {
+                fprintf( stderr, "   hex file: %s\n",
+                         args->com_flash_data.merge_file[i] );
+            }
+            if( args->com_flash_data.stream ) {
+                fprintf( stderr, "     stream: true\n" );
+            }
+            if( args->com_flash_data.plan ) {
+                fprintf( stderr, "       plan: true\n" );
+            }
+            if( NULL != args->com_flash_data.journal ) {
+                fprintf( stderr, "    journal: %s\n",
+                         args->com_flash_data.journal );
+            }
+            if( args->com_flash_data.merge_count ) {
+                fprintf( stderr, "    overlap: %s\n",
+                         args->com_flash_data.allow_overlap ?
+                            "last wins" : "error" );
+            }
             break;
         case com_get:
             fprintf( stderr, "       name: %d\n", args->com_get_data.name );
             break;
+        case com_checksum:
+            fprintf( stderr, "    compare: %s\n",
+                     (NULL == args->com_checksum_data.file) ?
+                        "(none)" : args->com_checksum_data.file );
+            break;
         case com_launch:
             fprintf( stderr, "   no-reset: %d\n", args->com_launch_config.noreset );
             break;
@@ -1082,7 +1613,6 @@ static void print_args( struct programmer_arguments *args )
 
 static int32_t execute_hex2bin( struct programmer_arguments *args ) {
     int32_t  retval = -1;
-    uint32_t  i;
     intel_buffer_out_t bout;
     size_t   memory_size;
     size_t   page_size;
@@ -1106,12 +1636,11 @@ static int32_t execute_hex2bin( struct programmer_arguments *args ) {
     if( !args->quiet )
         fprintf( stderr, "Dumping 0x%X bytes from address offset 0x%X.\n",
                 bout.info.data_end + 1, target_offset );
-    for( i = 0; i <= bout.info.data_end; i++ ) {
-        fprintf( stdout, "%c", bout.data[i] <= 0xFF ? bout.data[i] & 0xFF : 0xFF);
+    if( 0 != intel_bin_from_buffer_out(&bout, bout.info.data_end) ) {
+        fprintf( stderr, "Error writing the binary.\n" );
+        goto error;
     }
 
-    fflush( stdout );
-
     retval = 0;
 
 error:
@@ -1129,6 +1658,7 @@ static int32_t execute_bin2hex( struct programmer_arguments *args ) {
     enum atmel_memory_unit_enum mem_segment = args->com_convert_data.segment;
     size_t mem_size = 0;
     size_t page_size = 0;
+    size_t count;               // bytes read from the file
     uint32_t target_offset = 0; // address offset on the target device
         // NOTE: target_offset may not be set appropriately for device
         // classes other than ADC_AVR32
@@ -1185,18 +1715,32 @@ static int32_t execute_bin2hex( struct programmer_arguments *args ) {
         }
     }
 
-    buin.info.data_end = fread(buin.data, 1, buin.info.total_size, fp);
-    if( buin.info.data_end == 0 ) {
+    count = fread(buin.data, 1, buin.info.total_size, fp);
+    if( count == 0 ) {
         if( !args->quiet ) fprintf( stderr, "ERROR: no bytes read\n" );
         retval = -4;
         goto error;
     }
+    buin.info.data_end = (uint32_t) count - 1;
 
     if( !args->quiet )
-        fprintf( stderr, "Read 0x%X bytes, making hex with address offset 0x%X.\n",
-                buin.info.data_end + 1, target_offset );
-
-    retval = intel_hex_from_buffer( &buin, args->com_convert_data.force, target_offset );
+        fprintf( stderr, "Read 0x%X bytes, making %s with address offset 0x%X.\n",
+                buin.info.data_end + 1,
+                args->com_convert_data.srec ? "S-records" :
+                    (args->com_convert_data.dfuse ? "a DfuSe file" : "hex"),
+                target_offset );
+
+    if( args->com_convert_data.srec ) {
+        retval = srec_from_buffer( &buin, args->com_convert_data.force,
+                target_offset, args->com_convert_data.record_width );
+    } else if( args->com_convert_data.dfuse ) {
+        retval = dfuse_from_buffer( &buin, args->com_convert_data.force,
+                target_offset, args->vendor_id, args->chip_id );
+    } else {
+        retval = intel_hex_from_buffer( &buin, args->com_convert_data.force,
+                target_offset, args->com_convert_data.record_width,
+                args->com_convert_data.minimal_04 );
+    }
 
 error:
     if( NULL != buin.data ) {
@@ -1222,6 +1766,7 @@ int32_t parse_arguments( struct programmer_arguments *args,
     args->target  = tar_none;
     args->command = com_none;
     args->quiet   = 0;
+    args->json    = false;
     args->suppressBootloader = 0;
 
     /* Special case - check for the help commands which do not require a device type */
@@ -1288,6 +1833,9 @@ int32_t parse_arguments( struct programmer_arguments *args,
         case com_bin2hex :
             args->com_convert_data.segment = mem_flash;
             break;
+        case com_checksum :
+            args->com_checksum_data.segment = mem_flash;
+            break;
         default :
             break;
     }
@@ -1313,7 +1861,8 @@ int32_t parse_arguments( struct programmer_arguments *args,
 
     /* if this is a flash command, restore the filename */
     if( (com_flash == args->command) || (com_eflash == args->command)
-            || (com_user == args->command) ) {
+            || (com_user == args->command) || (com_compile == args->command)
+            || (com_flash_bundle == args->command) ) {
         if( 0 == args->com_flash_data.file ) {
 // TODO : it should be ok to not have a filename if --serial=hexdigits:offset is
 // provided, this should be implemented.. in fact, given that most of this
@@ -1325,6 +1874,15 @@ int32_t parse_arguments( struct programmer_arguments *args,
             goto done;
         }
         args->com_flash_data.file[0] = args->com_flash_data.original_first_char;
+        for( i = 0; i < (int32_t) args->com_flash_data.merge_count; i++ ) {
+            args->com_flash_data.merge_file[i][0] =
+                args->com_flash_data.merge_first_char[i];
+        }
+    }
+
+    if( com_checksum == args->command && NULL != args->com_checksum_data.file ) {
+        args->com_checksum_data.file[0] =
+            args->com_checksum_data.original_first_char;
     }
 
     if( (com_bin2hex == args->command) || (com_hex2bin == args->command) ) {
@@ -1336,10 +1894,12 @@ int32_t parse_arguments( struct programmer_arguments *args,
         args->com_convert_data.file[0] = args->com_convert_data.original_first_char;
 
         if ( com_bin2hex == args->command ) {
-            return execute_bin2hex( args );
+            status = execute_bin2hex( args );
         } else {
-            return execute_hex2bin( args );
+            status = execute_hex2bin( args );
         }
+        // either way the command has been handled, there is no device to open
+        return (0 == status) ? 1 : -1;
     }
 
 done:
@@ -1355,3 +1915,181 @@ done:
 
     return status;
 }
+
+
+int32_t parse_serve_arguments( struct serve_arguments *serve,
+                               const size_t argc,
+                               char **argv )
+{
+    size_t i;
+
+    if( argc < 2 || 0 != strcmp("serve", argv[1]) ) {
+        return 1;
+    }
+
+    memset( serve, 0, sizeof(*serve) );
+    serve->keep = 4;
+
+    for( i = 2; i < argc; i++ ) {
+        if( 0 == strcmp("--quiet", argv[i]) ) {
+            serve->quiet = true;
+        } else if( 0 == strncmp("--cache-dir=", argv[i], 12) ) {
+            serve->cache_dir = &argv[i][12];
+            if( '\0' == *serve->cache_dir ) {
+                fprintf( stderr, "--cache-dir needs a directory.\n" );
+                return -1;
+            }
+        } else if( 0 == strncmp("--keep=", argv[i], 7) ) {
+            if( 1 != sscanf(argv[i], "--keep=%u", &serve->keep) ) {
+                fprintf( stderr, "--keep needs a number of images.\n" );
+                return -1;
+            }
+        } else if( 0 == strncmp("--debug=", argv[i], 8) ) {
+            if( 1 != sscanf(argv[i], "--debug=%i", &debug) ) {
+                return -1;
+            }
+        } else if( 0 == strcmp("--debug", argv[i]) ) {
+            if( (i + 1) >= argc || 1 != sscanf(argv[i + 1], "%i", &debug) ) {
+                return -1;
+            }
+            i++;
+        } else if( NULL == serve->socket && '-' != argv[i][0] ) {
+            serve->socket = argv[i];
+        } else {
+            fprintf( stderr, "unrecognized parameter '%s'\n", argv[i] );
+            return -1;
+        }
+    }
+
+    if( NULL == serve->socket ) {
+        fprintf( stderr, "serve needs the path of its socket.\n" );
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t parse_command_chain( struct programmer_arguments *args,
+                             const size_t max,
+                             const size_t argc,
+                             char **argv )
+{
+    char **command_argv = NULL;
+    char first_chars[2];
+    size_t count = 0;
+    size_t start;
+    size_t end;
+    int32_t status;
+
+    for( end = 3; end < argc; end++ ) {
+        if( 0 == strcmp(argv[end], COMMAND_SEPARATOR) ) {
+            break;
+        }
+    }
+    if( end >= argc ) {
+        status = parse_arguments( &args[0], argc, argv );
+        return (0 == status) ? 1 : ((0 < status) ? 0 : status);
+    }
+
+    // each command is parsed as target, command, options on its own
+    command_argv = (char **) malloc( (argc + 1) * sizeof(char *) );
+    if( NULL == command_argv ) {
+        fprintf( stderr, "Unable to allocate memory.\n" );
+        return -1;
+    }
+    command_argv[0] = argv[0];
+    command_argv[1] = argv[1];
+    first_chars[0] = *argv[0];
+    first_chars[1] = *argv[1];
+
+    status = -1;
+    for( start = 2; start <= argc; start = end + 1 ) {
+        for( end = start; end < argc; end++ ) {
+            if( 0 == strcmp(argv[end], COMMAND_SEPARATOR) ) {
+                break;
+            }
+        }
+        if( start == end ) {
+            fprintf( stderr, "A command is missing around '%s'.\n",
+                     COMMAND_SEPARATOR );
+            goto done;
+        }
+        if( count == max ) {
+            fprintf( stderr, "At most %u commands can be chained.\n",
+                     (uint32_t) max );
+            goto done;
+        }
+        // these run without a device, so they cannot share its session
+        if( 0 == strcasecmp(argv[start], "compile")
+                || 0 == strcasecmp(argv[start], "bin2hex")
+                || 0 == strcasecmp(argv[start], "hex2bin") ) {
+            fprintf( stderr, "%s can not be chained with other commands.\n",
+                     argv[start] );
+            goto done;
+        }
+
+        memcpy( &command_argv[2], &argv[start],
+                (end - start) * sizeof(char *) );
+        memset( &args[count], 0, sizeof(args[count]) );
+        if( 0 != parse_arguments(&args[count], end - start + 2,
+                                 command_argv) ) {
+            goto done;
+        }
+        *argv[0] = first_chars[0];
+        *argv[1] = first_chars[1];
+
+        // the device resets or leaves the bootloader when it launches
+        if( (com_launch == args[count].command ||
+             com_start_app == args[count].command ||
+             com_reset == args[count].command) && end < argc ) {
+            fprintf( stderr, "%s must be the last command.\n",
+                     (com_launch == args[count].command) ? "launch" :
+                     (com_reset == args[count].command) ? "reset" : "start" );
+            goto done;
+        }
+        if( (com_flash == args[count].command ||
+             com_eflash == args[count].command ||
+             com_user == args[count].command) &&
+                args[count].com_flash_data.plan ) {
+            fprintf( stderr, "--plan can not be chained with other commands.\n" );
+            goto done;
+        }
+        count++;
+    }
+    status = (int32_t) count;
+
+done:
+    *argv[0] = first_chars[0];
+    *argv[1] = first_chars[1];
+    free( command_argv );
+    return status;
+}
+
+int32_t parse_target( struct programmer_arguments *args, const char *target )
+{
+    char name[64];
+
+    if( strlen(target) >= sizeof(name) ) {
+        return -1;
+    }
+    strcpy( name, target );
+
+    memset( args, 0, sizeof(*args) );
+    args->target  = tar_none;
+    args->command = com_none;
+
+    return assign_target( args, name, target_map );
+}
+
+const char *command_name( const enum commands_enum command )
+{
+    size_t i;
+
+    for( i = 0; NULL != command_map[i].name; i++ ) {
+        if( command == command_map[i].value ) {
+            return command_map[i].name;
+        }
+    }
+
+    return "(unknown)";
+}
@@ -31,6 +31,7 @@ extern "C" {
 #include "atmel.h"
 
 #define DEVICE_TYPE_STRING_MAX_LENGTH   6
+#define FLASH_MAX_INPUTS                8
 /*
  *  atmel_programmer target command
  *
@@ -139,7 +140,8 @@ enum targets_enum { tar_at89c51snd1c,
 enum commands_enum { com_none, com_erase, com_flash, com_user, com_eflash,
                      com_configure, com_get, com_getfuse, com_dump, com_edump,
                      com_udump, com_setfuse, com_setsecure, com_start_app,
-                     com_reset, com_launch, com_read, com_hex2bin, com_bin2hex };
+                     com_reset, com_launch, com_read, com_hex2bin, com_bin2hex,
+                     com_compile, com_flash_bundle, com_checksum };
 
 enum configure_enum { conf_BSB = ATMEL_SET_CONFIG_BSB,
                       conf_SBV = ATMEL_SET_CONFIG_SBV,
@@ -159,6 +161,14 @@ enum getfuse_enum { get_lock, get_epfl, get_bootprot, get_bodlevel,
                     get_bodhyst, get_boden, get_isp_bod_en,
                     get_isp_io_cond_en, get_isp_force };
 
+/* a run of bytes of an image held in memory, address 0 is the first byte of
+ * the memory it is written to */
+typedef struct {
+    uint32_t address;
+    const uint8_t *data;
+    size_t length;
+} image_extent_t;
+
 struct programmer_arguments {
     /* target-specific inputs */
     enum targets_enum target;
@@ -184,6 +194,7 @@ struct programmer_arguments {
     enum commands_enum command;
     char quiet;
     char suppressBootloader;
+    bool json;                          /* report the phases as JSON       */
 
     union {
         struct com_configure_struct {
@@ -199,8 +210,13 @@ struct programmer_arguments {
 
         struct com_read_struct {
             bool bin;
+            bool srec;              /* Motorola S-records instead of ihex */
+            bool dfuse;             /* DfuSe file instead of ihex */
             bool force;             /* do not remove blank pages */
             enum atmel_memory_unit_enum segment;
+            uint8_t record_width;   /* hex data bytes per record, 0 = 16 */
+            bool minimal_04;        /* only write 04 records when needed */
+            bool stream;            /* write each block as it is read */
         } com_read_data;
 
         struct com_erase_struct {
@@ -216,16 +232,40 @@ struct programmer_arguments {
             int32_t suppress_validation;
             char original_first_char;
             char *file;
+            const image_extent_t *extents; /* the image to use instead of */
+            size_t extent_count;           /*     file, NULL for none    */
             int16_t *serial_data; /* serial number or other device specific bytes */
             size_t serial_offset; /* where the serial_data should be written */
             size_t serial_length; /* how many bytes to write */
+            char *serial_file;  /* its bytes are written at
+                                   serial_file_offset, NULL for none */
+            size_t serial_file_offset;
+            char *serial_counter; /* holds the next number to write at
+                                     serial_counter_offset, NULL for none */
+            size_t serial_counter_offset;
+            uint8_t serial_counter_width; /* bytes, or digits for 'd' */
+            char serial_counter_format; /* 'l'/'b' endian binary, 'd'ecimal */
+            uint32_t serial_counter_value; /* the number this run writes */
             bool force;       /* bootloader configuration for UC3 devices
                                      is on last one or two words in the user
                                      page depending on the version of the
                                      bootloader - force overwrite required */
             bool validate_first; /* Do a validate before flashing */
+            bool if_changed; /* Skip it if the device holds the image */
             bool ignore_outside; /* Ignore validate errors outside region */
             bool erase_first; /* Erase flash before writing */
+            bool bin;           /* file is a raw binary image */
+            bool bin_offset_set;
+            uint32_t bin_offset; /* address of the first byte of a binary,
+                                    the start of the memory if not set */
+            char *cache_dir;    /* keep parsed images here, NULL for none */
+            char *merge_file[FLASH_MAX_INPUTS - 1];  /* combined with file, */
+            char merge_first_char[FLASH_MAX_INPUTS - 1]; /* in this order */
+            size_t merge_count;
+            bool allow_overlap; /* later inputs replace overlapping data */
+            bool stream;        /* program STDIN pages as they are read */
+            bool plan;          /* count the requests, without a device */
+            char *journal;      /* record written blocks here, to resume */
             enum atmel_memory_unit_enum segment;
         } com_flash_data;
 
@@ -235,6 +275,10 @@ struct programmer_arguments {
             bool force;             /* do not remove blank pages */
             char *file;                 // for bin2hex / hex2bin conversions
             enum atmel_memory_unit_enum segment;    // to auto-select offset
+            uint8_t record_width;       // hex data bytes per record, 0 = 16
+            bool minimal_04;            // only write 04 records when needed
+            bool srec;                  // bin2hex writes Motorola S-records
+            bool dfuse;                 // bin2hex writes a DfuSe file
         } com_convert_data;
 
         struct com_get_struct {
@@ -244,6 +288,15 @@ struct programmer_arguments {
         struct com_getfuse_struct {
             enum getfuse_enum name;
         } com_getfuse_data;
+
+        struct com_checksum_struct {
+            enum atmel_memory_unit_enum segment;
+            bool pages;             /* a line for each page with data */
+            bool extents;           /* a line for each run of such pages */
+            bool bin;               /* file is a raw binary image */
+            char original_first_char;
+            char *file;             /* image to compare with, NULL for none */
+        } com_checksum_data;
     };
 };
 
@@ -251,6 +304,42 @@ int32_t parse_arguments( struct programmer_arguments *args,
                          const size_t argc,
                          char **argv );
 
+int32_t parse_target( struct programmer_arguments *args, const char *target );
+/* set up args for the target named as on the command line (with an optional
+ * :bus,address), without a command.  returns 0, or -1 for an unknown target
+ */
+
+struct serve_arguments {
+    char *socket;           /* path of the Unix domain socket */
+    char *cache_dir;        /* used by flash jobs that do not give one */
+    uint32_t keep;          /* parsed images kept in memory */
+    bool quiet;
+};
+
+int32_t parse_serve_arguments( struct serve_arguments *serve,
+                               const size_t argc,
+                               char **argv );
+/* parse "serve [--cache-dir=directory] [--keep=images] [--quiet]
+ * [--debug level] socket".  returns 0 for a serve command line, 1 if argv
+ * is not one, or a negative value on an error.
+ */
+
+#define MAX_CHAINED_COMMANDS    16
+#define COMMAND_SEPARATOR       "+"
+
+int32_t parse_command_chain( struct programmer_arguments *args,
+                             const size_t max,
+                             const size_t argc,
+                             char **argv );
+/* parse a command line that may hold several commands for the same target,
+ * separated by COMMAND_SEPARATOR, into args[0] to args[max - 1].  returns the
+ * number of commands, 0 if the command line was handled here (--help etc.)
+ * or a negative value on an error.
+ */
+
+const char *command_name( const enum commands_enum command );
+/* the name command is given by on the command line */
+
 #ifdef __cplusplus
 }
 #endif
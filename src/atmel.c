@@ -34,6 +34,8 @@
 #include "dfu.h"
 #include "atmel.h"
 #include "util.h"
+#include "report.h"
+#include "progress.h"
 
 
 /* Atmel's firmware doesn't export a DFU descriptor in its config
@@ -63,12 +65,6 @@
                                ATMEL_TRACE_THRESHOLD, __VA_ARGS__ )
 
 
-#define PROGRESS_METER  "0%%                            100%%  "
-#define PROGRESS_START  "["
-#define PROGRESS_BAR    ">"
-#define PROGRESS_END    "]  "
-#define PROGRESS_ERROR  " X  "
-
 extern int debug;       /* defined in libdfu.c */
 
 // ________  P R O T O T Y P E S  _______________________________
@@ -121,10 +117,13 @@ static int32_t __atmel_read_block( dfu_device_t *device,
  * data between data_start and data_end
  */
 
-static inline void __print_progress( intel_buffer_info_t *info,
-                                        uint32_t *progress );
-/* calculate how many progress indicator steps to print and print them
- * update progress value
+static int32_t __atmel_flash_blocks( dfu_device_t *device,
+                                     intel_buffer_out_t *bout,
+                                     const bool eeprom );
+/* write the assigned data from info.data_start to info.data_end in blocks
+ * that fit a transfer and a 64kB page, updating the progress the caller
+ * began (if any).  the memory unit has already been selected.  returns 0 on
+ * success, -3 if a page could not be selected and -4 if a block write failed
  */
 
 // ________  F U N C T I O N S  _______________________________
@@ -140,6 +139,7 @@ static int32_t atmel_read_command( dfu_device_t *device,
     buin.info.block_start = data1;
     buin.info.block_end = data1;
     buin.data = buffer;
+    buin.base = 0;
 
     if( NULL == device ) {
         DEBUG( "invalid arguments.\n" );
@@ -195,16 +195,6 @@ static int32_t atmel_read_command( dfu_device_t *device,
     }
 }
 
-static inline void __print_progress( intel_buffer_info_t *info,
-                                        uint32_t *progress ) {
-    if ( !(debug > ATMEL_DEBUG_THRESHOLD) && isatty(2) ) {
-        while ( ((info->block_end - info->data_start + 1) * 32) > *progress ) {
-            fprintf( stderr, PROGRESS_BAR );
-            *progress += info->data_end - info->data_start + 1;
-        }
-    }
-}
-
 int32_t atmel_read_fuses( dfu_device_t *device,
                            atmel_avr32_fuses_t *info ) {
     intel_buffer_in_t buin;
@@ -215,6 +205,7 @@ int32_t atmel_read_fuses( dfu_device_t *device,
     buin.info.block_start = 0;
     buin.info.block_end = 31;
     buin.data = buffer;
+    buin.base = 0;
 
     if( NULL == device ) {
         DEBUG( "invalid arguments.\n" );
@@ -383,6 +374,7 @@ int32_t atmel_erase_flash( dfu_device_t *device,
             // Status command failed.
             dfu_clear_status( device );
             ++retries;
+            report_retry();
             if( !quiet ) fprintf( stderr, "ERROR\n" );
             DEBUG ( "CMD_ERASE status check %d returned nonzero.\n", retries );
         }
@@ -604,7 +596,7 @@ static int32_t __atmel_read_block( dfu_device_t *device,
     }
 
     result = dfu_upload( device, buin->info.block_end - buin->info.block_start + 1,
-                                &buin->data[buin->info.block_start] );
+                                &buin->data[buin->info.block_start - buin->base] );
     if( result < 0) {
         dfu_status_t status;
 
@@ -632,7 +624,6 @@ int32_t atmel_read_flash( dfu_device_t *device,
                           const uint8_t mem_segment,
                           const bool quiet ) {
     uint8_t mem_page = 0;           // tracks the current memory page
-    uint32_t progress = 0;          // used to indicate progress
     int32_t result = 0;
     // TODO : use status instead of result
     int32_t retval = -1;            // the return value for this function
@@ -662,18 +653,9 @@ int32_t atmel_read_flash( dfu_device_t *device,
         return -3;
     }
 
-    if( !quiet ) {
-        if( debug <= ATMEL_DEBUG_THRESHOLD && isatty(2) ) {
-            // NOTE: From here on we should go to finally on error
-            fprintf( stderr, PROGRESS_METER );
-        }
-        fprintf( stderr, "Reading 0x%X bytes...\n",
-                buin->info.data_end - buin->info.data_start + 1 );
-        if( debug <= ATMEL_DEBUG_THRESHOLD && isatty(2) ) {
-            // NOTE: From here on we should go to finally on error
-            fprintf( stderr, PROGRESS_START );
-        }
-    }
+    // NOTE: From here on we should go to finally on error
+    progress_begin( "Reading", buin->info.data_end - buin->info.data_start + 1,
+                    quiet, debug <= ATMEL_DEBUG_THRESHOLD );
 
     // select the first memory page ( not safe for mem_user )
     buin->info.block_start = buin->info.data_start;
@@ -716,21 +698,16 @@ int32_t atmel_read_flash( dfu_device_t *device,
         }
 
         buin->info.block_start = buin->info.block_end + 1;
-        if ( !quiet ) __print_progress( &buin->info, &progress );
+        progress_update( buin->info.block_end - buin->info.data_start + 1 );
     }
     retval = 0;
 
 finally:
+    progress_end( 0 == retval );
     if ( !quiet ) {
         if( 0 == retval ) {
-            if ( debug <= ATMEL_DEBUG_THRESHOLD && isatty(2) ) {
-                fprintf( stderr, PROGRESS_END );
-            }
             fprintf( stderr, "Success\n" );
         } else {
-            if ( debug <= ATMEL_DEBUG_THRESHOLD && isatty(2) ) {
-                fprintf( stderr, PROGRESS_ERROR );
-            }
             fprintf( stderr, "ERROR\n" );
             if( retval==-3 )
                 fprintf( stderr,
@@ -818,6 +795,8 @@ int32_t atmel_blank_check( dfu_device_t *device,
 
     TRACE( "%s( %p, 0x%08X, 0x%08X )\n", __FUNCTION__, device, start, end );
 
+    report_phase( "blank check" );
+
     if( (NULL == device) ) {
         DEBUG( "ERROR: Invalid arguments, device pointer is NULL.\n" );
         return -1;
@@ -1109,6 +1088,7 @@ int32_t atmel_getsecure( dfu_device_t *device ) {
     buin.info.block_start = 0;
     buin.info.block_end = 0;
     buin.data = buffer;
+    buin.base = 0;
 
     dfu_clear_status( device );
 
@@ -1137,13 +1117,73 @@ int32_t atmel_getsecure( dfu_device_t *device ) {
     return( (0 == buffer[0]) ? ATMEL_SECURE_OFF : ATMEL_SECURE_ON );
 }
 
+static int32_t __atmel_flash_blocks( dfu_device_t *device,
+                                     intel_buffer_out_t *bout,
+                                     const bool eeprom ) {
+    uint8_t mem_page;       // tracks the current memory page
+    int32_t result;
+
+    report_phase( "write" );
+    bout->info.block_start = bout->info.data_start;
+    mem_page = bout->info.block_start / ATMEL_64KB_PAGE;
+    if( 0 != (result = atmel_select_page( device, mem_page )) ) {
+        DEBUG( "ERROR selecting 64kB page %d.\n", result );
+        return -3;
+    }
+
+    while (bout->info.block_start <= bout->info.data_end) {
+        // select the memory page if needed (safe for non GRP_AVR32)
+        if ( bout->info.block_start / ATMEL_64KB_PAGE != mem_page ) {
+            mem_page = bout->info.block_start / ATMEL_64KB_PAGE;
+            if( 0 != (result = atmel_select_page( device, mem_page )) ) {
+                DEBUG( "ERROR selecting 64kB page %d.\n", result );
+                return -3;
+            }
+        }
+
+        // find end address (info.block_end) for data section to write
+        for(bout->info.block_end = bout->info.block_start;
+                bout->info.block_end <= bout->info.data_end;
+                bout->info.block_end++) {
+            // check if the current value is valid
+            if( bout->data[bout->info.block_end] > UINT8_MAX ) break;
+            // check if the current data packet is too big
+            if( (bout->info.block_end - bout->info.block_start + 1) > ATMEL_MAX_TRANSFER_SIZE ) break;
+            // check if the current data value is outside of the 64kB flash page
+            if( bout->info.block_end / ATMEL_64KB_PAGE - mem_page ) break;
+        }
+        bout->info.block_end--; // bout->info.block_end was one step beyond the last data value to flash
+
+        // write the data
+        DEBUG("Program data block: 0x%X to 0x%X (p. %u), 0x%X bytes.\n",
+                bout->info.block_start, bout->info.block_end,
+                bout->info.block_end / ATMEL_64KB_PAGE,
+                bout->info.block_end - bout->info.block_start + 1);
+        result = __atmel_flash_block( device, bout, eeprom );
+        if( 0 != result ) {
+            DEBUG( "Error flashing the block: err %d.\n", result );
+            return -4;
+        }
+
+        // increment bout->info.block_start to the next valid address
+        bout->info.block_start = bout->info.block_end + 1;
+        bout->info.block_start += intel_find_assigned(
+                &bout->data[bout->info.block_start],
+                bout->info.data_end - bout->info.block_end );
+        // bout->info.block_start is now on the first valid data for the next segment
+
+        progress_update( bout->info.block_end - bout->info.data_start + 1 );
+    }
+
+    return 0;
+}
+
 int32_t atmel_flash( dfu_device_t *device,
                      intel_buffer_out_t *bout,
                      const bool eeprom,
                      const bool force,
                      const bool quiet ) {
     uint32_t i;
-    uint32_t progress = 0;  // keep record of sent progress as bytes * 32
     uint8_t mem_page = 0;   // tracks the current memory page
     int32_t result = 0;     // result storage for many function calls
     int32_t retval = -1;    // the return value for this function
@@ -1177,12 +1217,11 @@ int32_t atmel_flash( dfu_device_t *device,
 
     // determine the limits of where actual data resides in the buffer
     bout->info.data_start = UINT32_MAX;
-    for( i = 0; i < bout->info.total_size; i++ ) {
-        if( bout->data[i] <= UINT8_MAX ) {
-            bout->info.data_end = i;
-            if (bout->info.data_start == UINT32_MAX)
-                bout->info.data_start = i;
-        }
+    i = intel_find_assigned( bout->data, bout->info.total_size );
+    if( i != bout->info.total_size ) {
+        bout->info.data_start = i;
+        bout->info.data_end = intel_find_assigned_last( bout->data,
+                                                        bout->info.total_size );
     }
 
     // debug info about data limits
@@ -1236,87 +1275,19 @@ int32_t atmel_flash( dfu_device_t *device,
         return -2;
     }
 
-    if( !quiet ) {
-        if( debug <= ATMEL_DEBUG_THRESHOLD && isatty(2) ) {
-            // NOTE: from here on we need to run finally block
-            fprintf( stderr, PROGRESS_METER );
-        }
-        fprintf( stderr, "Programming 0x%X bytes...\n",
-                bout->info.data_end - bout->info.data_start + 1 );
-        if( debug <= ATMEL_DEBUG_THRESHOLD && isatty(2) ) {
-            // NOTE: from here on we need to run finally block
-            fprintf( stderr, PROGRESS_START );
-        }
-    }
+    // NOTE: from here on the progress has to be ended
+    progress_begin( "Programming",
+                    bout->info.data_end - bout->info.data_start + 1,
+                    quiet, debug <= ATMEL_DEBUG_THRESHOLD );
 
     // program the data
-    bout->info.block_start = bout->info.data_start;
-    mem_page = bout->info.block_start / ATMEL_64KB_PAGE;
-    if( 0 != (result = atmel_select_page( device, mem_page )) ) {
-        DEBUG( "ERROR selecting 64kB page %d.\n", result );
-        retval = -3;
-        goto finally;
-    }
-
-    while (bout->info.block_start <= bout->info.data_end) {
-        // select the memory page if needed (safe for non GRP_AVR32)
-        if ( bout->info.block_start / ATMEL_64KB_PAGE != mem_page ) {
-            mem_page = bout->info.block_start / ATMEL_64KB_PAGE;
-            if( 0 != (result = atmel_select_page( device, mem_page )) ) {
-                DEBUG( "ERROR selecting 64kB page %d.\n", result );
-                retval = -3;
-                goto finally;
-            }
-        }
-
-        // find end address (info.block_end) for data section to write
-        for(bout->info.block_end = bout->info.block_start;
-                bout->info.block_end <= bout->info.data_end;
-                bout->info.block_end++) {
-            // check if the current value is valid
-            if( bout->data[bout->info.block_end] > UINT8_MAX ) break;
-            // check if the current data packet is too big
-            if( (bout->info.block_end - bout->info.block_start + 1) > ATMEL_MAX_TRANSFER_SIZE ) break;
-            // check if the current data value is outside of the 64kB flash page
-            if( bout->info.block_end / ATMEL_64KB_PAGE - mem_page ) break;
-        }
-        bout->info.block_end--; // bout->info.block_end was one step beyond the last data value to flash
+    retval = __atmel_flash_blocks( device, bout, eeprom );
 
-        // write the data
-        DEBUG("Program data block: 0x%X to 0x%X (p. %u), 0x%X bytes.\n",
-                bout->info.block_start, bout->info.block_end,
-                bout->info.block_end / ATMEL_64KB_PAGE,
-                bout->info.block_end - bout->info.block_start + 1);
-        result = __atmel_flash_block( device, bout, eeprom );
-        if( 0 != result ) {
-            DEBUG( "Error flashing the block: err %d.\n", result );
-            retval = -4;
-            goto finally;
-        }
-
-        // increment bout->info.block_start to the next valid address
-        for(bout->info.block_start = bout->info.block_end + 1;
-                bout->info.block_start <= bout->info.data_end;
-                bout->info.block_start++) {
-            if( (bout->data[bout->info.block_start] <= UINT8_MAX) ) break;
-        } // bout->info.block_start is now on the first valid data for the next segment
-
-        // display progress in 32 increments (if not hidden)
-        if ( !quiet ) __print_progress( &bout->info, &progress );
-    }
-    retval = 0;
-
-finally:
+    progress_end( 0 == retval );
     if ( !quiet ) {
         if( 0 == retval ) {
-            if ( debug <= ATMEL_DEBUG_THRESHOLD && isatty(2) ) {
-                fprintf( stderr, PROGRESS_END );
-            }
             fprintf( stderr, "Success\n" );
         } else {
-            if ( debug <= ATMEL_DEBUG_THRESHOLD && isatty(2) ) {
-                fprintf( stderr, PROGRESS_ERROR );
-            }
             fprintf( stderr, "ERROR\n" );
             if( retval==-3 )
                 fprintf( stderr,
@@ -1330,6 +1301,59 @@ finally:
     return retval;
 }
 
+int32_t atmel_flash_range( dfu_device_t *device,
+                           intel_buffer_out_t *bout,
+                           const uint32_t start,
+                           const uint32_t end,
+                           const bool force ) {
+    intel_buffer_info_t info;
+    uint32_t first;
+    int32_t result;
+
+    TRACE( "%s( %p, %p, 0x%X, 0x%X, %s )\n", __FUNCTION__, device, bout,
+            start, end, ((true == force) ? "true" : "false") );
+
+    if( (NULL == device) || (NULL == bout) || (start > end) ||
+            (end >= bout->info.total_size) ) {
+        DEBUG( "ERROR: Invalid arguments.\n" );
+        return -1;
+    }
+
+    intel_flash_prep_pages( bout, start, end );
+
+    first = intel_find_assigned( &bout->data[start], end - start + 1 );
+    if( first == end - start + 1 ) {
+        return 0;
+    }
+
+    // the reader keeps the data limits of the whole image in bout->info
+    info = bout->info;
+    bout->info.data_start = start + first;
+    bout->info.data_end = start + intel_find_assigned_last( &bout->data[start],
+                                                            end - start + 1 );
+    DEBUG( "Program range 0x%X to 0x%X.\n",
+            bout->info.data_start, bout->info.data_end );
+
+    if( (bout->info.data_start < bout->info.valid_start) ||
+            (bout->info.data_end > bout->info.valid_end) ) {
+        DEBUG( "ERROR: Data exists outside of the valid target flash region.\n" );
+        result = -1;
+    } else if( !force && 0 != (result = atmel_blank_check(device,
+                    bout->info.data_start, bout->info.data_end, true)) ) {
+        // the blank check selects flash itself, so it goes before the select
+        DEBUG( "The target memory is not blank.\n" );
+        result = (result > 0) ? 1 : -2;
+    } else if( 0 != atmel_select_memory_unit(device, mem_flash) ) {
+        DEBUG( "Error selecting memory unit.\n" );
+        result = -2;
+    } else {
+        result = __atmel_flash_blocks( device, bout, false );
+    }
+
+    bout->info = info;
+    return result;
+}
+
 static void atmel_flash_populate_footer( uint8_t *message, uint8_t *footer,
                                          const uint16_t vendorId,
                                          const uint16_t productId,
@@ -172,6 +172,19 @@ int32_t atmel_flash( dfu_device_t *device,
  * hide_progress bool sets whether to display progress
  */
 
+int32_t atmel_flash_range( dfu_device_t *device,
+                           intel_buffer_out_t *bout,
+                           const uint32_t start,
+                           const uint32_t end,
+                           const bool force );
+/* Flash the data in bout from start to end (inclusive, whole pages) to the
+ * main program memory, for programming an image while the rest of it is
+ * still being read.  The pages holding data are filled with 0xFF, checked to
+ * be blank unless force is set and written without any output.
+ * returns 0 on success, 1 if the memory is not blank, -1 if the data is
+ * outside the valid region, < -1 for communication errors.
+ */
+
 int32_t atmel_user( dfu_device_t *device,
                     intel_buffer_out_t *bout );
 /* Flash data to the user page.  Provide the buffer and the size of
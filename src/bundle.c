@@ -0,0 +1,430 @@
+/*
+ * dfu-programmer
+ *
+ * bundle.c
+ *
+ * Writes and plays back flash bundles: the exact DFU requests that
+ * programming a memory image sends, recorded once by the compile command
+ * so that flash-bundle only has to stream them to the device.
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "bundle.h"
+#include "dfu.h"
+#include "sha256.h"
+#include "util.h"
+
+#define BUNDLE_MAGIC            "DFUBUNDL"
+#define BUNDLE_VERSION          1
+#define BUNDLE_HEADER_SIZE      96
+#define BUNDLE_DIGEST_OFFSET    64
+#define BUNDLE_REQUEST_SIZE     8       // request, reserved, value, length
+#define BUNDLE_ALIGN(n)         (((size_t) (n) + 3) & ~((size_t) 3))
+#define BUNDLE_WRITER_CHUNK     0x10000
+
+#define BUNDLE_DEBUG_THRESHOLD  50
+#define BUNDLE_TRACE_THRESHOLD  55
+
+#define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               BUNDLE_DEBUG_THRESHOLD, __VA_ARGS__ )
+#define TRACE(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               BUNDLE_TRACE_THRESHOLD, __VA_ARGS__ )
+
+// ________  P R O T O T Y P E S  _______________________________
+static uint32_t bundle_get_word( const uint8_t *ptr );
+static uint16_t bundle_get_half( const uint8_t *ptr );
+static void bundle_put_word( uint8_t *ptr, uint32_t value );
+static void bundle_put_half( uint8_t *ptr, uint16_t value );
+/* read / write a little endian field */
+
+static void bundle_digest( const uint8_t *file, size_t size,
+        uint8_t digest[SHA256_DIGEST_SIZE] );
+/* SHA-256 of a bundle file, taking the digest field as zeros */
+
+
+// ________  F U N C T I O N S  _______________________________
+static uint32_t bundle_get_word( const uint8_t *ptr ) {
+    return ((uint32_t) ptr[3] << 24) | ((uint32_t) ptr[2] << 16) |
+           ((uint32_t) ptr[1] <<  8) |  (uint32_t) ptr[0];
+}
+
+static uint16_t bundle_get_half( const uint8_t *ptr ) {
+    return (uint16_t) ((ptr[1] << 8) | ptr[0]);
+}
+
+static void bundle_put_word( uint8_t *ptr, uint32_t value ) {
+    ptr[0] = (uint8_t) value;
+    ptr[1] = (uint8_t) (value >> 8);
+    ptr[2] = (uint8_t) (value >> 16);
+    ptr[3] = (uint8_t) (value >> 24);
+}
+
+static void bundle_put_half( uint8_t *ptr, uint16_t value ) {
+    ptr[0] = (uint8_t) value;
+    ptr[1] = (uint8_t) (value >> 8);
+}
+
+static void bundle_digest( const uint8_t *file, size_t size,
+        uint8_t digest[SHA256_DIGEST_SIZE] ) {
+    static const uint8_t zeros[SHA256_DIGEST_SIZE] = { 0 };
+    sha256_context_t ctx;
+
+    sha256_init( &ctx );
+    sha256_update( &ctx, file, BUNDLE_DIGEST_OFFSET );
+    sha256_update( &ctx, zeros, sizeof(zeros) );
+    sha256_update( &ctx, &file[BUNDLE_HEADER_SIZE], size - BUNDLE_HEADER_SIZE );
+    sha256_final( &ctx, digest );
+}
+
+void bundle_writer_init( bundle_writer_t *writer ) {
+    writer->data = NULL;
+    writer->used = 0;
+    writer->allocated = 0;
+    writer->count = 0;
+}
+
+void bundle_writer_free( bundle_writer_t *writer ) {
+    if( NULL != writer->data ) {
+        free( writer->data );
+    }
+    bundle_writer_init( writer );
+}
+
+int32_t bundle_record( void *context, uint8_t request, uint16_t value,
+        const uint8_t *data, size_t length ) {
+    bundle_writer_t *writer = (bundle_writer_t *) context;
+    size_t needed = BUNDLE_REQUEST_SIZE + BUNDLE_ALIGN(length);
+    uint8_t *record;
+
+    TRACE( "%s( %u, %u, %u )\n", __FUNCTION__, request, value, length );
+
+    if( DFU_UPLOAD == request ) {
+        DEBUG( "A bundle cannot read from the device.\n" );
+        return -1;
+    }
+
+    if( writer->allocated - writer->used < needed ) {
+        size_t allocated = writer->allocated + needed + BUNDLE_WRITER_CHUNK;
+        uint8_t *larger = (uint8_t *) realloc( writer->data, allocated );
+        if( NULL == larger ) {
+            DEBUG( "Unable to allocate 0x%X bytes.\n", (uint32_t) allocated );
+            return -1;
+        }
+        writer->data = larger;
+        writer->allocated = allocated;
+    }
+
+    record = &writer->data[writer->used];
+    memset( record, 0, needed );
+    record[0] = request;
+    bundle_put_half( &record[2], value );
+    bundle_put_word( &record[4], (uint32_t) length );
+    if( length ) {
+        memcpy( &record[BUNDLE_REQUEST_SIZE], data, length );
+    }
+    writer->used += needed;
+    writer->count++;
+
+    return 0;
+}
+
+int32_t bundle_write( FILE *fp, const bundle_writer_t *writer,
+        uint16_t vendor_id, uint16_t chip_id, uint32_t device_type,
+        uint32_t memory, const intel_buffer_out_t *bout ) {
+    uint8_t *file;
+    size_t image_size = 2 * (size_t) (bout->info.data_end -
+                                      bout->info.data_start + 1);
+    size_t size = BUNDLE_HEADER_SIZE + writer->used + image_size;
+    uint8_t *image;
+    uint32_t i;
+    int32_t retval = 0;
+
+    file = (uint8_t *) calloc( size, 1 );
+    if( NULL == file ) {
+        DEBUG( "Unable to allocate 0x%X bytes.\n", (uint32_t) size );
+        return -1;
+    }
+
+    memcpy( file, BUNDLE_MAGIC, 8 );
+    bundle_put_word( &file[8], BUNDLE_VERSION );
+    bundle_put_word( &file[12], BUNDLE_HEADER_SIZE );
+    bundle_put_half( &file[16], vendor_id );
+    bundle_put_half( &file[18], chip_id );
+    bundle_put_word( &file[20], device_type );
+    bundle_put_word( &file[24], memory );
+    bundle_put_word( &file[28], (uint32_t) bout->info.total_size );
+    bundle_put_word( &file[32], (uint32_t) bout->info.page_size );
+    bundle_put_word( &file[36], bout->info.data_start );
+    bundle_put_word( &file[40], bout->info.data_end );
+    bundle_put_word( &file[44], bout->info.valid_start );
+    bundle_put_word( &file[48], bout->info.valid_end );
+    bundle_put_word( &file[52], writer->count );
+    bundle_put_word( &file[56], (uint32_t) writer->used );
+    bundle_put_word( &file[60], (uint32_t) image_size );
+
+    if( writer->used ) {
+        memcpy( &file[BUNDLE_HEADER_SIZE], writer->data, writer->used );
+    }
+
+    image = &file[BUNDLE_HEADER_SIZE + writer->used];
+    for( i = bout->info.data_start; i <= bout->info.data_end; i++ ) {
+        bundle_put_half( image, bout->data[i] );
+        image += 2;
+    }
+
+    bundle_digest( file, size, &file[BUNDLE_DIGEST_OFFSET] );
+
+    if( size != fwrite(file, 1, size, fp) || 0 != fflush(fp) ) {
+        retval = -1;
+    }
+
+    free( file );
+    return retval;
+}
+
+int32_t bundle_open( const char *filename, dfu_bundle_t *bundle, bool quiet ) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    size_t image_size;
+    FILE *fp;
+
+    memset( bundle, 0, sizeof(dfu_bundle_t) );
+
+#ifndef _WIN32
+    if( 0 != strcmp("STDIN", filename) ) {
+        struct stat st;
+        int fd = open( filename, O_RDONLY );
+
+        if( fd < 0 ) {
+            if( !quiet ) fprintf( stderr, "Error opening %s\n", filename );
+            return -1;
+        }
+        if( 0 == fstat(fd, &st) && st.st_size > 0 ) {
+            // private and writable, dfu_download takes a non-const pointer
+            void *map = mmap( NULL, (size_t) st.st_size,
+                              PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+            if( MAP_FAILED != map ) {
+                bundle->file = (uint8_t *) map;
+                bundle->size = (size_t) st.st_size;
+                bundle->mapped = true;
+            }
+        }
+        close( fd );
+    }
+#endif
+
+    if( NULL == bundle->file ) {
+        if( 0 == strcmp("STDIN", filename) ) {
+            fp = stdin;
+        } else {
+            fp = fopen( filename, "rb" );
+            if( NULL == fp ) {
+                if( !quiet ) fprintf( stderr, "Error opening %s\n", filename );
+                return -1;
+            }
+        }
+        bundle->file = dfu_read_all( fp, &bundle->size );
+        if( stdin != fp ) {
+            fclose( fp );
+        }
+        if( NULL == bundle->file ) {
+            if( !quiet ) fprintf( stderr, "Error reading %s\n", filename );
+            return -1;
+        }
+    }
+
+    if( bundle->size < BUNDLE_HEADER_SIZE ||
+            0 != memcmp(bundle->file, BUNDLE_MAGIC, 8) ||
+            BUNDLE_VERSION != bundle_get_word(&bundle->file[8]) ||
+            BUNDLE_HEADER_SIZE != bundle_get_word(&bundle->file[12]) ) {
+        if( !quiet ) fprintf( stderr, "%s is not a flash bundle.\n", filename );
+        goto error;
+    }
+
+    bundle_digest( bundle->file, bundle->size, digest );
+    if( 0 != memcmp(digest, &bundle->file[BUNDLE_DIGEST_OFFSET],
+                    sizeof(digest)) ) {
+        if( !quiet ) fprintf( stderr, "Flash bundle checksum mismatch.\n" );
+        goto error;
+    }
+
+    bundle->vendor_id = bundle_get_half( &bundle->file[16] );
+    bundle->chip_id = bundle_get_half( &bundle->file[18] );
+    bundle->device_type = bundle_get_word( &bundle->file[20] );
+    bundle->memory = bundle_get_word( &bundle->file[24] );
+    bundle->total_size = bundle_get_word( &bundle->file[28] );
+    bundle->page_size = bundle_get_word( &bundle->file[32] );
+    bundle->data_start = bundle_get_word( &bundle->file[36] );
+    bundle->data_end = bundle_get_word( &bundle->file[40] );
+    bundle->valid_start = bundle_get_word( &bundle->file[44] );
+    bundle->valid_end = bundle_get_word( &bundle->file[48] );
+    bundle->request_count = bundle_get_word( &bundle->file[52] );
+    bundle->requests_size = bundle_get_word( &bundle->file[56] );
+    image_size = bundle_get_word( &bundle->file[60] );
+
+    if( bundle->data_start > bundle->data_end ||
+            bundle->data_end >= bundle->total_size ||
+            image_size != 2 * (size_t) (bundle->data_end - bundle->data_start + 1) ||
+            bundle->size != BUNDLE_HEADER_SIZE + bundle->requests_size + image_size ) {
+        if( !quiet ) fprintf( stderr, "Flash bundle layout is invalid.\n" );
+        goto error;
+    }
+
+    bundle->requests = &bundle->file[BUNDLE_HEADER_SIZE];
+    bundle->image = &bundle->requests[bundle->requests_size];
+
+    DEBUG( "Bundle of %u requests for %04X:%04X, 0x%X to 0x%X.\n",
+            bundle->request_count, bundle->vendor_id, bundle->chip_id,
+            bundle->data_start, bundle->data_end );
+    return 0;
+
+error:
+    bundle_close( bundle );
+    return -2;
+}
+
+void bundle_close( dfu_bundle_t *bundle ) {
+    if( NULL != bundle->file ) {
+#ifndef _WIN32
+        if( bundle->mapped ) {
+            munmap( bundle->file, bundle->size );
+        } else
+#endif
+        free( bundle->file );
+    }
+    bundle->file = NULL;
+    bundle->requests = NULL;
+    bundle->image = NULL;
+}
+
+int32_t bundle_play( dfu_device_t *device, const dfu_bundle_t *bundle,
+        bool quiet ) {
+    uint8_t *record = bundle->requests;
+    uint8_t *end = bundle->requests + bundle->requests_size;
+    dfu_status_t status;
+    uint32_t i;
+    int32_t result;
+    int32_t retval = -1;
+
+    if( !quiet ) {
+        fprintf( stderr, "Programming 0x%X bytes...\n",
+                bundle->data_end - bundle->data_start + 1 );
+    }
+
+    for( i = 0; i < bundle->request_count; i++ ) {
+        uint8_t request;
+        uint16_t value;
+        uint32_t length;
+
+        if( end - record < BUNDLE_REQUEST_SIZE ) {
+            DEBUG( "Request %u is truncated.\n", i );
+            goto finally;
+        }
+        request = record[0];
+        value = bundle_get_half( &record[2] );
+        length = bundle_get_word( &record[4] );
+        // a control transfer moves at most wLength bytes
+        if( UINT16_MAX < length ) {
+            DEBUG( "Request %u length 0x%X is too large.\n", i, length );
+            goto finally;
+        }
+        if( (size_t) (end - record) - BUNDLE_REQUEST_SIZE < BUNDLE_ALIGN(length) ) {
+            DEBUG( "Request %u is truncated.\n", i );
+            goto finally;
+        }
+
+        if( DFU_DNLOAD == request ) {
+            TRACE( "DFU_DNLOAD %u, 0x%X bytes.\n", value, length );
+            dfu_set_transaction_num( device, value );
+            result = dfu_download( device, length,
+                        length ? &record[BUNDLE_REQUEST_SIZE] : NULL );
+            if( (int32_t) length != result ) {
+                if( -EPIPE == result ) {
+                    fprintf( stderr, "Device is write protected.\n" );
+                    dfu_clear_status( device );
+                } else {
+                    DEBUG( "Request %u dfu_download failed.\n", i );
+                }
+                retval = -2;
+                goto finally;
+            }
+        } else if( DFU_GETSTATUS == request ) {
+            if( 0 != dfu_get_status(device, &status) ) {
+                DEBUG( "Request %u DFU_GETSTATUS failed.\n", i );
+                retval = -3;
+                goto finally;
+            }
+            if( DFU_STATUS_OK != status.bStatus ) {
+                DEBUG( "Request %u status (%s) was not OK.\n", i,
+                        dfu_status_to_string(status.bStatus) );
+                if( STATE_DFU_ERROR == status.bState ) {
+                    dfu_clear_status( device );
+                }
+                retval = (int32_t) status.bStatus;
+                goto finally;
+            }
+        } else {
+            DEBUG( "Request %u has unknown type %u.\n", i, request );
+            goto finally;
+        }
+
+        record += BUNDLE_REQUEST_SIZE + BUNDLE_ALIGN(length);
+    }
+    retval = 0;
+
+finally:
+    if( !quiet ) {
+        fprintf( stderr, 0 == retval ? "Success\n" : "ERROR\n" );
+    }
+
+    return retval;
+}
+
+int32_t bundle_image_to_buffer( const dfu_bundle_t *bundle,
+        intel_buffer_out_t *bout ) {
+    const uint8_t *image = bundle->image;
+    uint32_t i;
+
+    if( bout->info.total_size != bundle->total_size ) {
+        DEBUG( "Buffer size 0x%X does not match the bundle 0x%X.\n",
+                (uint32_t) bout->info.total_size, bundle->total_size );
+        return -1;
+    }
+
+    for( i = bundle->data_start; i <= bundle->data_end; i++ ) {
+        bout->data[i] = bundle_get_half( image );
+        image += 2;
+    }
+    bout->info.data_start = bundle->data_start;
+    bout->info.data_end = bundle->data_end;
+    bout->info.valid_start = bundle->valid_start;
+    bout->info.valid_end = bundle->valid_end;
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * dfu-programmer
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+#ifndef __BUNDLE_H__
+#define __BUNDLE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "dfu-device.h"
+#include "intel_hex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A flash bundle holds the requests that programming one memory sends to
+ * the device: every DFU_DNLOAD payload (memory and page selection, address
+ * pointer commands and the data blocks with their header, padding and
+ * footer) and the DFU_GETSTATUS checks between them, followed by the image
+ * used to validate the result.  All fields are little endian.
+ */
+
+typedef struct {
+    uint16_t vendor_id;         // the target the bundle was compiled for
+    uint16_t chip_id;
+    uint32_t device_type;
+    uint32_t memory;            // atmel_memory_unit_enum
+    uint32_t total_size;        // buffer layout, as in intel_buffer_info_t
+    uint32_t page_size;
+    uint32_t data_start;
+    uint32_t data_end;
+    uint32_t valid_start;
+    uint32_t valid_end;
+    uint32_t request_count;
+    uint8_t *requests;          // request_count requests
+    size_t requests_size;
+    uint8_t *image;             // data_start to data_end as uint16_t
+    uint8_t *file;              // the whole file, mapped or read
+    size_t size;
+    bool mapped;
+} dfu_bundle_t;
+
+typedef struct {
+    uint8_t *data;              // the requests recorded so far
+    size_t used;
+    size_t allocated;
+    uint32_t count;
+} bundle_writer_t;
+
+void bundle_writer_init( bundle_writer_t *writer );
+void bundle_writer_free( bundle_writer_t *writer );
+/* set up / release a writer for recording requests */
+
+int32_t bundle_record( void *context, uint8_t request, uint16_t value,
+        const uint8_t *data, size_t length );
+/* a dfu_recorder_t appending a request to the bundle_writer_t context
+ * return 0 on success, -1 if out of memory or for an upload, which a bundle
+ * cannot replay
+ */
+
+int32_t bundle_write( FILE *fp, const bundle_writer_t *writer,
+        uint16_t vendor_id, uint16_t chip_id, uint32_t device_type,
+        uint32_t memory, const intel_buffer_out_t *bout );
+/* write a bundle with the recorded requests for programming bout (after
+ * the backend prepared it) into memory of the given target to fp.
+ * return 0 on success, -1 on a write error
+ */
+
+int32_t bundle_open( const char *filename, dfu_bundle_t *bundle, bool quiet );
+/* map (or read, for STDIN and where mmap is not available) a bundle file
+ * and check its SHA-256 and layout.  release it with bundle_close.
+ * return 0 on success, < 0 on error
+ */
+
+void bundle_close( dfu_bundle_t *bundle );
+
+int32_t bundle_play( dfu_device_t *device, const dfu_bundle_t *bundle,
+        bool quiet );
+/* send the requests of the bundle to the device, straight from the file.
+ * stops at the first request that fails or status that is not OK.
+ * return 0 on success, < 0 on communication errors, > 0 for a DFU status
+ */
+
+int32_t bundle_image_to_buffer( const dfu_bundle_t *bundle,
+        intel_buffer_out_t *bout );
+/* fill bout, set up with the bundle's total and page size, with the image
+ * the bundle programs so it can be validated.  return 0 on success
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
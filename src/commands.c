@@ -27,13 +27,52 @@
 #include "config.h"
 #include "commands.h"
 #include "arguments.h"
+#include "elf.h"
 #include "intel_hex.h"
+#include "srec.h"
+#include "dfuse.h"
+#include "image_cache.h"
+#include "journal.h"
+#include "sha256.h"
+#include "bundle.h"
+#include "plan.h"
 #include "stm32.h"
 #include "atmel.h"
 #include "util.h"
+#include "report.h"
 
 #define COMMAND_DEBUG_THRESHOLD 40
 
+/* prepare_flash_image found no data for an extra segment */
+#define FLASH_IMAGE_EMPTY       (-1)
+
+/* a streamed dump reads and writes the memory this many bytes at a time */
+#define DUMP_STREAM_CHUNK       0x4000
+
+/* checksum and --if-changed read the memory into a window of this many
+ * bytes at a time */
+#define CHECKSUM_CHUNK          0x4000
+
+/* a streamed flash programs complete pages once this many have collected */
+#define FLASH_STREAM_BATCH      0x400
+
+/* the digests of one address range of a checksum */
+typedef struct {
+    uint32_t start;
+    uint32_t crc;
+    sha256_context_t sha;
+} checksum_range_t;
+
+/* a flash programmed while its file is still being read */
+typedef struct {
+    dfu_device_t *device;
+    struct programmer_arguments *args;
+    uint32_t flushed;       // everything below this has been programmed
+    uint32_t high;          // one past the highest record read so far
+    bool ordered;           // no record has gone backwards yet
+    int32_t result;         // why programming stopped the read
+} flash_stream_t;
+
 #define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
                                COMMAND_DEBUG_THRESHOLD, __VA_ARGS__ )
 
@@ -47,6 +86,100 @@ static int32_t execute_validate( dfu_device_t *device,
  * flash or eeprom data sections, also wether you want it quiet
  */
 
+static int32_t image_on_device( dfu_device_t *device,
+                                intel_buffer_out_t *bout,
+                                enum atmel_memory_unit_enum mem_segment,
+                                const bool quiet );
+/* read back only the pages bout has data for and compare the assigned bytes,
+ * stopping at the first difference.  returns 1 if the device already holds
+ * the image, 0 if it does not, or a negative value if it could not be read
+ */
+
+static int32_t prepare_flash_image( struct programmer_arguments *args,
+                                    enum atmel_memory_unit_enum mem_type,
+                                    const bool elf_input,
+                                    const bool extra_segment,
+                                    intel_buffer_out_t *bout,
+                                    flash_stream_t *stream );
+/* read the flash file (or the extents given instead) into bout, serialize
+ * it and check it against the bootloader region and user page rules.  the
+ * caller frees bout->data.
+ * with a stream, complete pages of an ihex file are programmed as it is
+ * read.  returns SUCCESS, FLASH_IMAGE_EMPTY if an extra segment has no
+ * data, or an error code
+ */
+
+static int32_t extents_to_buffer( const image_extent_t *extents,
+                                  const size_t count,
+                                  intel_buffer_out_t *bout );
+/* copy the extents into bout, like intel_hex_to_buffer does with a file.
+ * returns 0, or the number of bytes outside bout, which are left out
+ */
+
+static void dump_trim_blank( intel_buffer_in_t *buin, bool quiet );
+/* move info.data_start / data_end of a dump in to the pages with data, or
+ * to a single blank page if there is none
+ */
+
+static uint32_t dump_stream_chunk( uint32_t page_size );
+/* the size of the window read --stream reads at a time, whole pages
+ */
+
+static int32_t dump_stream_blank( uint32_t length );
+/* write length blank bytes of a binary dump to stdout, returns 0 or -1
+ */
+
+static int32_t dump_stream( dfu_device_t *device,
+                            struct programmer_arguments *args,
+                            intel_buffer_in_t *buin,
+                            uint32_t target_offset );
+/* read the memory from info.data_start to data_end in chunks and write
+ * each one out as soon as it has been read.  buin->data only needs to hold
+ * dump_stream_chunk() bytes, it is moved along the memory with buin->base.
+ * returns SUCCESS or an error
+ */
+
+static bool checksum_print( checksum_range_t *range,
+                            checksum_range_t *expected,
+                            uint32_t end, uint32_t target_offset );
+/* print the digests of range, which ends at end (inclusive).  with an
+ * expected range from an image the line says whether they match, false is
+ * returned if they do not
+ */
+
+static int32_t flash_stream_flush( flash_stream_t *stream,
+                                   intel_buffer_out_t *bout,
+                                   uint32_t end );
+/* program the pages of bout from stream->flushed up to end (exclusive).
+ * returns SUCCESS or an error code
+ */
+
+static int32_t flash_stream_record( void *context, intel_buffer_out_t *bout,
+                                    uint32_t address, uint32_t length );
+/* intel_record_hook_t for a flash_stream_t, programs the pages below a
+ * record while the records keep moving forwards
+ */
+
+static int32_t flash_journaled( dfu_device_t *device,
+                                struct programmer_arguments *args,
+                                intel_buffer_out_t *bout,
+                                flash_journal_t *journal );
+/* write the flash image in bout a block at a time, recording each block in
+ * the journal.  a journal of the same image whose last block reads back is
+ * carried on from after that block, without erasing or blank checking.
+ * returns 0, or non-zero if the image could not be written
+ */
+
+static int32_t merge_flash_inputs( struct programmer_arguments *args,
+                                   enum atmel_memory_unit_enum mem_type,
+                                   const bool extra_segment,
+                                   uint32_t target_offset,
+                                   intel_buffer_out_t *bout );
+/* read each further flash file and combine it into bout, overlapping data
+ * is an error unless allow_overlap is set.  for an extra segment only ELF
+ * files are read.  returns SUCCESS or an error code
+ */
+
 // ________  F U N C T I O N S  _______________________________
 static void security_check( dfu_device_t *device ) {
     if( ADC_AVR32 == device->type ) {
@@ -84,6 +217,7 @@ static int32_t execute_erase( dfu_device_t *device,
 
     DEBUG( "erase 0x%X bytes.\n",
            (args->flash_address_top - args->flash_address_bottom) );
+    report_phase( "erase" );
 
     if( GRP_STM32 & args->device_type ) {
         result = stm32_erase_flash( device, args->quiet );
@@ -126,20 +260,185 @@ static int32_t execute_setsecure( dfu_device_t *device,
     return SUCCESS;
 }
 
+// read the number --serial-counter writes this run from its file
+static int32_t serial_counter_read( struct programmer_arguments *args ) {
+    char *file = args->com_flash_data.serial_counter;
+    char text[12];
+    char *end;
+    unsigned long long value;
+    FILE *fp;
+
+    fp = fopen( file, "r" );
+    if( NULL == fp ) {
+        fprintf( stderr, "Unable to open the serial counter %s.\n", file );
+        return ARGUMENT_ERROR;
+    }
+    // %u would take a sign and wrap "-1" to the largest number
+    value = UINT64_MAX;
+    if( 1 == fscanf(fp, "%11s", text) && '0' <= text[0] && text[0] <= '9' &&
+            strlen(text) <= 10 ) {
+        value = strtoull( text, &end, 10 );
+        if( '\0' != *end ) {
+            value = UINT64_MAX;
+        }
+    }
+    fclose( fp );
+    if( UINT32_MAX < value ) {
+        fprintf( stderr, "%s does not hold a serial number.\n", file );
+        return ARGUMENT_ERROR;
+    } else if( UINT32_MAX == value ) {
+        // there would be no next number to store after this unit
+        fprintf( stderr, "The serial numbers in %s are used up.\n", file );
+        return ARGUMENT_ERROR;
+    }
+
+    args->com_flash_data.serial_counter_value = (uint32_t) value;
+    return SUCCESS;
+}
+
+// store the number after the one that was programmed, once the unit is done.
+// it is written to a temporary file and renamed so a crash never loses it
+static int32_t serial_counter_advance( struct programmer_arguments *args ) {
+    char *file = args->com_flash_data.serial_counter;
+    uint32_t next = args->com_flash_data.serial_counter_value + 1;
+    size_t length = strlen( file ) + 5;
+    char *temp;
+    int32_t retval = UNSPECIFIED_ERROR;
+    FILE *fp;
+
+    // wrapping to 0 would hand out numbers that were used already
+    if( UINT32_MAX == args->com_flash_data.serial_counter_value ) {
+        fprintf( stderr, "Serial number %u is the last, %s is not advanced.\n",
+                 args->com_flash_data.serial_counter_value, file );
+        return ARGUMENT_ERROR;
+    }
+    temp = (char *) malloc( length );
+    if( NULL == temp ) {
+        return BUFFER_INIT_ERROR;
+    }
+    snprintf( temp, length, "%s.tmp", file );
+    fp = fopen( temp, "w" );
+    if( NULL == fp ) {
+        goto done;
+    }
+    if( 0 > fprintf(fp, "%u\n", next) ) {
+        fclose( fp );
+        remove( temp );
+        goto done;
+    }
+    if( 0 != fclose(fp) ) {
+        remove( temp );
+        goto done;
+    }
+#ifdef _WIN32
+    remove( file );
+#endif
+    if( 0 != rename(temp, file) ) {
+        remove( temp );
+        goto done;
+    }
+    retval = SUCCESS;
+
+done:
+    if( SUCCESS != retval ) {
+        fprintf( stderr, "Unable to store the next serial number in %s.\n",
+                 file );
+    }
+    free( temp );
+    return retval;
+}
+
+// the bytes a --serial-counter value is written as
+static size_t serial_counter_bytes( struct programmer_arguments *args,
+                                    uint8_t *bytes ) {
+    uint32_t value = args->com_flash_data.serial_counter_value;
+    size_t width = args->com_flash_data.serial_counter_width;
+    size_t i;
+
+    for( i = 0; i < width; i++ ) {
+        switch( args->com_flash_data.serial_counter_format ) {
+            case 'd':
+                bytes[width - 1 - i] = (uint8_t) ('0' + value % 10);
+                value /= 10;
+                break;
+            case 'b':
+                bytes[width - 1 - i] = (uint8_t) value;
+                value >>= 8;
+                break;
+            default:
+                bytes[i] = (uint8_t) value;
+                value >>= 8;
+                break;
+        }
+    }
+
+    if( 0 != value ) {
+        fprintf( stderr, "Serial number %u does not fit in %u %s.\n",
+                 args->com_flash_data.serial_counter_value, (uint32_t) width,
+                 ('d' == args->com_flash_data.serial_counter_format) ?
+                    "digits" : "bytes" );
+        return 0;
+    }
+    return width;
+}
+
 // TODO : split this into a new command (no file is needed) - also general
 // format of this program is that only 1 command is run at a time.. caveat is
 // that if program sets a section in memory to '\0' and serialize sets it
 // otherwise, the section will end up '\0' unless a page erase is used.. so may
 // need to keep this part of the flash command, but specify that serialize data
 // 'wins' over data from the hex file
+// patch the per unit fields into an image, which may have come straight from
+// the image cache, this only touches the bytes of the fields
 static int32_t serialize_memory_image( intel_buffer_out_t *bout,
                                      struct programmer_arguments *args ) {
     uint32_t target_offset = 0;
+    uint8_t counter[10];
+    uint8_t *data;
+    size_t length;
+    size_t i;
+
     if( args->command == com_user )
         target_offset = ATMEL_USER_PAGE_OFFSET;
     else if( args->device_type & GRP_STM32 )
         target_offset = STM32_FLASH_OFFSET;
 
+    if( NULL != args->com_flash_data.serial_file ) {
+        FILE *fp = fopen( args->com_flash_data.serial_file, "rb" );
+
+        data = (NULL == fp) ? NULL : dfu_read_all( fp, &length );
+        if( NULL != fp ) {
+            fclose( fp );
+        }
+        if( NULL == data ) {
+            fprintf( stderr, "Unable to read the serial file %s.\n",
+                     args->com_flash_data.serial_file );
+            return BUFFER_INIT_ERROR;
+        }
+        for( i = 0; i < length; i++ ) {
+            if( 0 != intel_process_data(bout, data[i], target_offset,
+                        args->com_flash_data.serial_file_offset + i) ) {
+                free( data );
+                return BUFFER_INIT_ERROR;
+            }
+        }
+        free( data );
+    }
+
+    if( NULL != args->com_flash_data.serial_counter ) {
+        if( SUCCESS != serial_counter_read(args) ||
+                0 == (length = serial_counter_bytes(args, counter)) ) {
+            return BUFFER_INIT_ERROR;
+        }
+        for( i = 0; i < length; i++ ) {
+            if( 0 != intel_process_data(bout, counter[i], target_offset,
+                        args->com_flash_data.serial_counter_offset + i) ) {
+                return BUFFER_INIT_ERROR;
+            }
+        }
+        DEBUG( "Serial number %u.\n", args->com_flash_data.serial_counter_value );
+    }
+
     if ( NULL != args->com_flash_data.serial_data ) {
         int16_t *serial_data = args->com_flash_data.serial_data;
         uint32_t length = args->com_flash_data.serial_length;
@@ -174,6 +473,7 @@ static int32_t execute_validate( dfu_device_t *device,
     buin.info.data_start = bout->info.valid_start;
     buin.info.data_end = bout->info.valid_end;
 
+    report_phase( "verify" );
     if( device->type & GRP_STM32 ) {
         result = stm32_read_flash( device, &buin, mem_segment, quiet );
     } else {
@@ -212,6 +512,86 @@ error:
     return retval;
 }
 
+static int32_t image_on_device( dfu_device_t *device,
+                                intel_buffer_out_t *bout,
+                                enum atmel_memory_unit_enum mem_segment,
+                                const bool quiet ) {
+    int32_t retval = 1;
+    intel_buffer_in_t buin;     // a window onto the memory
+    uint32_t page_size = (uint32_t) bout->info.page_size;
+    uint32_t length;
+    uint32_t start;
+    uint32_t end;
+    uint32_t i;
+
+    if( UINT32_MAX == bout->info.data_start ||
+            bout->info.data_start > bout->info.data_end ) {
+        return 0;
+    }
+    if( 0 == page_size ) {
+        page_size = (uint32_t) bout->info.total_size;
+    }
+    report_phase( "compare" );
+
+    buin.info.total_size = bout->info.total_size;
+    buin.info.page_size = page_size;
+    length = CHECKSUM_CHUNK + page_size - 1;
+    length -= length % page_size;
+    buin.data = (uint8_t *) malloc( length );
+    if( NULL == buin.data ) {
+        DEBUG( "ERROR allocating 0x%X bytes of memory.\n", length );
+        return -1;
+    }
+
+    if( !quiet ) fprintf( stderr, "Comparing the image with the device...  " );
+    for( start = bout->info.data_start; start <= bout->info.data_end;
+            start = end + 1 ) {
+        // pages without data are not read at all
+        start += (uint32_t) intel_find_assigned( &bout->data[start],
+                                        bout->info.data_end - start + 1 );
+        if( start > bout->info.data_end ) {
+            break;
+        }
+        start -= start % page_size;
+        end = start + length - 1;
+        if( end > bout->info.data_end ) {
+            end = bout->info.data_end;
+        }
+
+        buin.base = start;
+        buin.info.data_start = start;
+        buin.info.data_end = end;
+        if( device->type & GRP_STM32 ) {
+            retval = stm32_read_flash( device, &buin, mem_segment, true );
+        } else {
+            retval = atmel_read_flash( device, &buin, mem_segment, true );
+        }
+        if( 0 != retval ) {
+            DEBUG( "ERROR: could not read memory, err %d.\n", retval );
+            if( !quiet ) fprintf( stderr, "ERROR\n" );
+            retval = -2;
+            goto done;
+        }
+        retval = 1;
+
+        for( i = start; i <= end; i++ ) {
+            if( bout->data[i] <= UINT8_MAX &&
+                    bout->data[i] != buin.data[i - start] ) {
+                DEBUG( "The device differs at 0x%X.\n", i );
+                retval = 0;
+                goto done;
+            }
+        }
+    }
+
+done:
+    if( !quiet && retval >= 0 ) {
+        fprintf( stderr, retval ? "Unchanged.\n" : "Changed.\n" );
+    }
+    free( buin.data );
+    return retval;
+}
+
 static void print_flash_usage( intel_buffer_info_t *info ) {
     fprintf( stderr,
             "0x%X bytes written into 0x%X bytes memory (%.02f%%).\n",
@@ -221,16 +601,25 @@ static void print_flash_usage( intel_buffer_info_t *info ) {
                 (float) (info->valid_end - info->valid_start + 1)) ) ;
 }
 
-static int32_t execute_flash( dfu_device_t *device,
-                                struct programmer_arguments *args ) {
+static int32_t prepare_flash_image( struct programmer_arguments *args,
+                                    enum atmel_memory_unit_enum mem_type,
+                                    const bool elf_input,
+                                    const bool extra_segment,
+                                    intel_buffer_out_t *bout,
+                                    flash_stream_t *stream ) {
     int32_t  retval = UNSPECIFIED_ERROR;
     int32_t  result;
     uint32_t  i;
-    intel_buffer_out_t bout;
     size_t   memory_size;
     size_t   page_size;
-    enum atmel_memory_unit_enum mem_type = args->com_flash_data.segment;
     uint32_t target_offset = 0;
+    uint32_t bin_offset;
+    image_cache_key_t cache_key;
+    bool cache_keyed = false;
+    bool cached = false;
+    // only ELF files have data for an extra segment
+    bool skip_input = extra_segment && !elf_input;
+    bool in_memory = NULL != args->com_flash_data.extents;
 
     /* assign the correct memory size */
     switch ( mem_type ) {
@@ -248,6 +637,9 @@ static int32_t execute_flash( dfu_device_t *device,
             }
             memory_size = args->eeprom_memory_size;
             page_size = args->eeprom_page_size;
+            if( elf_input && (args->device_type & (ADC_AVR | ADC_XMEGA)) ) {
+                target_offset = ELF_AVR_EEPROM_OFFSET;
+            }
             break;
         case mem_user:
             memory_size = args->flash_page_size;
@@ -266,16 +658,56 @@ static int32_t execute_flash( dfu_device_t *device,
     }
 
     // ----------------- CONVERT HEX FILE TO BINARY -------------------------
-    if( 0 != intel_init_buffer_out(&bout, memory_size, page_size) ) {
+    if( 0 != intel_init_buffer_out(bout, memory_size, page_size) ) {
         DEBUG("ERROR initializing a buffer.\n");
         retval = BUFFER_INIT_ERROR;
         goto error;
     }
 
-    result = intel_hex_to_buffer( args->com_flash_data.file, &bout,
-            target_offset, args->quiet );
+    bin_offset = args->com_flash_data.bin_offset_set ?
+        args->com_flash_data.bin_offset : target_offset;
+
+    if( NULL != stream ) {
+        // pages are checked against the flash region as they are written
+        bout->info.valid_start = args->flash_address_bottom;
+        bout->info.valid_end = args->flash_address_top;
+    }
+
+    /* a cached image of the same file skips parsing it again, the key can
+     * only be made with a cache directory or while images are kept */
+    if( !skip_input && !in_memory ) {
+        cache_keyed = (0 == image_cache_key( &cache_key,
+                    args->com_flash_data.cache_dir, args->com_flash_data.file,
+                    bout, target_offset, args->com_flash_data.bin,
+                    bin_offset ));
+        cached = cache_keyed && (0 == image_cache_load( &cache_key, bout ));
+    }
 
-    if ( result < 0 ) {
+    if( cached || skip_input ) {
+        result = 0;
+    } else if( in_memory ) {
+        result = extents_to_buffer( args->com_flash_data.extents,
+                                    args->com_flash_data.extent_count, bout );
+    } else if( args->com_flash_data.bin ) {
+        result = intel_bin_to_buffer( args->com_flash_data.file, bout,
+                target_offset, bin_offset, args->quiet );
+    } else if( NULL != stream ) {
+        result = intel_hex_stream_to_buffer( args->com_flash_data.file, bout,
+                target_offset, args->quiet, flash_stream_record, stream );
+    } else {
+        result = intel_hex_to_buffer( args->com_flash_data.file, bout,
+                target_offset, args->quiet );
+    }
+
+    /* only images without warnings are cached, so a hit never hides one */
+    if( cache_keyed && !cached && 0 == result ) {
+        image_cache_store( &cache_key, bout );
+    }
+
+    if ( NULL != stream && SUCCESS != stream->result ) {
+        retval = stream->result;
+        goto error;
+    } else if ( result < 0 ) {
         DEBUG( "Something went wrong with creating the memory image.\n" );
         retval = BUFFER_INIT_ERROR;
         goto error;
@@ -293,25 +725,43 @@ static int32_t execute_flash( dfu_device_t *device,
             fprintf( stderr, " and will not be written.\n" );
         }
     }
+    if( 0 != args->com_flash_data.merge_count ) {
+        retval = merge_flash_inputs( args, mem_type, extra_segment,
+                                     target_offset, bout );
+        if( SUCCESS != retval ) {
+            goto error;
+        }
+        retval = UNSPECIFIED_ERROR;
+    }
+
 // TODO : consider accepting a string to flash to the user page as well as a hex
 // file.. this would be easier than using serialize and could return the address
 // location of the start of the string (to be used in the program file)
 
-    if (0 != serialize_memory_image( &bout, args )) {
+    if( extra_segment ) {
+        if( bout->info.data_start == UINT32_MAX ) {
+            DEBUG( "No data for memory %d in the image.\n", mem_type );
+            return FLASH_IMAGE_EMPTY;
+        }
+    } else if (0 != serialize_memory_image( bout, args )) {
         retval = BUFFER_INIT_ERROR;
         goto error;
     }
 
     if( mem_type == mem_flash ) {
-        bout.info.valid_start = args->flash_address_bottom;
-        bout.info.valid_end = args->flash_address_top;
+        bout->info.valid_start = args->flash_address_bottom;
+        bout->info.valid_end = args->flash_address_top;
 
-        // check that there isn't anything overlapping the bootloader
+        // check that there isn't anything overlapping the bootloader,
+        // pages that were streamed have been checked already
         for( i = args->bootloader_bottom; i <= args->bootloader_top; i++) {
-            if( bout.data[i] <= UINT8_MAX ) {
+            if( NULL != stream && i < stream->flushed ) {
+                continue;
+            }
+            if( bout->data[i] <= UINT8_MAX ) {
                 if( true == args->suppressBootloader ) {
                     //If we're ignoring the bootloader, don't write to it
-                    bout.data[i] = UINT16_MAX;
+                    bout->data[i] = UINT16_MAX;
                 } else {
                     fprintf( stderr, "Bootloader and code overlap.\n" );
                     fprintf( stderr, "Use --suppress-bootloader-mem to ignore\n" );
@@ -323,14 +773,14 @@ static int32_t execute_flash( dfu_device_t *device,
     } else if ( mem_type == mem_user ) {
         // check here about overwriting?
 
-        if ( bout.info.data_start == UINT32_MAX ) {
+        if ( bout->info.data_start == UINT32_MAX ) {
             fprintf( stderr,
                     "ERROR: No data to write into the user page.\n" );
             retval = BUFFER_INIT_ERROR;
             goto error;
         } else {
             DEBUG("Hex file contains %u bytes to write.\n",
-                    bout.info.data_end - bout.info.data_start + 1 );
+                    bout->info.data_end - bout->info.data_start + 1 );
         }
 
         if ( !(args->com_flash_data.force) ) {
@@ -356,11 +806,11 @@ static int32_t execute_flash( dfu_device_t *device,
             // checking the bootloader version to make sure the right number of
             // words are blocked / written.
             //  ----------- the below for loop is not currently in use -----------
-            for ( i = bout.info.total_size - 8; i < bout.info.total_size; i++ ) {
-                if ( -1 != bout.data[i] ) {
+            for ( i = bout->info.total_size - 8; i < bout->info.total_size; i++ ) {
+                if ( -1 != bout->data[i] ) {
                     fprintf( stderr,
                             "ERROR: data overlap with bootloader configuration word(s).\n" );
-                    DEBUG( "At position %d, value is %d.\n", i, bout.data[i] );
+                    DEBUG( "At position %d, value is %d.\n", i, bout->data[i] );
                     fprintf( stderr,
                             "ERROR: use the --force-config flag to write the data.\n" );
                     retval = ARGUMENT_ERROR;
@@ -370,6 +820,433 @@ static int32_t execute_flash( dfu_device_t *device,
         }
     }
 
+    return SUCCESS;
+
+error:
+    return retval;
+}
+
+static int32_t extents_to_buffer( const image_extent_t *extents,
+                                  const size_t count,
+                                  intel_buffer_out_t *bout ) {
+    int32_t outside = 0;
+    uint64_t address;
+    size_t i;
+    size_t j;
+
+    for( i = 0; i < count; i++ ) {
+        for( j = 0; j < extents[i].length; j++ ) {
+            address = (uint64_t) extents[i].address + j;
+            if( address >= bout->info.total_size ) {
+                outside++;
+                continue;
+            }
+            bout->data[address] = extents[i].data[j];
+            if( address < bout->info.data_start ) {
+                bout->info.data_start = (uint32_t) address;
+            }
+            if( address > bout->info.data_end ) {
+                bout->info.data_end = (uint32_t) address;
+            }
+        }
+    }
+
+    return outside;
+}
+
+static int32_t merge_flash_inputs( struct programmer_arguments *args,
+                                   enum atmel_memory_unit_enum mem_type,
+                                   const bool extra_segment,
+                                   uint32_t target_offset,
+                                   intel_buffer_out_t *bout ) {
+    int32_t retval = UNSPECIFIED_ERROR;
+    int32_t result;
+    intel_buffer_out_t image;
+    uint32_t overlap;
+    uint32_t offset;
+    size_t i;
+
+    image.data = NULL;
+
+    for( i = 0; i < args->com_flash_data.merge_count; i++ ) {
+        char *file = args->com_flash_data.merge_file[i];
+        bool elf_input = (0 != strcmp("STDIN", file)) && elf_check_file( file );
+
+        if( extra_segment && !elf_input ) {
+            continue;
+        }
+
+        offset = target_offset;
+        if( mem_eeprom == mem_type ) {
+            offset = (elf_input && (args->device_type & (ADC_AVR | ADC_XMEGA))) ?
+                ELF_AVR_EEPROM_OFFSET : 0;
+        }
+
+        if( 0 != intel_init_buffer_out(&image, bout->info.total_size,
+                                       bout->info.page_size) ) {
+            DEBUG( "ERROR initializing a buffer.\n" );
+            retval = BUFFER_INIT_ERROR;
+            goto error;
+        }
+
+        result = intel_hex_to_buffer( file, &image, offset, args->quiet );
+        if( result < 0 ) {
+            DEBUG( "Something went wrong with creating the memory image.\n" );
+            retval = BUFFER_INIT_ERROR;
+            goto error;
+        } else if( result > 0 && !args->quiet ) {
+            fprintf( stderr, "WARNING: 0x%X bytes of %s are outside target "
+                             "memory,\n and will not be written.\n", result, file );
+        }
+
+        result = intel_merge_buffer( bout, &image,
+                                     args->com_flash_data.allow_overlap,
+                                     &overlap );
+        if( -1 == result ) {
+            fprintf( stderr, "%s overlaps an earlier file at 0x%X.\n", file,
+                     offset + overlap );
+            fprintf( stderr, "Use --allow-overlap to let later files win.\n" );
+            retval = BUFFER_INIT_ERROR;
+            goto error;
+        } else if( result < 0 ) {
+            retval = BUFFER_INIT_ERROR;
+            goto error;
+        } else if( result > 0 ) {
+            DEBUG( "%s replaced 0x%X bytes of earlier files.\n", file, result );
+        }
+
+        free( image.data );
+        image.data = NULL;
+    }
+
+    retval = SUCCESS;
+
+error:
+    if( NULL != image.data ) {
+        free( image.data );
+        image.data = NULL;
+    }
+
+    return retval;
+}
+
+static int32_t flash_stream_flush( flash_stream_t *stream,
+                                   intel_buffer_out_t *bout,
+                                   uint32_t end ) {
+    struct programmer_arguments *args = stream->args;
+    uint32_t i;
+    int32_t result;
+
+    if( end <= stream->flushed ) {
+        return SUCCESS;
+    }
+
+    // check that there isn't anything overlapping the bootloader
+    i = (args->bootloader_bottom > stream->flushed) ?
+        args->bootloader_bottom : stream->flushed;
+    for( ; i <= args->bootloader_top && i < end; i++ ) {
+        if( bout->data[i] <= UINT8_MAX ) {
+            if( true == args->suppressBootloader ) {
+                bout->data[i] = UINT16_MAX;
+            } else {
+                fprintf( stderr, "Bootloader and code overlap.\n" );
+                fprintf( stderr, "Use --suppress-bootloader-mem to ignore\n" );
+                return BUFFER_INIT_ERROR;
+            }
+        }
+    }
+
+    DEBUG( "Streaming pages 0x%X to 0x%X.\n", stream->flushed, end - 1 );
+    report_phase( "write" );
+    result = atmel_flash_range( stream->device, bout, stream->flushed, end - 1,
+                                args->com_flash_data.force );
+    if( 1 == result ) {
+        fprintf( stderr, "The target memory for the program is not blank.\n"
+                         "Use --force flag to override this error check.\n" );
+        return FLASH_WRITE_ERROR;
+    } else if( -1 == result ) {
+        fprintf( stderr, "Hex file error, use debug for more info.\n" );
+        return BUFFER_INIT_ERROR;
+    } else if( 0 != result ) {
+        fprintf( stderr, "Memory write error, use debug for more info.\n" );
+        return FLASH_WRITE_ERROR;
+    }
+
+    stream->flushed = end;
+    return SUCCESS;
+}
+
+static int32_t flash_stream_record( void *context, intel_buffer_out_t *bout,
+                                    uint32_t address, uint32_t length ) {
+    flash_stream_t *stream = (flash_stream_t *) context;
+    uint32_t complete;
+
+    if( address < stream->flushed ) {
+        fprintf( stderr, "Data for 0x%X arrived after its page was written.\n",
+                 address );
+        fprintf( stderr, "The device is left partly programmed, up to 0x%X.\n"
+                         "Flash this file without --stream.\n",
+                 stream->flushed - 1 );
+        stream->result = BUFFER_INIT_ERROR;
+        return -1;
+    }
+
+    if( address < stream->high ) {
+        if( stream->ordered ) {
+            DEBUG( "Record at 0x%X is out of order, buffering the rest.\n",
+                   address );
+            stream->ordered = false;
+        }
+    } else if( stream->ordered ) {
+        // later records start at or above this one, the pages below are done
+        complete = address - address % bout->info.page_size;
+        if( complete >= stream->flushed + FLASH_STREAM_BATCH ) {
+            stream->result = flash_stream_flush( stream, bout, complete );
+            if( SUCCESS != stream->result ) {
+                return -1;
+            }
+            report_phase( "parse" );
+        }
+    }
+
+    if( address + length > stream->high ) {
+        stream->high = address + length;
+    }
+    return 0;
+}
+
+static int32_t flash_journaled( dfu_device_t *device,
+                                struct programmer_arguments *args,
+                                intel_buffer_out_t *bout,
+                                flash_journal_t *journal ) {
+    int32_t result;
+    intel_buffer_info_t info;
+    uint32_t page_size = (uint32_t) bout->info.page_size;
+    uint32_t block_size;
+    uint32_t start;
+    uint32_t end;
+    char target[16];
+    bool stm32 = 0 != (args->device_type & GRP_STM32);
+    bool resume;
+
+    // the image is prepared as atmel_flash and stm32_write_flash do it
+    if( 0 == page_size ) {
+        page_size = (uint32_t) bout->info.total_size;
+    }
+    block_size = JOURNAL_BLOCK_SIZE + page_size - 1;
+    block_size -= block_size % page_size;
+
+    intel_flash_prep_buffer( bout );
+    bout->info.data_start = (uint32_t) intel_find_assigned( bout->data,
+                                                bout->info.total_size );
+    if( bout->info.data_start == bout->info.total_size ) {
+        DEBUG( "ERROR: No valid data to flash.\n" );
+        fprintf( stderr, "Hex file error, use debug for more info.\n" );
+        return -1;
+    }
+    bout->info.data_end = intel_find_assigned_last( bout->data,
+                                                    bout->info.total_size );
+    if( (bout->info.data_start < bout->info.valid_start) ||
+            (bout->info.data_end > bout->info.valid_end) ) {
+        DEBUG( "ERROR: Data exists outside of the valid target flash region.\n" );
+        fprintf( stderr, "Hex file error, use debug for more info.\n" );
+        return -1;
+    }
+
+    snprintf( target, sizeof(target), "%04x:%04x", args->vendor_id,
+              args->chip_id );
+    if( 0 != journal_open(journal, args->com_flash_data.journal, target,
+                          bout) ) {
+        return -1;
+    }
+
+    // the last block was recorded once written, check it really was
+    resume = journal->resume;
+    if( resume ) {
+        info = bout->info;
+        bout->info.data_start = journal->last_start;
+        bout->info.data_end = journal->last_end;
+        result = image_on_device( device, bout, mem_flash, true );
+        bout->info = info;
+        if( 1 != result ) {
+            DEBUG( "The journaled block 0x%X to 0x%X differs. (err %d)\n",
+                   journal->last_start, journal->last_end, result );
+            resume = false;
+        }
+        if( !args->quiet ) {
+            if( resume ) {
+                fprintf( stderr, "Resuming after 0x%X from the journal.\n",
+                         journal->last_end );
+            } else {
+                fprintf( stderr, "The journal's last block did not read back,"
+                                 " starting over.\n" );
+            }
+        }
+    }
+    if( 0 != journal_begin(journal, resume) ) {
+        return -1;
+    }
+
+    if( resume ) {
+        start = journal->last_end + 1;
+    } else {
+        start = bout->info.data_start - bout->info.data_start % block_size;
+
+        if( 1 == args->com_flash_data.erase_first ) {
+            report_phase( "erase" );
+            if( stm32 ) {
+                result = stm32_erase_flash( device, args->quiet );
+            } else {
+                result = atmel_erase_flash( device, ATMEL_ERASE_ALL,
+                                            args->quiet );
+            }
+            if( 0 != result ) {
+                DEBUG( "Error erasing flash. (err %d)\n", result );
+                return result;
+            }
+        }
+
+        if( !stm32 && !args->com_flash_data.force &&
+                0 != atmel_blank_check(device, bout->info.data_start,
+                                       bout->info.data_end, args->quiet) ) {
+            if( !args->quiet ) {
+                fprintf( stderr,
+                        "The target memory for the program is not blank.\n"
+                        "Use --force flag to override this error check.\n" );
+            }
+            return -1;
+        }
+    }
+
+    report_phase( "write" );
+    if( !args->quiet ) {
+        end = (start > bout->info.data_start) ? start : bout->info.data_start;
+        fprintf( stderr, "Programming 0x%X bytes in 0x%X byte blocks...  ",
+                 (end <= bout->info.data_end) ?
+                    bout->info.data_end - end + 1 : 0, block_size );
+    }
+    for( ; start <= bout->info.data_end; start = end + 1 ) {
+        end = start - start % block_size + block_size - 1;
+        if( end >= bout->info.total_size ) {
+            end = (uint32_t) bout->info.total_size - 1;
+        }
+
+        // only blocks with data are written and recorded
+        if( (size_t) (end - start + 1) ==
+                intel_find_assigned(&bout->data[start], end - start + 1) ) {
+            continue;
+        }
+
+        if( stm32 ) {
+            result = stm32_write_range( device, bout, start, end );
+        } else {
+            result = atmel_flash_range( device, bout, start, end, true );
+        }
+        if( 0 != result ) {
+            DEBUG( "Error writing 0x%X to 0x%X. (err %d)\n", start, end,
+                   result );
+            if( !args->quiet ) {
+                fprintf( stderr, "ERROR\n"
+                         "Memory write error, use debug for more info.\n" );
+            }
+            return result;
+        }
+        if( 0 != journal_block(journal, start, end) ) {
+            return -1;
+        }
+    }
+    if( !args->quiet ) {
+        fprintf( stderr, "Success\n" );
+    }
+
+    return 0;
+}
+
+static int32_t flash_segment( dfu_device_t *device,
+                              struct programmer_arguments *args,
+                              enum atmel_memory_unit_enum mem_type,
+                              const bool elf_input,
+                              const bool extra_segment ) {
+    int32_t  retval = UNSPECIFIED_ERROR;
+    int32_t  result;
+    intel_buffer_out_t bout;
+    flash_stream_t stream;
+    flash_journal_t journal;
+    bool streaming = args->com_flash_data.stream && mem_flash == mem_type &&
+        !extra_segment && !(args->device_type & GRP_STM32) &&
+        0 == strcmp("STDIN", args->com_flash_data.file);
+
+    bout.data = NULL;
+    memset( &journal, 0, sizeof(journal) );
+
+    if( streaming ) {
+        // pages are written as the file is read, so erase first
+        if( 1 == args->com_flash_data.erase_first ) {
+            report_phase( "erase" );
+            if( 0 != (result = atmel_erase_flash(device, ATMEL_ERASE_ALL,
+                                                 args->quiet)) ) {
+                DEBUG( "Error erasing flash. (err %d)\n", result );
+                return result;
+            }
+        }
+        memset( &stream, 0, sizeof(stream) );
+        stream.device = device;
+        stream.args = args;
+        stream.ordered = true;
+        stream.result = SUCCESS;
+    } else if( args->com_flash_data.stream ) {
+        DEBUG( "Only ihex flash from STDIN to an Atmel device is streamed.\n" );
+    }
+
+    report_phase( "parse" );
+    retval = prepare_flash_image( args, mem_type, elf_input, extra_segment,
+                                  &bout, streaming ? &stream : NULL );
+    if( FLASH_IMAGE_EMPTY == retval ) {
+        goto success;
+    } else if( SUCCESS != retval ) {
+        goto error;
+    }
+
+    if( streaming ) {
+        // program whatever is left, then validate the whole image
+        retval = flash_stream_flush( &stream, &bout,
+                                     (uint32_t) bout.info.total_size );
+        if( SUCCESS != retval ) {
+            goto error;
+        }
+        bout.info.data_start = UINT32_MAX;
+        result = (int32_t) intel_find_assigned( bout.data,
+                                                bout.info.total_size );
+        if( (size_t) result == bout.info.total_size ) {
+            fprintf( stderr, "Hex file error, use debug for more info.\n" );
+            DEBUG( "ERROR: No valid data to flash.\n" );
+            retval = BUFFER_INIT_ERROR;
+            goto error;
+        }
+        bout.info.data_start = (uint32_t) result;
+        bout.info.data_end = intel_find_assigned_last( bout.data,
+                                                       bout.info.total_size );
+        if( !args->quiet ) {
+            fprintf( stderr, "Programmed 0x%X bytes as they were read.\n",
+                     bout.info.data_end - bout.info.data_start + 1 );
+        }
+        goto validate;
+    }
+
+    // ------------------ SKIP AN UNCHANGED IMAGE (if required) ------------
+    if( args->com_flash_data.if_changed ) {
+        result = image_on_device( device, &bout, mem_type, args->quiet );
+        if( 1 == result ) {
+            if( !args->quiet ) {
+                fprintf( stderr, "The device already holds this image,"
+                                 " nothing was written.\n" );
+            }
+            goto success;
+        } else if( result < 0 ) {
+            DEBUG( "Could not compare with the device, flashing anyway.\n" );
+        }
+    }
+
     // ------------------ INITIAL VALIDATE (if required) -------------------
     if ( 1 == args->com_flash_data.validate_first ) {
         if( 0 == ( retval = execute_validate(device, &bout, mem_type, args->quiet,
@@ -380,10 +1257,14 @@ static int32_t execute_flash( dfu_device_t *device,
     }
 
     // ------------------ WRITE PROGRAM DATA -------------------------------
-    if( mem_type == mem_user ) {
+    if( NULL != args->com_flash_data.journal && !extra_segment ) {
+        result = flash_journaled( device, args, &bout, &journal );
+    } else if( mem_type == mem_user ) {
+        report_phase( "write" );
         result = atmel_user( device, &bout );
     } else {
-        if ( 1 == args->com_flash_data.erase_first ) {
+        if ( 1 == args->com_flash_data.erase_first && !extra_segment ) {
+            report_phase( "erase" );
             if( args->device_type & GRP_STM32 ) {
                 result = stm32_erase_flash( device, args->quiet );
             } else {
@@ -396,39 +1277,381 @@ static int32_t execute_flash( dfu_device_t *device,
             }
         }
 
-        if( args->device_type & GRP_STM32 ) {
-            result = stm32_write_flash( device, &bout,
-                    mem_type == mem_eeprom ? true : false,
-                    args->com_flash_data.force, args->quiet );
-        } else {
-            result = atmel_flash(device, &bout,
-                    mem_type == mem_eeprom ? true : false,
-                    args->com_flash_data.force, args->quiet);
+        if( args->device_type & GRP_STM32 ) {
+            result = stm32_write_flash( device, &bout,
+                    mem_type == mem_eeprom ? true : false,
+                    args->com_flash_data.force, args->quiet );
+        } else {
+            /* the blank check looks at flash, which an extra segment
+             * follows straight after programming */
+            result = atmel_flash(device, &bout,
+                    mem_type == mem_eeprom ? true : false,
+                    args->com_flash_data.force || extra_segment, args->quiet);
+        }
+    }
+    if( 0 != result ) {
+        DEBUG( "Error writing %s data. (err %d)\n", "memory", result );
+        retval = FLASH_WRITE_ERROR;
+        goto error;
+    }
+
+validate:
+    // ------------------  VALIDATE PROGRAM ------------------------------
+    if( 0 == args->com_flash_data.suppress_validation ) {
+        if( 0 != ( retval = execute_validate(device, &bout, mem_type, args->quiet,
+                                             args->com_flash_data.ignore_outside)) ) {
+            fprintf( stderr, "Memory did not validate. Did you erase?\n" );
+            goto error;
+        } else if ( 0 == args->quiet ) {
+            print_flash_usage( &bout.info );
+        }
+    } else if( 0 == args->quiet ) {
+        print_flash_usage( &bout.info );
+    }
+
+success:
+    retval = SUCCESS;
+
+error:
+    /* the journal is kept for another go unless the image was written, a
+     * validate that failed to read the memory goes again as well */
+    journal_close( &journal, SUCCESS == retval ||
+                             VALIDATION_ERROR_IN_REGION == retval ||
+                             VALIDATION_ERROR_OUTSIDE_REGION == retval );
+    if( NULL != bout.data ) {
+        free( bout.data );
+        bout.data = NULL;
+    }
+
+    return retval;
+}
+
+static int32_t execute_flash( dfu_device_t *device,
+                                struct programmer_arguments *args ) {
+    int32_t retval;
+    char *file = args->com_flash_data.file;
+    bool elf_input = NULL == args->com_flash_data.extents &&
+                     !args->com_flash_data.bin && elf_check_file( file );
+    bool elf_eeprom = elf_input && 0 != strcmp("STDIN", file);
+    size_t i;
+
+    if( args->com_flash_data.stream &&
+            (args->com_flash_data.validate_first ||
+             args->com_flash_data.if_changed ||
+             NULL != args->com_flash_data.serial_data ||
+             NULL != args->com_flash_data.serial_file ||
+             NULL != args->com_flash_data.serial_counter ||
+             NULL != args->com_flash_data.journal ||
+             0 != args->com_flash_data.merge_count) ) {
+        fprintf( stderr, "--stream needs the whole image for --validate-first,"
+                         " --if-changed,\n --serial, --journal or more than"
+                         " one file.\n" );
+        return ARGUMENT_ERROR;
+    }
+
+    if( NULL != args->com_flash_data.journal &&
+            mem_flash != args->com_flash_data.segment ) {
+        fprintf( stderr, "--journal only records writes to flash.\n" );
+        return ARGUMENT_ERROR;
+    }
+
+    for( i = 0; i < args->com_flash_data.merge_count; i++ ) {
+        file = args->com_flash_data.merge_file[i];
+        elf_eeprom = elf_eeprom ||
+            (0 != strcmp("STDIN", file) && elf_check_file( file ));
+    }
+
+    retval = flash_segment( device, args, args->com_flash_data.segment,
+                            elf_input, false );
+
+    /* an ELF file also carries the .eeprom section, program it in the same
+     * run.  STDIN has been consumed by then, so it only gets one segment. */
+    file = args->com_flash_data.file;
+    if( SUCCESS == retval && elf_eeprom &&
+            mem_flash == args->com_flash_data.segment &&
+            0 != args->eeprom_memory_size &&
+            (args->device_type & (ADC_AVR | ADC_XMEGA)) ) {
+        retval = flash_segment( device, args, mem_eeprom,
+                                elf_input && 0 != strcmp("STDIN", file), true );
+    }
+
+    /* the unit has its serial number, the next unit gets the next one */
+    if( SUCCESS == retval && NULL != args->com_flash_data.serial_counter ) {
+        retval = serial_counter_advance( args );
+        if( SUCCESS == retval && !args->quiet ) {
+            fprintf( stderr, "Programmed serial number %u.\n",
+                     args->com_flash_data.serial_counter_value );
+        }
+    }
+
+    return retval;
+}
+
+int32_t execute_compile( struct programmer_arguments *args ) {
+    int32_t retval;
+    int32_t result;
+    intel_buffer_out_t bout;
+    bundle_writer_t writer;
+    dfu_device_t recorder;
+    enum atmel_memory_unit_enum mem_type = args->com_flash_data.segment;
+    bool elf_input = NULL == args->com_flash_data.extents &&
+                     !args->com_flash_data.bin &&
+                     elf_check_file( args->com_flash_data.file );
+
+    bout.data = NULL;
+    bundle_writer_init( &writer );
+
+    retval = prepare_flash_image( args, mem_type, elf_input, false, &bout,
+                                  NULL );
+    if( SUCCESS != retval ) {
+        goto error;
+    }
+
+    /* run the usual programming code against a device that records the
+     * requests instead of sending them.  the blank check needs the device,
+     * so it is left to flash-bundle */
+    memset( &recorder, 0, sizeof(recorder) );
+    recorder.type = args->device_type;
+    recorder.recorder = bundle_record;
+    recorder.recorder_context = &writer;
+
+    if( mem_type == mem_user ) {
+        result = atmel_user( &recorder, &bout );
+    } else if( args->device_type & GRP_STM32 ) {
+        result = stm32_write_flash( &recorder, &bout,
+                mem_type == mem_eeprom ? true : false, true, true );
+    } else {
+        result = atmel_flash( &recorder, &bout,
+                mem_type == mem_eeprom ? true : false, true, true );
+    }
+    if( 0 != result ) {
+        DEBUG( "Error recording %s data. (err %d)\n", "memory", result );
+        fprintf( stderr, "Unable to compile the flash bundle.\n" );
+        retval = BUFFER_INIT_ERROR;
+        goto error;
+    }
+
+    if( 0 != bundle_write(stdout, &writer, args->vendor_id, args->chip_id,
+                          args->device_type, mem_type, &bout) ) {
+        fprintf( stderr, "Error writing the flash bundle.\n" );
+        retval = UNSPECIFIED_ERROR;
+        goto error;
+    }
+
+    if( !args->quiet ) {
+        fprintf( stderr, "Compiled 0x%X bytes into %u requests.\n",
+                bout.info.data_end - bout.info.data_start + 1, writer.count );
+    }
+    retval = SUCCESS;
+
+error:
+    bundle_writer_free( &writer );
+    if( NULL != bout.data ) {
+        free( bout.data );
+        bout.data = NULL;
+    }
+
+    return retval;
+}
+
+int32_t execute_plan( struct programmer_arguments *args ) {
+    int32_t retval;
+    int32_t result = 0;
+    intel_buffer_out_t bout;
+    intel_buffer_in_t buin;
+    plan_t plan;
+    dfu_device_t recorder;
+    enum atmel_memory_unit_enum mem_type = args->com_flash_data.segment;
+    bool stm32 = 0 != (args->device_type & GRP_STM32);
+    uint32_t i;
+    char what[64];
+
+    bout.data = NULL;
+    buin.data = NULL;
+
+    // as execute_command selects them
+    if( com_eflash == args->command ) {
+        mem_type = args->com_flash_data.segment = mem_eeprom;
+    } else if( com_user == args->command ) {
+        mem_type = args->com_flash_data.segment = mem_user;
+    }
+
+    retval = prepare_flash_image( args, mem_type, NULL ==
+                    args->com_flash_data.extents && !args->com_flash_data.bin &&
+                    elf_check_file(args->com_flash_data.file), false, &bout,
+                    NULL );
+    if( SUCCESS != retval ) {
+        goto error;
+    }
+
+    /* the same steps execute_flash takes, against a device that counts the
+     * requests.  it reports success and reads back 0xFF, so the blank check
+     * passes and the validate reads what a real one would */
+    plan_init( &plan, args->device_type, args->flash_address_top -
+               args->flash_address_bottom + 1 );
+    memset( &recorder, 0, sizeof(recorder) );
+    recorder.type = args->device_type;
+    recorder.recorder = plan_record;
+    recorder.recorder_context = &plan;
+    // --json counts the recorded requests in the phases a real run reports
+
+    if( mem_type != mem_user && args->com_flash_data.erase_first ) {
+        plan_stage( &plan, "erase" );
+        report_phase( "erase" );
+        if( stm32 ) {
+            result = stm32_erase_flash( &recorder, true );
+        } else {
+            result = atmel_erase_flash( &recorder, ATMEL_ERASE_ALL, true );
+        }
+    }
+
+    // atmel_flash checks the range it will write, found the same way
+    if( 0 == result && mem_type != mem_user && !stm32 &&
+            !args->com_flash_data.force ) {
+        intel_flash_prep_buffer( &bout );
+        i = intel_find_assigned( bout.data, bout.info.total_size );
+        if( i != bout.info.total_size ) {
+            plan_stage( &plan, "blank check" );
+            result = atmel_blank_check( &recorder, i,
+                    intel_find_assigned_last(bout.data, bout.info.total_size),
+                    true );
+        }
+    }
+
+    if( 0 == result ) {
+        plan_stage( &plan, "write" );
+        report_phase( "write" );
+        if( mem_type == mem_user ) {
+            result = atmel_user( &recorder, &bout );
+        } else if( stm32 ) {
+            result = stm32_write_flash( &recorder, &bout,
+                    mem_type == mem_eeprom ? true : false, true, true );
+        } else {
+            result = atmel_flash( &recorder, &bout,
+                    mem_type == mem_eeprom ? true : false, true, true );
+        }
+    }
+    if( 0 != result ) {
+        DEBUG( "Error planning %s data. (err %d)\n", "memory", result );
+        fprintf( stderr, "Unable to plan flashing the image.\n" );
+        retval = FLASH_WRITE_ERROR;
+        goto error;
+    }
+
+    if( 0 == args->com_flash_data.suppress_validation ) {
+        if( 0 != intel_init_buffer_in(&buin, bout.info.total_size,
+                                      bout.info.page_size) ) {
+            DEBUG( "ERROR initializing a buffer.\n" );
+            retval = BUFFER_INIT_ERROR;
+            goto error;
+        }
+        buin.info.data_start = bout.info.valid_start;
+        buin.info.data_end = bout.info.valid_end;
+
+        plan_stage( &plan, "validate" );
+        report_phase( "verify" );
+        if( stm32 ) {
+            result = stm32_read_flash( &recorder, &buin, mem_type, true );
+        } else {
+            result = atmel_read_flash( &recorder, &buin, mem_type, true );
+        }
+        if( 0 != result ) {
+            DEBUG( "Error planning the validate. (err %d)\n", result );
+            fprintf( stderr, "Unable to plan flashing the image.\n" );
+            retval = FLASH_READ_ERROR;
+            goto error;
+        }
+    }
+
+    snprintf( what, sizeof(what), "%s data from 0x%X to 0x%X",
+              (mem_type == mem_user) ? "user page" :
+              (mem_type == mem_eeprom) ? "eeprom" : "flash",
+              bout.info.data_start, bout.info.data_end );
+    plan_print( stdout, &plan, what );
+    if( !args->quiet && (args->com_flash_data.validate_first ||
+                         args->com_flash_data.if_changed) ) {
+        fprintf( stderr, "The reads of --validate-first and --if-changed "
+                         "are not planned.\n" );
+    }
+    retval = SUCCESS;
+
+error:
+    if( NULL != buin.data ) {
+        free( buin.data );
+        buin.data = NULL;
+    }
+    if( NULL != bout.data ) {
+        free( bout.data );
+        bout.data = NULL;
+    }
+
+    return retval;
+}
+
+static int32_t execute_flash_bundle( dfu_device_t *device,
+                                     struct programmer_arguments *args ) {
+    int32_t retval = UNSPECIFIED_ERROR;
+    int32_t result;
+    dfu_bundle_t bundle;
+    intel_buffer_out_t bout;
+
+    bout.data = NULL;
+
+    if( 0 != bundle_open(args->com_flash_data.file, &bundle, args->quiet) ) {
+        return BUFFER_INIT_ERROR;
+    }
+
+    if( bundle.vendor_id != args->vendor_id ||
+            bundle.chip_id != args->chip_id ||
+            bundle.device_type != args->device_type ) {
+        fprintf( stderr, "The bundle was compiled for %04x:%04x, not %04x:%04x.\n",
+                bundle.vendor_id, bundle.chip_id,
+                args->vendor_id, args->chip_id );
+        retval = ARGUMENT_ERROR;
+        goto error;
+    }
+
+    if( 0 != intel_init_buffer_out(&bout, bundle.total_size, bundle.page_size) ||
+            0 != bundle_image_to_buffer(&bundle, &bout) ) {
+        DEBUG( "ERROR initializing a buffer.\n" );
+        retval = BUFFER_INIT_ERROR;
+        goto error;
+    }
+
+    /* the same check atmel_flash makes before programming */
+    if( !(args->device_type & GRP_STM32) && mem_user != bundle.memory &&
+            !args->com_flash_data.force &&
+            0 != atmel_blank_check(device, bundle.data_start, bundle.data_end,
+                                   args->quiet) ) {
+        if( !args->quiet ) {
+            fprintf( stderr,
+                    "The target memory for the program is not blank.\n"
+                    "Use --force flag to override this error check.\n" );
         }
+        retval = FLASH_WRITE_ERROR;
+        goto error;
     }
-    if( 0 != result ) {
-        DEBUG( "Error writing %s data. (err %d)\n", "memory", result );
+
+    if( 0 != (result = bundle_play(device, &bundle, args->quiet)) ) {
+        DEBUG( "Error playing the bundle. (err %d)\n", result );
         retval = FLASH_WRITE_ERROR;
         goto error;
     }
 
-    // ------------------  VALIDATE PROGRAM ------------------------------
     if( 0 == args->com_flash_data.suppress_validation ) {
-        if( 0 != ( retval = execute_validate(device, &bout, mem_type, args->quiet,
-                                             args->com_flash_data.ignore_outside)) ) {
+        if( 0 != (retval = execute_validate(device, &bout, bundle.memory,
+                        args->quiet, args->com_flash_data.ignore_outside)) ) {
             fprintf( stderr, "Memory did not validate. Did you erase?\n" );
             goto error;
-        } else if ( 0 == args->quiet ) {
-            print_flash_usage( &bout.info );
         }
-    } else if( 0 == args->quiet ) {
+    }
+    if( 0 == args->quiet ) {
         print_flash_usage( &bout.info );
     }
-
-success:
     retval = SUCCESS;
 
 error:
+    bundle_close( &bundle );
     if( NULL != bout.data ) {
         free( bout.data );
         bout.data = NULL;
@@ -629,9 +1852,201 @@ static int32_t execute_get( dfu_device_t *device,
     return 0;
 }
 
+static void dump_trim_blank( intel_buffer_in_t *buin, bool quiet ) {
+    uint32_t i;
+
+    // find first page with data (from the byte before the first data)
+    i = buin->info.data_start + intel_find_data( &buin->data[buin->info.data_start],
+            buin->info.data_end - buin->info.data_start );
+    if( i > buin->info.data_start && (i - 1) / buin->info.page_size >
+            buin->info.data_start / buin->info.page_size ) {
+        buin->info.data_start = (i - 1) - (i - 1) % buin->info.page_size;
+    }
+    if( i == buin->info.data_end ) {
+        if( !quiet )
+            fprintf( stderr,
+                    "Memory is blank, returning a single blank page.\n"
+                    "Use --force to return the entire memory regardless.\n");
+        buin->info.data_start = 0;
+        buin->info.data_end = buin->info.page_size - 1;
+    } else {        // find last page with data (to the byte after it)
+        i = intel_find_data_last( &buin->data[buin->info.data_start + 1],
+                buin->info.data_end - buin->info.data_start );
+        i = (i == buin->info.data_end - buin->info.data_start) ?
+            buin->info.data_start + 1 : buin->info.data_start + 2 + i;
+        if( i <= buin->info.data_end && i / buin->info.page_size <
+                buin->info.data_end / buin->info.page_size ) {
+            buin->info.data_end = i - i % buin->info.page_size +
+                                 buin->info.page_size - 1;
+        }
+    }
+}
+
+static uint32_t dump_stream_chunk( uint32_t page_size ) {
+    // whole pages at a time, so the hex writer can skip blank ones
+    uint32_t chunk = DUMP_STREAM_CHUNK + page_size - 1;
+
+    return chunk - chunk % page_size;
+}
+
+static int32_t dump_stream_blank( uint32_t length ) {
+    uint8_t blank[0x100];
+    uint32_t count;
+
+    memset( blank, UINT8_MAX, sizeof(blank) );
+    for( ; 0 < length; length -= count ) {
+        count = (length < sizeof(blank)) ? length : sizeof(blank);
+        if( count != fwrite(blank, 1, count, stdout) ) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int32_t dump_stream( dfu_device_t *device,
+                            struct programmer_arguments *args,
+                            intel_buffer_in_t *buin,
+                            uint32_t target_offset ) {
+    enum atmel_memory_unit_enum mem_segment = args->com_read_data.segment;
+    uint32_t region_start = buin->info.data_start;
+    uint32_t region_end = buin->info.data_end;
+    uint32_t chunk = dump_stream_chunk( (uint32_t) buin->info.page_size );
+    uint32_t start;
+    uint32_t end;
+    uint32_t next = 0;          // next byte of a binary to write
+    uint32_t last = 0;          // last byte with data, if blank is false
+    bool blank = true;
+    uint32_t i;
+    intel_hex_stream_t *hex = NULL;
+    int32_t result;
+    int32_t retval = UNSPECIFIED_ERROR;
+
+    if( !args->com_read_data.bin ) {
+        hex = intel_hex_stream_open( args->com_read_data.force, target_offset,
+                                     args->com_read_data.record_width,
+                                     args->com_read_data.minimal_04 );
+        if( NULL == hex ) {
+            return BUFFER_INIT_ERROR;
+        }
+    }
+
+    if( !args->quiet ) {
+        fprintf( stderr, "Dumping 0x%X bytes from address offset 0x%X as they "
+                 "are read...\n", region_end - region_start + 1,
+                 target_offset + region_start );
+    }
+
+    for( start = region_start; start <= region_end; start = end + 1 ) {
+        end = start - start % chunk + chunk - 1;
+        if( end > region_end ) {
+            end = region_end;
+        }
+
+        // buin->data is a window of one chunk, moved along the memory
+        memset( buin->data, UINT8_MAX, chunk );
+        buin->base = start;
+        buin->info.data_start = start;
+        buin->info.data_end = end;
+        if( args->device_type & GRP_STM32 ) {
+            result = stm32_read_flash( device, buin, mem_segment, true );
+        } else {
+            result = atmel_read_flash( device, buin, mem_segment, true );
+        }
+        if( 0 != result ) {
+            DEBUG( "ERROR: could not read memory, err %d.\n", result );
+            fprintf( stderr, "Memory read error, use debug for more info.\n" );
+            security_message( device );
+            retval = FLASH_READ_ERROR;
+            goto error;
+        }
+
+        i = (uint32_t) intel_find_data_last( buin->data, end - start + 1 );
+        if( i != end - start + 1 ) {
+            last = start + i;
+            blank = false;
+        }
+
+        if( NULL != hex ) {
+            // the hex writer skips blank pages itself, trimming is not needed
+            buin->info.data_start = args->com_read_data.force ? 0 : region_start;
+            if( 0 != intel_hex_stream_write(hex, buin, end) ) {
+                goto error;
+            }
+            continue;
+        }
+
+        // a binary is written up to the last data so far, blank bytes after
+        // it wait until more data or the end shows whether they are needed
+        if( !args->com_read_data.force ) {
+            if( blank || last < start ) {
+                continue;
+            }
+            i = last;
+        } else {
+            i = end;
+        }
+        if( next < start ) {
+            if( 0 != dump_stream_blank(start - next) ) {
+                goto error;
+            }
+            next = start;
+        }
+        if( i + 1 - next != fwrite(&buin->data[next - start], 1, i + 1 - next,
+                                   stdout) ) {
+            goto error;
+        }
+        next = i + 1;
+    }
+
+    buin->base = 0;
+    buin->info.data_start = region_start;
+    buin->info.data_end = region_end;
+    if( NULL != hex ) {
+        result = intel_hex_stream_close( hex );
+        hex = NULL;
+        if( 0 != result ) {
+            goto error;
+        }
+    }
+    if( args->com_read_data.force ) {
+        return SUCCESS;
+    }
+
+    // as dump_trim_blank: a single blank page, or up to the end of the page
+    // after the last data
+    if( blank ) {
+        if( !args->quiet )
+            fprintf( stderr,
+                    "Memory is blank, returning a single blank page.\n"
+                    "Use --force to return the entire memory regardless.\n");
+        buin->info.data_start = 0;
+        buin->info.data_end = (uint32_t) buin->info.page_size - 1;
+    } else if( last < region_end ) {
+        i = last + 1;
+        i += (uint32_t) buin->info.page_size - 1 - i % buin->info.page_size;
+        if( i < region_end ) {
+            buin->info.data_end = i;
+        }
+    }
+    if( args->com_read_data.bin && next <= buin->info.data_end &&
+            0 != dump_stream_blank(buin->info.data_end + 1 - next) ) {
+        goto error;
+    }
+
+    return SUCCESS;
+
+error:
+    if( NULL != hex ) {
+        intel_hex_stream_close( hex );
+    }
+    if( FLASH_READ_ERROR != retval ) {
+        fprintf( stderr, "Error writing the dump.\n" );
+    }
+    return retval;
+}
+
 static int32_t execute_dump( dfu_device_t *device,
                              struct programmer_arguments *args ) {
-    int32_t i = 0;
     int32_t retval = UNSPECIFIED_ERROR;
     int32_t result;             // result of fcn calls
     intel_buffer_in_t buin;     // buffer in for storing read mem
@@ -667,17 +2082,39 @@ static int32_t execute_dump( dfu_device_t *device,
             goto error;
     }
 
-    if( 0 != intel_init_buffer_in(&buin, mem_size, page_size) ) {
+    // --stream only holds a window of one chunk, never the whole memory
+    if( 0 != intel_init_buffer_in(&buin, args->com_read_data.stream ?
+                dump_stream_chunk((uint32_t) page_size) : mem_size,
+                page_size) ) {
         DEBUG("ERROR initializing a buffer.\n");
         retval = BUFFER_INIT_ERROR;
         goto error;
     }
+    buin.info.total_size = mem_size;
+    buin.info.data_end = (uint32_t) mem_size - 1;
+    buin.info.valid_end = (uint32_t) mem_size - 1;
 
     if( mem_segment == mem_flash ) {
         buin.info.data_start = args->flash_address_bottom;
         buin.info.data_end = args->flash_address_top;
     }
 
+    if( args->com_read_data.stream ) {
+        if( args->com_read_data.srec || args->com_read_data.dfuse ) {
+            fprintf( stderr, "--stream only writes ihex or --bin output.\n" );
+            retval = ARGUMENT_ERROR;
+            goto error;
+        }
+        if( !(args->device_type & GRP_STM32) ) {
+            security_check( device );
+        }
+        report_phase( "read" );
+        retval = dump_stream( device, args, &buin, target_offset );
+        fflush( stdout );
+        goto error;
+    }
+
+    report_phase( "read" );
     if( args->device_type & GRP_STM32 ) {
         result = stm32_read_flash(device, &buin, mem_segment, args->quiet);
     } else {
@@ -697,51 +2134,299 @@ static int32_t execute_dump( dfu_device_t *device,
     if( args->com_read_data.force ) {
         buin.info.data_start = 0;
     } else {
-        // find first page with data
-        for( i = buin.info.data_start; i < buin.info.data_end; i++ ) {
-            if( buin.data[i] != 0xFF ) break;
-            if( i / buin.info.page_size >
-                    buin.info.data_start / buin.info.page_size ) {
-                // i has just jumped to a different page than buin.data_start
-                buin.info.data_start = i;
-            }
-        }
-        if( i == buin.info.data_end ) {
-            if( !args->quiet )
-                fprintf( stderr,
-                        "Memory is blank, returning a single blank page.\n"
-                        "Use --force to return the entire memory regardless.\n");
-            buin.info.data_start = 0;
-            buin.info.data_end = buin.info.page_size - 1;
-        } else {        // find last page with data
-            for( i = buin.info.data_end; i > buin.info.data_start; i-- ) {
-                if( buin.data[i] !=0xFF ) break;
-                if( i / buin.info.page_size <
-                        buin.info.data_end / buin.info.page_size ) {
-                    buin.info.data_end = i;
-                }
-            }
-        }
+        dump_trim_blank( &buin, args->quiet );
     }
 
     if( args->com_read_data.bin ) {
         if( !args->quiet )
             fprintf( stderr, "Dumping 0x%X bytes from address offset 0x%X.\n",
                     buin.info.data_end + 1, target_offset );
-        for( i = 0; i <= buin.info.data_end; i++ ) {
-            fprintf( stdout, "%c", buin.data[i] );
+        if( 0 != intel_bin_from_buffer(&buin) ) {
+            fprintf( stderr, "Error writing the binary.\n" );
+            retval = UNSPECIFIED_ERROR;
+            goto error;
+        }
+    } else if( args->com_read_data.srec ) {
+        if( !args->quiet )
+            fprintf( stderr, "Dumping 0x%X bytes from address offset 0x%X.\n",
+                    buin.info.data_end - buin.info.data_start + 1,
+                    target_offset + buin.info.data_start );
+        if( 0 != srec_from_buffer(&buin, args->com_read_data.force,
+                    target_offset, args->com_read_data.record_width) ) {
+            fprintf( stderr, "Error writing the S-records.\n" );
+            retval = UNSPECIFIED_ERROR;
+            goto error;
+        }
+    } else if( args->com_read_data.dfuse ) {
+        if( !args->quiet )
+            fprintf( stderr, "Dumping 0x%X bytes from address offset 0x%X.\n",
+                    buin.info.data_end - buin.info.data_start + 1,
+                    target_offset + buin.info.data_start );
+        if( 0 != dfuse_from_buffer(&buin, args->com_read_data.force,
+                    target_offset, args->vendor_id, args->chip_id) ) {
+            fprintf( stderr, "Error writing the DfuSe file.\n" );
+            retval = UNSPECIFIED_ERROR;
+            goto error;
         }
     } else {
         if( !args->quiet )
             fprintf( stderr, "Dumping 0x%X bytes from address offset 0x%X.\n",
                     buin.info.data_end - buin.info.data_start + 1,
                     target_offset + buin.info.data_start );
-        intel_hex_from_buffer( &buin,
-                args->com_read_data.force, target_offset );
+        if( 0 != intel_hex_from_buffer(&buin,
+                    args->com_read_data.force, target_offset,
+                    args->com_read_data.record_width,
+                    args->com_read_data.minimal_04) ) {
+            fprintf( stderr, "Error writing the hex file.\n" );
+            retval = UNSPECIFIED_ERROR;
+            goto error;
+        }
+    }
+
+    fflush( stdout );
+
+    retval = SUCCESS;
+
+error:
+    if( NULL != buin.data ) {
+        free( buin.data );
+        buin.data = NULL;
+    }
+
+    return retval;
+}
+
+static void checksum_begin( checksum_range_t *range, uint32_t start ) {
+    range->start = start;
+    range->crc = DFU_CRC32_INIT;
+    sha256_init( &range->sha );
+}
+
+static void checksum_update( checksum_range_t *range,
+                             const uint8_t *data, size_t length ) {
+    range->crc = dfu_crc32( range->crc, data, length );
+    sha256_update( &range->sha, data, length );
+}
+
+static bool checksum_print( checksum_range_t *range,
+                            checksum_range_t *expected,
+                            uint32_t end, uint32_t target_offset ) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint8_t expected_digest[SHA256_DIGEST_SIZE];
+    bool match = true;
+    int i;
+
+    // the usual CRC-32, as printed by crc32 or zlib
+    sha256_final( &range->sha, digest );
+    fprintf( stdout, "0x%08X-0x%08X  crc32 %08x  sha256 ",
+             target_offset + range->start, target_offset + end,
+             range->crc ^ DFU_CRC32_INIT );
+    for( i = 0; i < SHA256_DIGEST_SIZE; i++ ) {
+        fprintf( stdout, "%02x", digest[i] );
+    }
+
+    if( NULL != expected ) {
+        sha256_final( &expected->sha, expected_digest );
+        match = expected->crc == range->crc &&
+            0 == memcmp( digest, expected_digest, sizeof(digest) );
+        fprintf( stdout, "  %s", match ? "match" : "DIFFERS" );
+    }
+    fprintf( stdout, "\n" );
+
+    return match;
+}
+
+static int32_t execute_checksum( dfu_device_t *device,
+                                 struct programmer_arguments *args ) {
+    int32_t retval = UNSPECIFIED_ERROR;
+    int32_t result;
+    enum atmel_memory_unit_enum mem_segment = args->com_checksum_data.segment;
+    char *file = args->com_checksum_data.file;
+    bool pages = args->com_checksum_data.pages;
+    bool extents = args->com_checksum_data.extents;
+    intel_buffer_in_t buin;         // a window onto the memory
+    intel_buffer_out_t bout;        // the image to compare with
+    uint8_t *image = NULL;          // the image bytes for the window
+    checksum_range_t total[2];      // device, image
+    checksum_range_t part[2];
+    bool in_extent = false;
+    bool match = true;
+    size_t mem_size = 0;
+    size_t page_size = 0;
+    uint32_t target_offset = 0;     // address offset on the target device
+    uint32_t image_offset = 0;      // address of buffer[0] in the image file
+    uint32_t region_start = 0;
+    uint32_t region_end;
+    uint32_t start;
+    uint32_t end;
+    uint32_t page;
+    uint32_t length;
+    uint32_t i;
+
+    buin.data = NULL;
+    bout.data = NULL;
+
+    switch( mem_segment ) {
+        case mem_flash:
+            mem_size = args->memory_address_top + 1;
+            page_size = args->flash_page_size;
+            region_start = args->flash_address_bottom;
+            if( ADC_AVR32 == args->device_type ) {
+                target_offset = 0x80000000;
+            } else if( GRP_STM32 & args->device_type ) {
+                target_offset = STM32_FLASH_OFFSET;
+                image_offset = STM32_FLASH_OFFSET;
+            }
+            break;
+        case mem_eeprom:
+            if( 0 == args->eeprom_memory_size ) {
+                fprintf( stderr, "This device has no eeprom.\n" );
+                return ARGUMENT_ERROR;
+            }
+            mem_size = args->eeprom_memory_size;
+            page_size = args->eeprom_page_size;
+            break;
+        case mem_user:
+            mem_size = args->flash_page_size;
+            page_size = args->flash_page_size;
+            target_offset = 0x80800000;
+            image_offset = ATMEL_USER_PAGE_OFFSET;
+            break;
+        default:
+            fprintf( stderr, "Checksum not supported for this memory.\n" );
+            return ARGUMENT_ERROR;
+    }
+    region_end = (mem_segment == mem_flash) ?
+        args->flash_address_top : (uint32_t) mem_size - 1;
+
+    // the memory is read a window at a time, never all at once
+    buin.info.total_size = mem_size;
+    buin.info.page_size = page_size;
+    length = CHECKSUM_CHUNK + page_size - 1;
+    length -= length % page_size;
+    buin.data = (uint8_t *) malloc( length );
+    image = (uint8_t *) malloc( length );
+    if( NULL == buin.data || NULL == image ) {
+        DEBUG( "ERROR allocating 0x%X bytes of memory.\n", length );
+        retval = BUFFER_INIT_ERROR;
+        goto error;
+    }
+
+    if( NULL != file ) {
+        if( 0 != intel_init_buffer_out(&bout, mem_size, page_size) ) {
+            DEBUG( "ERROR initializing a buffer.\n" );
+            retval = BUFFER_INIT_ERROR;
+            goto error;
+        }
+        if( args->com_checksum_data.bin ) {
+            result = intel_bin_to_buffer( file, &bout, image_offset,
+                                          image_offset, args->quiet );
+        } else {
+            result = intel_hex_to_buffer( file, &bout, image_offset,
+                                          args->quiet );
+        }
+        if( result < 0 ) {
+            DEBUG( "Something went wrong with creating the memory image.\n" );
+            retval = BUFFER_INIT_ERROR;
+            goto error;
+        }
+    }
+
+    if( !(args->device_type & GRP_STM32) ) {
+        security_check( device );
+    }
+    if( !args->quiet ) {
+        fprintf( stderr, "Checking 0x%X bytes...\n",
+                 region_end - region_start + 1 );
     }
 
+    report_phase( "read" );
+    checksum_begin( &total[0], region_start );
+    checksum_begin( &total[1], region_start );
+    for( start = region_start; start <= region_end; start = end + 1 ) {
+        end = start - start % length + length - 1;
+        if( end > region_end ) {
+            end = region_end;
+        }
+
+        buin.base = start;
+        buin.info.data_start = start;
+        buin.info.data_end = end;
+        if( args->device_type & GRP_STM32 ) {
+            result = stm32_read_flash( device, &buin, mem_segment, true );
+        } else {
+            result = atmel_read_flash( device, &buin, mem_segment, true );
+        }
+        if( 0 != result ) {
+            DEBUG( "ERROR: could not read memory, err %d.\n", result );
+            fprintf( stderr, "Memory read error, use debug for more info.\n" );
+            security_message( device );
+            retval = FLASH_READ_ERROR;
+            goto error;
+        }
+
+        // unassigned image bytes compare as blank memory
+        for( i = start; NULL != file && i <= end; i++ ) {
+            image[i - start] = (bout.data[i] > UINT8_MAX) ?
+                0xff : (uint8_t) bout.data[i];
+        }
+
+        checksum_update( &total[0], buin.data, end - start + 1 );
+        checksum_update( &total[1], image, end - start + 1 );
+        if( !pages && !extents ) {
+            continue;
+        }
+
+        // the pages (or the parts of the region on them) in this window
+        for( page = start; page <= end; page = i + 1 ) {
+            bool blank;
+
+            i = page - page % page_size + page_size - 1;
+            if( i > end ) {
+                i = end;
+            }
+            blank = (i - page + 1 == intel_find_data(&buin.data[page - start],
+                                                     i - page + 1)) &&
+                (NULL == file || i - page + 1 ==
+                    intel_find_data(&image[page - start], i - page + 1));
+
+            if( blank ) {
+                if( in_extent ) {
+                    match = checksum_print( &part[0], file ? &part[1] : NULL,
+                                            page - 1, target_offset ) && match;
+                    in_extent = false;
+                }
+                continue;
+            }
+            if( !in_extent ) {
+                checksum_begin( &part[0], page );
+                checksum_begin( &part[1], page );
+                in_extent = true;
+            }
+            checksum_update( &part[0], &buin.data[page - start], i - page + 1 );
+            checksum_update( &part[1], &image[page - start], i - page + 1 );
+            if( pages ) {
+                match = checksum_print( &part[0], file ? &part[1] : NULL,
+                                        i, target_offset ) && match;
+                in_extent = false;
+            }
+        }
+    }
+    if( in_extent ) {
+        match = checksum_print( &part[0], file ? &part[1] : NULL,
+                                region_end, target_offset ) && match;
+    }
+    match = checksum_print( &total[0], file ? &total[1] : NULL,
+                            region_end, target_offset ) && match;
     fflush( stdout );
 
+    if( !match ) {
+        if( !args->quiet ) {
+            fprintf( stderr, "The memory does not match %s.\n", file );
+        }
+        retval = VALIDATION_ERROR_IN_REGION;
+        goto error;
+    }
     retval = SUCCESS;
 
 error:
@@ -749,6 +2434,14 @@ error:
         free( buin.data );
         buin.data = NULL;
     }
+    if( NULL != image ) {
+        free( image );
+        image = NULL;
+    }
+    if( NULL != bout.data ) {
+        free( bout.data );
+        bout.data = NULL;
+    }
 
     return retval;
 }
@@ -809,6 +2502,7 @@ static int32_t execute_configure( dfu_device_t *device,
 
 static int32_t execute_launch( dfu_device_t *device,
                                   struct programmer_arguments *args ) {
+    report_phase( "launch" );
     if( args->device_type & GRP_STM32 ) {
         return stm32_start_app( device, args->quiet );
     } else if( args->com_launch_config.noreset ) {
@@ -818,6 +2512,66 @@ static int32_t execute_launch( dfu_device_t *device,
     }
 }
 
+int32_t read_memory( dfu_device_t *device,
+                     struct programmer_arguments *args,
+                     enum atmel_memory_unit_enum mem_segment,
+                     const uint32_t address,
+                     uint8_t *buffer,
+                     const size_t length ) {
+    intel_buffer_in_t buin;     // a window onto the memory, held by buffer
+    size_t mem_size;
+    size_t page_size;
+    int32_t result;
+
+    switch( mem_segment ) {
+        case mem_flash:
+            mem_size = args->memory_address_top + 1;
+            page_size = args->flash_page_size;
+            break;
+        case mem_eeprom:
+            mem_size = args->eeprom_memory_size;
+            page_size = args->eeprom_page_size;
+            break;
+        case mem_user:
+            mem_size = args->flash_page_size;
+            page_size = args->flash_page_size;
+            break;
+        default:
+            DEBUG( "Unknown memory type %d\n", mem_segment );
+            return ARGUMENT_ERROR;
+    }
+    if( 0 == length || address >= mem_size || length > mem_size - address ) {
+        DEBUG( "0x%X bytes at 0x%X are outside the 0x%X byte memory.\n",
+               (uint32_t) length, address, (uint32_t) mem_size );
+        return ARGUMENT_ERROR;
+    }
+
+    device->type = args->device_type;
+    buin.info.total_size = mem_size;
+    buin.info.page_size = page_size;
+    buin.info.data_start = address;
+    buin.info.data_end = address + (uint32_t) length - 1;
+    buin.base = address;
+    buin.data = buffer;
+
+    report_phase( "read" );
+    if( args->device_type & GRP_STM32 ) {
+        result = stm32_read_flash( device, &buin, mem_segment, args->quiet );
+    } else {
+        security_check( device );
+        result = atmel_read_flash( device, &buin, mem_segment, args->quiet );
+    }
+    if( 0 != result ) {
+        DEBUG( "ERROR: could not read memory, err %d.\n", result );
+        if( !(args->device_type & GRP_STM32) ) {
+            security_message( device );
+        }
+        return FLASH_READ_ERROR;
+    }
+
+    return SUCCESS;
+}
+
 int32_t execute_command( dfu_device_t *device,
                          struct programmer_arguments *args ) {
     device->type = args->device_type;
@@ -869,6 +2623,10 @@ int32_t execute_command( dfu_device_t *device,
             return execute_setfuse( device, args );
         case com_setsecure:
             return execute_setsecure( device, args );
+        case com_flash_bundle:
+            return execute_flash_bundle( device, args );
+        case com_checksum:
+            return execute_checksum( device, args );
         default:
             fprintf( stderr, "Not supported at this time.\n" );
     }
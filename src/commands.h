@@ -33,6 +33,27 @@ extern "C" {
 int32_t execute_command( dfu_device_t *device,
                          struct programmer_arguments *args );
 
+int32_t execute_compile( struct programmer_arguments *args );
+/* record the requests that flashing the file would send into a flash
+ * bundle on stdout, no device is needed
+ */
+
+int32_t execute_plan( struct programmer_arguments *args );
+/* count the requests that flashing the file would send and print them with
+ * a time estimate on stdout, no device is needed
+ */
+
+int32_t read_memory( dfu_device_t *device,
+                     struct programmer_arguments *args,
+                     enum atmel_memory_unit_enum mem_segment,
+                     const uint32_t address,
+                     uint8_t *buffer,
+                     const size_t length );
+/* read length bytes of the memory from address (0 is its first byte) into
+ * buffer, for the library.  returns SUCCESS, ARGUMENT_ERROR if the range is
+ * not in the memory or FLASH_READ_ERROR
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,422 @@
+/*
+ * dfu-programmer
+ *
+ * compress.c
+ *
+ * Reads gzip and zstd compressed input files.  The compressed file is
+ * wrapped in a stdio stream (fopencookie or funopen) that decodes a chunk
+ * at a time as it is read, so the hex, S-record, ELF, DfuSe and binary
+ * readers handle compressed files and STDIN without a temporary file.
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "compress.h"
+#include "util.h"
+
+#if defined(HAVE_FOPENCOOKIE) || defined(HAVE_FUNOPEN)
+#define COMPRESS_STREAMS
+#endif
+
+#define COMPRESS_CHUNK          0x10000
+#define COMPRESS_MAGIC_MAX      4
+
+#define COMPRESS_DEBUG_THRESHOLD    50
+#define COMPRESS_TRACE_THRESHOLD    55
+
+#define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               COMPRESS_DEBUG_THRESHOLD, __VA_ARGS__ )
+#define TRACE(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               COMPRESS_TRACE_THRESHOLD, __VA_ARGS__ )
+
+enum compress_format { COMPRESS_NONE, COMPRESS_GZIP, COMPRESS_ZSTD };
+
+static const uint8_t gzip_magic[2] = { 0x1f, 0x8b };
+static const uint8_t zstd_magic[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+#ifdef COMPRESS_STREAMS
+typedef struct {
+    FILE *fp;                   // the compressed input
+    const char *filename;
+    bool quiet;
+    enum compress_format format;
+    bool eof;                   // everything has been read from fp
+    bool in_frame;              // a gzip member / zstd frame is not finished
+    size_t prefix_length;       // COMPRESS_NONE: bytes read while detecting
+    size_t prefix_used;
+    uint8_t prefix[COMPRESS_MAGIC_MAX];
+#ifdef HAVE_LIBZ
+    z_stream z;
+#endif
+#ifdef HAVE_LIBZSTD
+    ZSTD_DStream *zstd;
+    ZSTD_inBuffer zin;
+#endif
+    uint8_t in[COMPRESS_CHUNK];
+} compress_stream_t;
+#endif
+
+// ________  P R O T O T Y P E S  _______________________________
+static FILE *compress_stream( FILE *fp, enum compress_format format,
+        const uint8_t *prefix, size_t length,
+        const char *filename, bool quiet );
+/* return a stream reading fp in the given format, prefix holds the first
+ * length bytes, already read from fp.  fp is closed on failure.
+ */
+
+static bool compress_supported( enum compress_format format );
+/* return true if this build can read the format */
+
+#ifdef COMPRESS_STREAMS
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+static size_t compress_fill( compress_stream_t *s );
+/* read the next chunk of fp into s->in, return its length (0 at the end of
+ * the file or on an error, see ferror)
+ */
+#endif
+
+static ssize_t compress_read( compress_stream_t *s, char *buf, size_t size );
+/* decode up to size bytes into buf.  return the number of bytes, 0 at the
+ * end of the data or -1 on an error
+ */
+
+static int compress_close( compress_stream_t *s );
+/* release the decoder and close fp */
+#endif
+
+
+// ________  F U N C T I O N S  _______________________________
+FILE *compress_open( FILE *fp, const char *filename, bool quiet ) {
+    uint8_t magic[COMPRESS_MAGIC_MAX];
+    const uint8_t *expected;
+    size_t expected_length;
+    size_t length;
+    enum compress_format format;
+    int c;
+
+    c = fgetc( fp );
+    if( gzip_magic[0] == c ) {
+        format = COMPRESS_GZIP;
+        expected = gzip_magic;
+        expected_length = sizeof(gzip_magic);
+    } else if( zstd_magic[0] == c ) {
+        format = COMPRESS_ZSTD;
+        expected = zstd_magic;
+        expected_length = sizeof(zstd_magic);
+    } else {
+        if( EOF != c ) {
+            ungetc( c, fp );
+        }
+        return fp;
+    }
+
+    magic[0] = (uint8_t) c;
+    length = 1 + fread( &magic[1], 1, expected_length - 1, fp );
+    if( length != expected_length || 0 != memcmp(magic, expected, length) ) {
+        format = COMPRESS_NONE;
+    }
+
+    return compress_stream( fp, format, magic, length, filename, quiet );
+}
+
+#ifdef COMPRESS_STREAMS
+#if defined(HAVE_LIBZ) || defined(HAVE_LIBZSTD)
+static size_t compress_fill( compress_stream_t *s ) {
+    size_t length = 0;
+
+    if( !s->eof ) {
+        length = fread( s->in, 1, sizeof(s->in), s->fp );
+        if( 0 == length ) {
+            s->eof = true;
+        }
+    }
+    return length;
+}
+#endif
+
+static ssize_t compress_read( compress_stream_t *s, char *buf, size_t size ) {
+    size_t length;
+
+    switch( s->format ) {
+        case COMPRESS_NONE:
+            // replay the bytes read looking for a header, then pass through
+            length = s->prefix_length - s->prefix_used;
+            if( length > size ) {
+                length = size;
+            }
+            memcpy( buf, &s->prefix[s->prefix_used], length );
+            s->prefix_used += length;
+            if( length < size ) {
+                length += fread( &buf[length], 1, size - length, s->fp );
+            }
+            return ferror( s->fp ) ? -1 : (ssize_t) length;
+
+#ifdef HAVE_LIBZ
+        case COMPRESS_GZIP: {
+            int result;
+
+            s->z.next_out = (Bytef *) buf;
+            s->z.avail_out = (uInt) size;
+            while( s->z.avail_out == size ) {
+                if( 0 == s->z.avail_in ) {
+                    if( 0 == (length = compress_fill(s)) ) {
+                        if( ferror(s->fp) ) {
+                            return -1;
+                        }
+                        break;
+                    }
+                    s->z.next_in = s->in;
+                    s->z.avail_in = (uInt) length;
+                }
+                result = inflate( &s->z, Z_NO_FLUSH );
+                if( Z_STREAM_END == result ) {
+                    // gzip files can hold several members back to back
+                    s->in_frame = false;
+                    inflateReset( &s->z );
+                } else if( Z_OK == result || Z_BUF_ERROR == result ) {
+                    s->in_frame = true;
+                } else {
+                    if( !s->quiet )
+                        fprintf( stderr, "Error decompressing %s: %s\n",
+                                 s->filename, s->z.msg ? s->z.msg : "bad data" );
+                    return -1;
+                }
+            }
+            length = size - s->z.avail_out;
+            break;
+        }
+#endif
+
+#ifdef HAVE_LIBZSTD
+        case COMPRESS_ZSTD: {
+            ZSTD_outBuffer out = { buf, size, 0 };
+            size_t result;
+
+            while( 0 == out.pos ) {
+                if( s->zin.pos == s->zin.size ) {
+                    if( 0 == (length = compress_fill(s)) ) {
+                        if( ferror(s->fp) ) {
+                            return -1;
+                        }
+                        break;
+                    }
+                    s->zin.src = s->in;
+                    s->zin.size = length;
+                    s->zin.pos = 0;
+                }
+                result = ZSTD_decompressStream( s->zstd, &out, &s->zin );
+                if( ZSTD_isError(result) ) {
+                    if( !s->quiet )
+                        fprintf( stderr, "Error decompressing %s: %s\n",
+                                 s->filename, ZSTD_getErrorName(result) );
+                    return -1;
+                }
+                // 0 when a frame is complete and fully flushed
+                s->in_frame = (0 != result);
+            }
+            length = out.pos;
+            break;
+        }
+#endif
+
+        default:
+            return -1;
+    }
+
+    if( 0 == length && s->in_frame ) {
+        if( !s->quiet )
+            fprintf( stderr, "Error decompressing %s: the file is truncated.\n",
+                     s->filename );
+        return -1;
+    }
+    return (ssize_t) length;
+}
+
+static int compress_close( compress_stream_t *s ) {
+    int result;
+
+#ifdef HAVE_LIBZ
+    if( COMPRESS_GZIP == s->format ) {
+        inflateEnd( &s->z );
+    }
+#endif
+#ifdef HAVE_LIBZSTD
+    if( COMPRESS_ZSTD == s->format ) {
+        ZSTD_freeDStream( s->zstd );
+    }
+#endif
+    result = fclose( s->fp );
+    free( s );
+
+    return result;
+}
+
+#ifdef HAVE_FOPENCOOKIE
+static ssize_t compress_cookie_read( void *cookie, char *buf, size_t size ) {
+    return compress_read( (compress_stream_t *) cookie, buf, size );
+}
+
+static int compress_cookie_close( void *cookie ) {
+    return compress_close( (compress_stream_t *) cookie );
+}
+#else
+static int compress_cookie_read( void *cookie, char *buf, int size ) {
+    return (int) compress_read( (compress_stream_t *) cookie, buf,
+                                (size_t) size );
+}
+
+static int compress_cookie_close( void *cookie ) {
+    return compress_close( (compress_stream_t *) cookie );
+}
+#endif
+#endif
+
+static bool compress_supported( enum compress_format format ) {
+    switch( format ) {
+#ifdef COMPRESS_STREAMS
+        case COMPRESS_NONE:
+            return true;
+#ifdef HAVE_LIBZ
+        case COMPRESS_GZIP:
+            return true;
+#endif
+#ifdef HAVE_LIBZSTD
+        case COMPRESS_ZSTD:
+            return true;
+#endif
+#endif
+        default:
+            return false;
+    }
+}
+
+static FILE *compress_stream( FILE *fp, enum compress_format format,
+        const uint8_t *prefix, size_t length,
+        const char *filename, bool quiet ) {
+#ifdef COMPRESS_STREAMS
+    compress_stream_t *s = NULL;
+    FILE *stream = NULL;
+#endif
+
+    if( COMPRESS_NONE == format ) {
+        // not compressed after all, put back what was read
+        if( 1 == length && EOF != ungetc(prefix[0], fp) ) {
+            return fp;
+        }
+        if( 0 == fseek(fp, -((long) length), SEEK_CUR) ) {
+            return fp;
+        }
+    }
+
+    if( !compress_supported(format) ) {
+        if( COMPRESS_NONE == format ) {
+            DEBUG( "Unable to rewind %s.\n", filename );
+        } else if( !quiet ) {
+            fprintf( stderr, "%s is %s compressed, which this build can not read.\n",
+                     filename, (COMPRESS_GZIP == format) ? "gzip" : "zstd" );
+        }
+        fclose( fp );
+        return NULL;
+    }
+
+#ifdef COMPRESS_STREAMS
+    s = (compress_stream_t *) calloc( 1, sizeof(compress_stream_t) );
+    if( NULL == s ) {
+        DEBUG( "Unable to allocate the decoder.\n" );
+        fclose( fp );
+        return NULL;
+    }
+    s->fp = fp;
+    s->filename = filename;
+    s->quiet = quiet;
+    s->format = COMPRESS_NONE;  // until the decoder is set up
+    // the magic bytes are the first input for the decoder
+    memcpy( s->prefix, prefix, length );
+    s->prefix_length = length;
+    memcpy( s->in, prefix, length );
+
+    switch( format ) {
+#ifdef HAVE_LIBZ
+        case COMPRESS_GZIP:
+            s->z.next_in = s->in;
+            s->z.avail_in = (uInt) length;
+            // 16 + MAX_WBITS reads the gzip header and trailer
+            if( Z_OK != inflateInit2(&s->z, 16 + MAX_WBITS) ) {
+                DEBUG( "Unable to set up inflate.\n" );
+                goto error;
+            }
+            DEBUG( "Reading %s as gzip.\n", filename );
+            break;
+#endif
+#ifdef HAVE_LIBZSTD
+        case COMPRESS_ZSTD:
+            s->zin.src = s->in;
+            s->zin.size = length;
+            s->zin.pos = 0;
+            s->zstd = ZSTD_createDStream();
+            if( NULL == s->zstd ) {
+                DEBUG( "Unable to set up the zstd decoder.\n" );
+                goto error;
+            }
+            if( ZSTD_isError(ZSTD_initDStream(s->zstd)) ) {
+                DEBUG( "Unable to set up the zstd decoder.\n" );
+                ZSTD_freeDStream( s->zstd );
+                goto error;
+            }
+            DEBUG( "Reading %s as zstd.\n", filename );
+            break;
+#endif
+        default:
+            break;
+    }
+    s->format = format;
+
+#ifdef HAVE_FOPENCOOKIE
+    {
+        cookie_io_functions_t functions = { compress_cookie_read, NULL, NULL,
+                                            compress_cookie_close };
+        stream = fopencookie( s, "r", functions );
+    }
+#else
+    stream = funopen( s, compress_cookie_read, NULL, NULL,
+                      compress_cookie_close );
+#endif
+    if( NULL == stream ) {
+        DEBUG( "Unable to open the decoding stream.\n" );
+        goto error;
+    }
+    return stream;
+
+error:
+    compress_close( s );
+#endif
+    return NULL;
+}
@@ -0,0 +1,40 @@
+/*
+ * dfu-programmer
+ *
+ * compress.h
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+FILE *compress_open( FILE *fp, const char *filename, bool quiet );
+/* check fp for a gzip or zstd header.  if there is one, a stream is returned
+ * that reads the decompressed data as fp is read, no temporary file is used.
+ * otherwise fp is returned, positioned at its start.  closing the returned
+ * stream also closes fp.
+ *
+ * NULL is returned (and fp closed) if fp is compressed in a format this
+ * build cannot read, or the decoder could not be set up.  filename is only
+ * used for messages.
+ */
+
+#endif
@@ -2,6 +2,7 @@
 #define __DFU_DEVICE_H__
 
 #include <stdint.h>
+#include <stddef.h>
 #include <libusb-1.0/libusb.h>
 
 #ifdef __cplusplus
@@ -23,12 +24,19 @@ extern "C" {
 
 typedef unsigned atmel_device_class_t;
 
+/* receives the requests of a device with no handle, see dfu_download */
+typedef int32_t (*dfu_recorder_t)( void *context, uint8_t request,
+                                   uint16_t value, const uint8_t *data,
+                                   size_t length );
+
 typedef struct {
     struct libusb_device_handle *handle;
     int32_t interface;
     atmel_device_class_t type;
     int security_bit_state;
     uint16_t transaction;
+    dfu_recorder_t recorder;
+    void *recorder_context;
 } dfu_device_t;
 
 #ifdef __cplusplus
@@ -23,24 +23,17 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
 #include <libusb-1.0/libusb.h>
 #include <errno.h>
 #include <stdbool.h>
 
 #include "dfu.h"
+#include "report.h"
 #include "util.h"
 
 // cSpell:words DNBUSY
 
-/* DFU commands */
-#define DFU_DETACH      0
-#define DFU_DNLOAD      1
-#define DFU_UPLOAD      2
-#define DFU_GETSTATUS   3
-#define DFU_CLRSTATUS   4
-#define DFU_GETSTATE    5
-#define DFU_ABORT       6
-
 #define USB_CLASS_APP_SPECIFIC  0xfe
 #define DFU_SUBCLASS            0x01
 
@@ -142,7 +135,8 @@ int32_t dfu_download( dfu_device_t *device,
     TRACE( "%s( %p, %u, %p )\n", __FUNCTION__, device, length, data );
 
     /* Sanity checks */
-    if( (NULL == device) || (NULL == device->handle) ) {
+    if( (NULL == device) ||
+            ((NULL == device->handle) && (NULL == device->recorder)) ) {
         DEBUG( "Invalid parameter\n" );
         return -1;
     }
@@ -157,6 +151,17 @@ int32_t dfu_download( dfu_device_t *device,
         return -3;
     }
 
+    if( NULL == device->handle ) {
+        /* counted as the transfer it stands in for */
+        report_transfer();
+        if( 0 != device->recorder(device->recorder_context, DFU_DNLOAD,
+                                  device->transaction++, data, length) ) {
+            return -4;
+        }
+        report_bytes( length );
+        return (int32_t) length;
+    }
+
     {
         size_t i;
         for( i = 0; i < length; i++ ) {
@@ -165,6 +170,7 @@ int32_t dfu_download( dfu_device_t *device,
     }
 
     result = dfu_transfer_out( device, DFU_DNLOAD, device->transaction++, data, length );
+    report_bytes( (0 < result) ? (size_t) result : 0 );
 
     dfu_msg_response_output( __FUNCTION__, result );
 
@@ -177,7 +183,8 @@ int32_t dfu_upload( dfu_device_t *device, const size_t length, uint8_t* data ) {
     TRACE( "%s( %p, %u, %p )\n", __FUNCTION__, device, length, data );
 
     /* Sanity checks */
-    if( (NULL == device) || (NULL == device->handle) ) {
+    if( (NULL == device) ||
+            ((NULL == device->handle) && (NULL == device->recorder)) ) {
         DEBUG( "Invalid parameter\n" );
         return -1;
     }
@@ -187,7 +194,20 @@ int32_t dfu_upload( dfu_device_t *device, const size_t length, uint8_t* data ) {
         return -2;
     }
 
+    if( NULL == device->handle ) {
+        /* nothing is read back, the memory looks erased */
+        report_transfer();
+        if( 0 != device->recorder(device->recorder_context, DFU_UPLOAD,
+                                  device->transaction++, NULL, length) ) {
+            return -4;
+        }
+        report_bytes( length );
+        memset( data, 0xff, length );
+        return (int32_t) length;
+    }
+
     result = dfu_transfer_in( device, DFU_UPLOAD, device->transaction++, data, length );
+    report_bytes( (0 < result) ? (size_t) result : 0 );
 
     dfu_msg_response_output( __FUNCTION__, result );
 
@@ -200,11 +220,23 @@ int32_t dfu_get_status( dfu_device_t *device, dfu_status_t *status ) {
 
     TRACE( "%s( %p, %p )\n", __FUNCTION__, device, status );
 
-    if( (NULL == device) || (NULL == device->handle) ) {
+    if( (NULL == device) ||
+            ((NULL == device->handle) && (NULL == device->recorder)) ) {
         DEBUG( "Invalid parameter\n" );
         return -1;
     }
 
+    if( NULL == device->handle ) {
+        /* the status is checked when the recording is played back */
+        status->bStatus       = DFU_STATUS_OK;
+        status->bwPollTimeout = 0;
+        status->bState        = STATE_DFU_DOWNLOAD_IDLE;
+        status->iString       = 0;
+        report_transfer();
+        return device->recorder( device->recorder_context, DFU_GETSTATUS,
+                                 0, NULL, 0 );
+    }
+
     /* Initialize the status data structure */
     status->bStatus       = DFU_STATUS_ERROR_UNKNOWN;
     status->bwPollTimeout = 0;
@@ -397,6 +429,7 @@ retry:
             }
             
             retries--;
+            report_retry();
             goto retry;
         }
 
@@ -583,6 +616,7 @@ static int32_t dfu_make_idle( dfu_device_t *device,
     while( 0 < retries ) {
         if( 0 != dfu_get_status(device, &status) ) {
             dfu_clear_status( device );
+            report_retry();
             continue;
         }
 
@@ -634,6 +668,7 @@ static int32_t dfu_transfer_out( dfu_device_t *device,
                                  const int32_t value,
                                  uint8_t* data,
                                  const size_t length ) {
+    report_transfer();
     return libusb_control_transfer( device->handle,
                 /* bmRequestType */ LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE,
                 /* bRequest      */ request,
@@ -649,6 +684,7 @@ static int32_t dfu_transfer_in( dfu_device_t *device,
                                 const int32_t value,
                                 uint8_t* data,
                                 const size_t length ) {
+    report_transfer();
     return libusb_control_transfer( device->handle,
                 /* bmRequestType */ LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_CLASS | LIBUSB_RECIPIENT_INTERFACE,
                 /* bRequest      */ request,
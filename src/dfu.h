@@ -32,6 +32,15 @@ extern "C" {
 
 #include "dfu-device.h"
 
+/* DFU requests */
+#define DFU_DETACH      0
+#define DFU_DNLOAD      1
+#define DFU_UPLOAD      2
+#define DFU_GETSTATUS   3
+#define DFU_CLRSTATUS   4
+#define DFU_GETSTATE    5
+#define DFU_ABORT       6
+
 /* DFU states */
 #define STATE_APP_IDLE                  0x00
 #define STATE_APP_DETACH                0x01
@@ -108,6 +117,10 @@ int32_t dfu_download( dfu_device_t *device, const size_t length, uint8_t* data )
  *              device - must be less than wTransferSize
  *  data      - the data to transfer
  *
+ *  A device without a handle but with a recorder passes the request (and
+ *  any DFU_GETSTATUS, which then reports OK) to the recorder instead, which
+ *  returns 0 or < 0 on error.  This is used to compile flash bundles.
+ *
  *  returns the number of bytes written or < 0 on error
  */
 
@@ -119,6 +132,9 @@ int32_t dfu_upload( dfu_device_t *device, const size_t length, uint8_t* data );
  *              device - must be less than wTransferSize
  *  data      - the buffer to put the received data in
  *
+ *  A device without a handle passes the request to its recorder, as
+ *  dfu_download does, and gets back length bytes of 0xFF.
+ *
  *  returns the number of bytes received or < 0 on error
  */
 
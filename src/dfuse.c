@@ -0,0 +1,369 @@
+/*
+ * dfu-programmer
+ *
+ * dfuse.c
+ *
+ * Reads and writes the DfuSe file format (UM0391) used by ST for STM32
+ * firmware: a prefix, one image per alternate setting made of address /
+ * data elements, and the standard DFU suffix with its CRC.
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dfuse.h"
+#include "util.h"
+
+#define DFUSE_PREFIX_SIZE       11
+#define DFUSE_TARGET_SIZE       274
+#define DFUSE_ELEMENT_SIZE      8
+#define DFUSE_SUFFIX_SIZE       16
+#define DFUSE_TARGET_NAME_SIZE  255
+#define DFUSE_VERSION           1
+
+/* the only image written, the name ST uses for the alt 0 flash interface */
+#define DFUSE_TARGET_NAME       "Internal Flash"
+
+#define DFUSE_DEBUG_THRESHOLD   50
+#define DFUSE_TRACE_THRESHOLD   55
+
+#define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               DFUSE_DEBUG_THRESHOLD, __VA_ARGS__ )
+#define TRACE(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               DFUSE_TRACE_THRESHOLD, __VA_ARGS__ )
+
+static const char dfuse_prefix_signature[5] = { 'D', 'f', 'u', 'S', 'e' };
+static const char dfuse_target_signature[6] = { 'T', 'a', 'r', 'g', 'e', 't' };
+static const char dfuse_suffix_signature[3] = { 'U', 'F', 'D' };
+
+// ________  P R O T O T Y P E S  _______________________________
+static uint32_t dfuse_get_word( const uint8_t *ptr );
+static uint16_t dfuse_get_half( const uint8_t *ptr );
+static void dfuse_put_word( uint8_t *ptr, uint32_t value );
+static void dfuse_put_half( uint8_t *ptr, uint16_t value );
+/* read / write a little endian field, all DfuSe fields are little endian */
+
+static bool dfuse_page_blank( intel_buffer_in_t *buin, uint32_t page );
+/* return true if every byte of the page that is within data_start to
+ * data_end is 0xFF
+ */
+
+
+// ________  F U N C T I O N S  _______________________________
+static uint32_t dfuse_get_word( const uint8_t *ptr ) {
+    return ((uint32_t) ptr[3] << 24) | ((uint32_t) ptr[2] << 16) |
+           ((uint32_t) ptr[1] <<  8) |  (uint32_t) ptr[0];
+}
+
+static uint16_t dfuse_get_half( const uint8_t *ptr ) {
+    return (uint16_t) ((ptr[1] << 8) | ptr[0]);
+}
+
+static void dfuse_put_word( uint8_t *ptr, uint32_t value ) {
+    ptr[0] = (uint8_t) value;
+    ptr[1] = (uint8_t) (value >> 8);
+    ptr[2] = (uint8_t) (value >> 16);
+    ptr[3] = (uint8_t) (value >> 24);
+}
+
+static void dfuse_put_half( uint8_t *ptr, uint16_t value ) {
+    ptr[0] = (uint8_t) value;
+    ptr[1] = (uint8_t) (value >> 8);
+}
+
+int32_t dfuse_to_buffer( FILE *fp, intel_buffer_out_t *bout,
+                         uint32_t target_offset, bool quiet ) {
+    uint8_t *file = NULL;
+    const uint8_t *suffix;
+    size_t size = 0;
+    size_t pos;
+    size_t end;
+    uint32_t crc;
+    uint8_t targets;
+    uint8_t t;
+    int32_t invalid_address_count = 0;
+    int32_t retval;
+
+    file = dfu_read_all( fp, &size );
+    if( NULL == file ) {
+        if( !quiet ) fprintf( stderr, "Error reading the DfuSe file.\n" );
+        retval = -4;
+        goto error;
+    }
+
+    if( size < DFUSE_PREFIX_SIZE + DFUSE_SUFFIX_SIZE ||
+            0 != memcmp(file, dfuse_prefix_signature,
+                        sizeof(dfuse_prefix_signature)) ) {
+        if( !quiet ) fprintf( stderr, "Not a DfuSe file.\n" );
+        retval = -5;
+        goto error;
+    }
+
+    // the suffix is stored backwards, dwCRC is the last field in the file
+    suffix = &file[size - DFUSE_SUFFIX_SIZE];
+    if( 0 != memcmp(&suffix[8], dfuse_suffix_signature,
+                    sizeof(dfuse_suffix_signature)) ||
+            DFUSE_SUFFIX_SIZE != suffix[11] ) {
+        if( !quiet ) fprintf( stderr, "DfuSe file has no DFU suffix.\n" );
+        retval = -5;
+        goto error;
+    }
+
+    crc = dfu_crc32( DFU_CRC32_INIT, file, size - 4 );
+    if( crc != dfuse_get_word(&suffix[12]) ) {
+        if( !quiet ) {
+            fprintf( stderr, "DfuSe file CRC mismatch, 0x%08X expected 0x%08X.\n",
+                    crc, dfuse_get_word(&suffix[12]) );
+        }
+        retval = -5;
+        goto error;
+    }
+
+    DEBUG( "DfuSe file for device %04X:%04X, bcdDFU %04X.\n",
+            dfuse_get_half(&suffix[4]), dfuse_get_half(&suffix[2]),
+            dfuse_get_half(&suffix[6]) );
+    if( DFUSE_BCD_DFU != dfuse_get_half(&suffix[6]) ) {
+        DEBUG( "Unexpected bcdDFU, reading it anyway.\n" );
+    }
+
+    if( DFUSE_VERSION != file[5] ||
+            dfuse_get_word(&file[6]) != size - DFUSE_SUFFIX_SIZE ) {
+        if( !quiet ) fprintf( stderr, "DfuSe prefix is invalid.\n" );
+        retval = -5;
+        goto error;
+    }
+
+    targets = file[10];
+    pos = DFUSE_PREFIX_SIZE;
+    end = size - DFUSE_SUFFIX_SIZE;
+
+    for( t = 0; t < targets; t++ ) {
+        uint8_t alternate;
+        uint32_t target_size;
+        uint32_t elements;
+        uint32_t e;
+        char name[DFUSE_TARGET_NAME_SIZE + 1];
+
+        if( end - pos < DFUSE_TARGET_SIZE ||
+                0 != memcmp(&file[pos], dfuse_target_signature,
+                            sizeof(dfuse_target_signature)) ) {
+            if( !quiet ) fprintf( stderr, "DfuSe image %u is invalid.\n", t );
+            retval = -5;
+            goto error;
+        }
+
+        alternate = file[pos + 6];
+        name[0] = '\0';
+        if( 0 != dfuse_get_word(&file[pos + 7]) ) {
+            memcpy( name, &file[pos + 11], DFUSE_TARGET_NAME_SIZE );
+            name[DFUSE_TARGET_NAME_SIZE] = '\0';
+        }
+        target_size = dfuse_get_word( &file[pos + 266] );
+        elements = dfuse_get_word( &file[pos + 270] );
+        pos += DFUSE_TARGET_SIZE;
+
+        if( end - pos < target_size ) {
+            if( !quiet ) fprintf( stderr, "DfuSe image %u is truncated.\n", t );
+            retval = -5;
+            goto error;
+        }
+
+        if( 0 != alternate ) {
+            // option bytes, OTP, ... are not memories this program writes
+            if( !quiet ) {
+                fprintf( stderr,
+                    "WARNING: skipping DfuSe image for alternate setting %u (%s).\n",
+                    alternate, name );
+            }
+            pos += target_size;
+            continue;
+        }
+
+        DEBUG( "Image %u '%s', %u elements.\n", t, name, elements );
+        end = pos + target_size;
+        for( e = 0; e < elements; e++ ) {
+            uint32_t address;
+            uint32_t length;
+            uint32_t i;
+
+            if( end - pos < DFUSE_ELEMENT_SIZE ) {
+                if( !quiet ) fprintf( stderr, "DfuSe element %u is invalid.\n", e );
+                retval = -5;
+                goto error;
+            }
+            address = 0x7fffffff & dfuse_get_word( &file[pos] );
+            length = dfuse_get_word( &file[pos + 4] );
+            pos += DFUSE_ELEMENT_SIZE;
+            if( end - pos < length ) {
+                if( !quiet ) fprintf( stderr, "DfuSe element %u is truncated.\n", e );
+                retval = -5;
+                goto error;
+            }
+
+            DEBUG( "Loading 0x%X bytes at 0x%X.\n", length, address );
+            for( i = 0; i < length; i++ ) {
+                if( 0 != intel_process_data(bout, (char) file[pos + i],
+                            target_offset, address + i) ) {
+                    if( !invalid_address_count && !quiet ) {
+                        fprintf( stderr,
+                            "WARNING (element %u): 0x%02x address outside valid region,\n",
+                            e, address + i );
+                        fprintf( stderr,
+                            " suppressing additional address error messages.\n" );
+                    }
+                    invalid_address_count++;
+                }
+            }
+            pos += length;
+        }
+        pos = end;
+        end = size - DFUSE_SUFFIX_SIZE;
+    }
+
+    if( invalid_address_count && !quiet ) {
+        fprintf( stderr, "Total of 0x%X bytes in invalid addressed.\n",
+                invalid_address_count );
+    }
+
+    retval = invalid_address_count;
+
+error:
+    if( NULL != file ) {
+        free( file );
+        file = NULL;
+    }
+
+    return retval;
+}
+
+static bool dfuse_page_blank( intel_buffer_in_t *buin, uint32_t page ) {
+    uint32_t i = page * buin->info.page_size;
+    uint32_t last = i + buin->info.page_size - 1;
+
+    if( i < buin->info.data_start ) {
+        i = buin->info.data_start;
+    }
+    if( last > buin->info.data_end ) {
+        last = buin->info.data_end;
+    }
+    if( i > last ) {
+        return true;
+    }
+    return last - i + 1 == intel_find_data( &buin->data[i], last - i + 1 );
+}
+
+int32_t dfuse_from_buffer( intel_buffer_in_t *buin, bool force_full,
+                           uint32_t target_offset,
+                           uint16_t vendor_id, uint16_t product_id ) {
+    uint8_t *file = NULL;
+    size_t size;
+    size_t pos;
+    uint32_t page_size = buin->info.page_size;
+    uint32_t first_page = buin->info.data_start / page_size;
+    uint32_t last_page = buin->info.data_end / page_size;
+    uint32_t page;
+    uint32_t elements = 0;
+    uint32_t crc;
+    int32_t retval = 0;
+
+    // worst case is an element for every other page
+    size = DFUSE_PREFIX_SIZE + DFUSE_TARGET_SIZE + DFUSE_SUFFIX_SIZE
+         + (buin->info.data_end - buin->info.data_start + 1)
+         + DFUSE_ELEMENT_SIZE * ((last_page - first_page) / 2 + 1);
+    file = (uint8_t *) calloc( size, 1 );
+    if( NULL == file ) {
+        DEBUG( "Unable to allocate 0x%X bytes.\n", (uint32_t) size );
+        retval = -1;
+        goto finally;
+    }
+
+    memcpy( file, dfuse_prefix_signature, sizeof(dfuse_prefix_signature) );
+    file[5] = DFUSE_VERSION;
+    file[10] = 1;               // bTargets
+    pos = DFUSE_PREFIX_SIZE;
+
+    memcpy( &file[pos], dfuse_target_signature, sizeof(dfuse_target_signature) );
+    file[pos + 6] = 0;          // bAlternateSetting
+    dfuse_put_word( &file[pos + 7], 1 );
+    memcpy( &file[pos + 11], DFUSE_TARGET_NAME, sizeof(DFUSE_TARGET_NAME) - 1 );
+    pos += DFUSE_TARGET_SIZE;
+
+    for( page = first_page; page <= last_page; page++ ) {
+        uint32_t start;
+        uint32_t length;
+
+        if( !force_full && dfuse_page_blank(buin, page) ) {
+            continue;
+        }
+
+        // extend the element over the following pages that hold data
+        start = page * page_size;
+        if( start < buin->info.data_start ) {
+            start = buin->info.data_start;
+        }
+        while( page < last_page &&
+                (force_full || !dfuse_page_blank(buin, page + 1)) ) {
+            page++;
+        }
+        length = (page + 1) * page_size - start;
+        if( start + length - 1 > buin->info.data_end ) {
+            length = buin->info.data_end - start + 1;
+        }
+
+        TRACE( "Element %u, 0x%X bytes at 0x%X.\n",
+                elements, length, start + target_offset );
+        dfuse_put_word( &file[pos], start + target_offset );
+        dfuse_put_word( &file[pos + 4], length );
+        pos += DFUSE_ELEMENT_SIZE;
+        memcpy( &file[pos], &buin->data[start], length );
+        pos += length;
+        elements++;
+    }
+
+    // dwTargetSize and dwNbElements of the image, DFUImageSize of the file
+    dfuse_put_word( &file[DFUSE_PREFIX_SIZE + 266],
+            (uint32_t) (pos - DFUSE_PREFIX_SIZE - DFUSE_TARGET_SIZE) );
+    dfuse_put_word( &file[DFUSE_PREFIX_SIZE + 270], elements );
+    dfuse_put_word( &file[6], (uint32_t) pos );
+
+    dfuse_put_half( &file[pos], 0xffff );               // bcdDevice
+    dfuse_put_half( &file[pos + 2], product_id );
+    dfuse_put_half( &file[pos + 4], vendor_id );
+    dfuse_put_half( &file[pos + 6], DFUSE_BCD_DFU );
+    memcpy( &file[pos + 8], dfuse_suffix_signature,
+            sizeof(dfuse_suffix_signature) );
+    file[pos + 11] = DFUSE_SUFFIX_SIZE;
+    crc = dfu_crc32( DFU_CRC32_INIT, file, pos + 12 );
+    dfuse_put_word( &file[pos + 12], crc );
+    pos += DFUSE_SUFFIX_SIZE;
+
+    if( pos != fwrite(file, 1, pos, stdout) || 0 != fflush(stdout) ) {
+        retval = -3;
+    }
+
+finally:
+    if( NULL != file ) {
+        free( file );
+        file = NULL;
+    }
+
+    return retval;
+}
@@ -0,0 +1,65 @@
+/*
+ * dfu-programmer
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __DFUSE_H__
+#define __DFUSE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "intel_hex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bcdDFU of a DfuSe file, as opposed to 0x0100 / 0x0110 for plain DFU */
+#define DFUSE_BCD_DFU           0x011A
+
+int32_t dfuse_to_buffer( FILE *fp, intel_buffer_out_t *bout,
+        uint32_t target_offset, bool quiet );
+/*  Read a DfuSe (.dfu) file, as made by ST's DfuSe tools or dfu-tool, from
+ *  an open file into bout.  The suffix CRC and signatures are checked
+ *  before anything is loaded.  The elements of the alternate setting 0
+ *  image (internal flash) are placed at their element address, images for
+ *  other alternate settings (option bytes, OTP) are skipped with a warning.
+ *
+ *  \return 0 = success
+ *          + = the number of data bytes outside the buffer that were ignored
+ *          - = error reading or validating the file
+ */
+
+int32_t dfuse_from_buffer( intel_buffer_in_t *buin, bool force_full,
+        uint32_t target_offset, uint16_t vendor_id, uint16_t product_id );
+/*  Used to convert a buffer to a DfuSe file on stdout.  One alternate
+ *  setting 0 image is written with an element for each run of pages that
+ *  hold data, and the suffix carries the given vendor and product ids.
+ *  target offset is the address location of buffer 0
+ *  force_full writes data_start to data_end as a single element.
+ *
+ *  \return 0 = success, -1 = out of memory, -3 = error writing stdout
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ * dfu-programmer
+ *
+ * elf.c
+ *
+ * Loads the PT_LOAD segments of a 32 bit ELF executable into a memory
+ * image, so firmware can be flashed without converting it to hex first.
+ * Both little endian (AVR, ARM) and big endian (AVR32) files are handled.
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf.h"
+#include "compress.h"
+#include "util.h"
+
+#define ELF_IDENT_SIZE      16
+#define ELF_CLASS_32        1
+#define ELF_DATA_LSB        1
+#define ELF_DATA_MSB        2
+#define ELF_TYPE_EXEC       2
+#define ELF_PT_LOAD         1
+
+#define ELF32_HEADER_SIZE   52
+#define ELF32_PHDR_SIZE     32
+
+#define ELF_DEBUG_THRESHOLD     50
+#define ELF_TRACE_THRESHOLD     55
+
+#define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               ELF_DEBUG_THRESHOLD, __VA_ARGS__ )
+#define TRACE(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               ELF_TRACE_THRESHOLD, __VA_ARGS__ )
+
+static const uint8_t elf_magic[4] = { 0x7f, 'E', 'L', 'F' };
+
+// ________  P R O T O T Y P E S  _______________________________
+static uint32_t elf_get_word( const uint8_t *ptr, bool msb );
+static uint16_t elf_get_half( const uint8_t *ptr, bool msb );
+/* read a 32 / 16 bit field of the given byte order */
+
+
+// ________  F U N C T I O N S  _______________________________
+bool elf_check_file( const char *filename ) {
+    uint8_t ident[sizeof(elf_magic)];
+    FILE *fp;
+    int c;
+    bool result;
+
+    if( NULL == filename ) {
+        return false;
+    }
+
+    if( 0 == strcmp("STDIN", filename) ) {
+        // only one character can be pushed back, 0x7f never starts a hex file
+        c = fgetc( stdin );
+        if( EOF == c ) {
+            return false;
+        }
+        ungetc( c, stdin );
+        return elf_magic[0] == c;
+    }
+
+    fp = fopen( filename, "rb" );
+    if( NULL == fp || NULL == (fp = compress_open(fp, filename, true)) ) {
+        return false;
+    }
+    result = (sizeof(ident) == fread(ident, 1, sizeof(ident), fp)) &&
+             (0 == memcmp(ident, elf_magic, sizeof(elf_magic)));
+    fclose( fp );
+
+    return result;
+}
+
+static uint32_t elf_get_word( const uint8_t *ptr, bool msb ) {
+    if( msb ) {
+        return ((uint32_t) ptr[0] << 24) | ((uint32_t) ptr[1] << 16) |
+               ((uint32_t) ptr[2] <<  8) |  (uint32_t) ptr[3];
+    }
+    return ((uint32_t) ptr[3] << 24) | ((uint32_t) ptr[2] << 16) |
+           ((uint32_t) ptr[1] <<  8) |  (uint32_t) ptr[0];
+}
+
+static uint16_t elf_get_half( const uint8_t *ptr, bool msb ) {
+    if( msb ) {
+        return (uint16_t) ((ptr[0] << 8) | ptr[1]);
+    }
+    return (uint16_t) ((ptr[1] << 8) | ptr[0]);
+}
+
+int32_t elf_to_buffer( FILE *fp, intel_buffer_out_t *bout,
+                       uint32_t target_offset, bool quiet ) {
+    uint8_t *file = NULL;
+    size_t size = 0;
+    bool msb;
+    uint32_t phoff;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t i;
+    uint32_t j;
+    uint32_t buffer_start = 0x7fffffff & target_offset;
+    uint32_t buffer_end = buffer_start + bout->info.total_size - 1;
+    int32_t invalid_address_count = 0;
+    int32_t retval;
+
+    file = dfu_read_all( fp, &size );
+    if( NULL == file ) {
+        if( !quiet ) fprintf( stderr, "Error reading the ELF file.\n" );
+        retval = -4;
+        goto error;
+    }
+
+    if( size < ELF32_HEADER_SIZE ||
+            0 != memcmp(file, elf_magic, sizeof(elf_magic)) ) {
+        if( !quiet ) fprintf( stderr, "Not an ELF file.\n" );
+        retval = -5;
+        goto error;
+    }
+
+    if( ELF_CLASS_32 != file[4] ||
+            (ELF_DATA_LSB != file[5] && ELF_DATA_MSB != file[5]) ) {
+        if( !quiet )
+            fprintf( stderr, "Only 32 bit ELF executables are supported.\n" );
+        retval = -5;
+        goto error;
+    }
+    msb = (ELF_DATA_MSB == file[5]);
+
+    if( ELF_TYPE_EXEC != elf_get_half(&file[16], msb) ) {
+        if( !quiet )
+            fprintf( stderr, "ELF file is not an executable (not linked?).\n" );
+        retval = -5;
+        goto error;
+    }
+
+    DEBUG( "ELF machine %u, %s endian.\n",
+            elf_get_half(&file[18], msb), msb ? "big" : "little" );
+
+    phoff = elf_get_word( &file[28], msb );
+    phentsize = elf_get_half( &file[42], msb );
+    phnum = elf_get_half( &file[44], msb );
+
+    if( phentsize < ELF32_PHDR_SIZE || phoff > size ||
+            (size - phoff) / phentsize < phnum ) {
+        if( !quiet ) fprintf( stderr, "ELF program headers are invalid.\n" );
+        retval = -5;
+        goto error;
+    }
+
+    for( i = 0; i < phnum; i++ ) {
+        const uint8_t *phdr = &file[phoff + i * phentsize];
+        uint32_t offset = elf_get_word( &phdr[4], msb );
+        uint32_t paddr = 0x7fffffff & elf_get_word( &phdr[12], msb );
+        uint32_t filesz = elf_get_word( &phdr[16], msb );
+
+        if( ELF_PT_LOAD != elf_get_word(&phdr[0], msb) || 0 == filesz ) {
+            continue;
+        }
+
+        if( offset > size || size - offset < filesz ) {
+            if( !quiet ) fprintf( stderr, "ELF segment %u is truncated.\n", i );
+            retval = -5;
+            goto error;
+        }
+
+        if( paddr > buffer_end || paddr + (filesz - 1) < buffer_start ) {
+            DEBUG( "Skipping segment at 0x%X, outside 0x%X to 0x%X.\n",
+                    paddr, buffer_start, buffer_end );
+            continue;
+        }
+
+        DEBUG( "Loading 0x%X bytes at 0x%X.\n", filesz, paddr );
+        for( j = 0; j < filesz; j++ ) {
+            if( 0 != intel_process_data(bout, (char) file[offset + j],
+                        target_offset, paddr + j) ) {
+                if( !invalid_address_count && !quiet ) {
+                    fprintf( stderr,
+                        "WARNING (segment %u): 0x%02x address outside valid region,\n",
+                        i, paddr + j );
+                    fprintf( stderr,
+                        " suppressing additional address error messages.\n" );
+                }
+                invalid_address_count++;
+            }
+        }
+    }
+
+    if( invalid_address_count && !quiet ) {
+        fprintf( stderr, "Total of 0x%X bytes in invalid addressed.\n",
+                invalid_address_count );
+    }
+
+    retval = invalid_address_count;
+
+error:
+    if( NULL != file ) {
+        free( file );
+        file = NULL;
+    }
+
+    return retval;
+}
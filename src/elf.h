@@ -0,0 +1,61 @@
+/*
+ * dfu-programmer
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __ELF_H__
+#define __ELF_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "intel_hex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* avr-gcc links the .eeprom section at this address */
+#define ELF_AVR_EEPROM_OFFSET   0x810000
+
+bool elf_check_file( const char *filename );
+/*  Return true if the named file (or STDIN) starts with the ELF magic
+ *  number.  Nothing is consumed from STDIN.
+ */
+
+int32_t elf_to_buffer( FILE *fp, intel_buffer_out_t *bout,
+        uint32_t target_offset, bool quiet );
+/*  Read a 32 bit ELF executable from an open file into bout.  The file
+ *  contents of each PT_LOAD segment are placed at the segment's physical
+ *  address, masked the same way as hex file addresses.  Segments that lie
+ *  entirely outside of target_offset .. target_offset + total_size belong
+ *  to another memory (eg the AVR .eeprom section at ELF_AVR_EEPROM_OFFSET
+ *  or the AVR32 user page) and are skipped without a warning.
+ *
+ *  \return 0 = success
+ *          + = the number of bytes in partly overlapping segments that were
+ *              outside the buffer and have been ignored
+ *          - = error reading or parsing the file
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
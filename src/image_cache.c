@@ -0,0 +1,351 @@
+/*
+ * dfu-programmer
+ *
+ * image_cache.c
+ *
+ * An on-disk cache of parsed memory images.  Entries are named by the
+ * SHA-256 of the source file and the buffer parameters, and hold the
+ * buffer info followed by the uint16_t image exactly as it is kept in
+ * memory, so a hit is a single read instead of parsing the file again.
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "image_cache.h"
+#include "util.h"
+
+#define IMAGE_CACHE_MAGIC       "DFUIMG\r\n"
+#define IMAGE_CACHE_BYTE_ORDER  0x01020304
+#define IMAGE_CACHE_READ_CHUNK  0x10000
+
+/* every field is naturally aligned, the image follows at header_size */
+typedef struct {
+    char magic[8];              // IMAGE_CACHE_MAGIC
+    uint32_t byte_order;        // IMAGE_CACHE_BYTE_ORDER in the writer's order
+    uint32_t header_size;       // sizeof(image_cache_header_t)
+    uint8_t source_digest[SHA256_DIGEST_SIZE];
+    uint32_t total_size;
+    uint32_t page_size;
+    uint32_t target_offset;
+    uint32_t flags;
+    uint32_t bin_offset;
+    uint32_t block_start;       // the intel_buffer_info_t extents
+    uint32_t block_end;
+    uint32_t data_start;
+    uint32_t data_end;
+    uint32_t valid_start;
+    uint32_t valid_end;
+    uint32_t reserved;
+    uint8_t image_digest[SHA256_DIGEST_SIZE];   // header (digest zeroed) + image
+} image_cache_header_t;
+
+/* an image kept in memory, with the header its entry would have */
+typedef struct {
+    image_cache_header_t header;
+    uint16_t *data;             // NULL for an unused slot
+    uint32_t used;              // when it was last used, larger is later
+} image_cache_memory_t;
+
+static image_cache_memory_t memory[IMAGE_CACHE_MEMORY_MAX];
+static uint32_t memory_count = 0;   // slots that may be used, 0 for none
+static uint32_t memory_clock = 0;
+
+#define CACHE_DEBUG_THRESHOLD   50
+#define CACHE_TRACE_THRESHOLD   55
+
+#define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               CACHE_DEBUG_THRESHOLD, __VA_ARGS__ )
+#define TRACE(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               CACHE_TRACE_THRESHOLD, __VA_ARGS__ )
+
+// ________  P R O T O T Y P E S  _______________________________
+static void image_cache_digest( const image_cache_header_t *header,
+        const uint16_t *data, uint8_t digest[SHA256_DIGEST_SIZE] );
+/* compute the image digest of an entry */
+
+static bool image_cache_match( const image_cache_key_t *key,
+        const image_cache_header_t *header );
+/* return true if the header was written by this build for this key */
+
+static void image_cache_remember( const image_cache_header_t *header,
+        const uint16_t *data );
+/* keep a copy of an image in memory, replacing the least recently used one
+ * when all the slots are taken.  does nothing if memory is not used
+ */
+
+
+// ________  F U N C T I O N S  _______________________________
+int32_t image_cache_key( image_cache_key_t *key, const char *cache_dir,
+        const char *filename, const intel_buffer_out_t *bout,
+        uint32_t target_offset, bool bin, uint32_t bin_offset ) {
+    sha256_context_t ctx;
+    uint8_t chunk[IMAGE_CACHE_READ_CHUNK];
+    size_t length;
+    size_t used;
+    FILE *fp;
+    int i;
+
+    if( (NULL == cache_dir && 0 == memory_count) || NULL == filename ||
+            0 == strcmp("STDIN", filename) ) {
+        return -1;
+    }
+
+    fp = fopen( filename, "rb" );
+    if( NULL == fp ) {
+        return -1;
+    }
+    sha256_init( &ctx );
+    while( 0 != (length = fread(chunk, 1, sizeof(chunk), fp)) ) {
+        sha256_update( &ctx, chunk, length );
+    }
+    if( ferror(fp) ) {
+        fclose( fp );
+        return -1;
+    }
+    fclose( fp );
+    sha256_final( &ctx, key->source_digest );
+
+    key->total_size = (uint32_t) bout->info.total_size;
+    key->page_size = (uint32_t) bout->info.page_size;
+    key->target_offset = target_offset;
+    key->flags = bin ? IMAGE_CACHE_BIN : 0;
+    key->bin_offset = bin ? bin_offset : 0;
+
+    key->path[0] = '\0';
+    if( NULL == cache_dir ) {
+        return 0;
+    }
+    used = (size_t) snprintf( key->path, sizeof(key->path), "%s/", cache_dir );
+    for( i = 0; i < SHA256_DIGEST_SIZE && used < sizeof(key->path); i++ ) {
+        used += (size_t) snprintf( &key->path[used], sizeof(key->path) - used,
+                                   "%02x", key->source_digest[i] );
+    }
+    if( used < sizeof(key->path) ) {
+        used += (size_t) snprintf( &key->path[used], sizeof(key->path) - used,
+                        "-%X-%X-%X-%X-%X.img", key->total_size, key->page_size,
+                        key->target_offset, key->flags, key->bin_offset );
+    }
+    if( used >= sizeof(key->path) ) {
+        DEBUG( "Cache directory name is too long.\n" );
+        return -1;
+    }
+
+    TRACE( "Cache entry %s\n", key->path );
+    return 0;
+}
+
+static void image_cache_digest( const image_cache_header_t *header,
+        const uint16_t *data, uint8_t digest[SHA256_DIGEST_SIZE] ) {
+    image_cache_header_t copy = *header;
+    sha256_context_t ctx;
+
+    memset( copy.image_digest, 0, sizeof(copy.image_digest) );
+    sha256_init( &ctx );
+    sha256_update( &ctx, (const uint8_t *) &copy, sizeof(copy) );
+    sha256_update( &ctx, (const uint8_t *) data,
+                   header->total_size * sizeof(uint16_t) );
+    sha256_final( &ctx, digest );
+}
+
+static bool image_cache_match( const image_cache_key_t *key,
+        const image_cache_header_t *header ) {
+    return 0 == memcmp(header->magic, IMAGE_CACHE_MAGIC, sizeof(header->magic))
+        && IMAGE_CACHE_BYTE_ORDER == header->byte_order
+        && sizeof(image_cache_header_t) == header->header_size
+        && 0 == memcmp(header->source_digest, key->source_digest,
+                       sizeof(key->source_digest))
+        && key->total_size == header->total_size
+        && key->page_size == header->page_size
+        && key->target_offset == header->target_offset
+        && key->flags == header->flags
+        && key->bin_offset == header->bin_offset;
+}
+
+void image_cache_keep( uint32_t count ) {
+    uint32_t i;
+
+    if( count > IMAGE_CACHE_MEMORY_MAX ) {
+        count = IMAGE_CACHE_MEMORY_MAX;
+    }
+    for( i = count; i < IMAGE_CACHE_MEMORY_MAX; i++ ) {
+        free( memory[i].data );
+        memory[i].data = NULL;
+    }
+    memory_count = count;
+}
+
+static void image_cache_remember( const image_cache_header_t *header,
+        const uint16_t *data ) {
+    image_cache_memory_t *slot = NULL;
+    size_t length = header->total_size * sizeof(uint16_t);
+    uint32_t i;
+
+    for( i = 0; i < memory_count; i++ ) {
+        if( NULL == slot || NULL == memory[i].data ||
+                (NULL != slot->data && memory[i].used < slot->used) ) {
+            slot = &memory[i];
+        }
+    }
+    if( NULL == slot ) {
+        return;
+    }
+
+    free( slot->data );
+    slot->data = (uint16_t *) malloc( length );
+    if( NULL == slot->data ) {
+        return;
+    }
+    memcpy( slot->data, data, length );
+    slot->header = *header;
+    slot->used = ++memory_clock;
+}
+
+int32_t image_cache_load( const image_cache_key_t *key,
+        intel_buffer_out_t *bout ) {
+    image_cache_header_t header;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    size_t length = bout->info.total_size;
+    uint32_t i;
+    FILE *fp;
+
+    // an image kept in memory was checked when it was made or loaded
+    for( i = 0; i < memory_count; i++ ) {
+        if( NULL != memory[i].data &&
+                image_cache_match(key, &memory[i].header) ) {
+            header = memory[i].header;
+            memcpy( bout->data, memory[i].data, length * sizeof(uint16_t) );
+            memory[i].used = ++memory_clock;
+            DEBUG( "Using the image kept in memory.\n" );
+            goto hit;
+        }
+    }
+    if( '\0' == key->path[0] ) {
+        return 1;
+    }
+
+    fp = fopen( key->path, "rb" );
+    if( NULL == fp ) {
+        DEBUG( "No cache entry %s\n", key->path );
+        return 1;
+    }
+
+    if( 1 != fread(&header, sizeof(header), 1, fp) ||
+            !image_cache_match(key, &header) ) {
+        DEBUG( "Cache entry %s does not match.\n", key->path );
+        goto miss;
+    }
+
+    if( length != fread(bout->data, sizeof(uint16_t), length, fp) ) {
+        DEBUG( "Cache entry %s is truncated.\n", key->path );
+        goto miss;
+    }
+
+    image_cache_digest( &header, bout->data, digest );
+    if( 0 != memcmp(digest, header.image_digest, sizeof(digest)) ) {
+        DEBUG( "Cache entry %s is corrupt.\n", key->path );
+        goto miss;
+    }
+    fclose( fp );
+    image_cache_remember( &header, bout->data );
+    DEBUG( "Using cached image %s\n", key->path );
+
+hit:
+    bout->info.block_start = header.block_start;
+    bout->info.block_end = header.block_end;
+    bout->info.data_start = header.data_start;
+    bout->info.data_end = header.data_end;
+    bout->info.valid_start = header.valid_start;
+    bout->info.valid_end = header.valid_end;
+    return 0;
+
+miss:
+    fclose( fp );
+    // leave bout as intel_init_buffer_out made it
+    memset( bout->data, 0xff, length * sizeof(uint16_t) );
+    return 1;
+}
+
+int32_t image_cache_store( const image_cache_key_t *key,
+        const intel_buffer_out_t *bout ) {
+    image_cache_header_t header;
+    char temp[IMAGE_CACHE_PATH_MAX + 32];
+    size_t length = bout->info.total_size;
+    FILE *fp;
+
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, IMAGE_CACHE_MAGIC, sizeof(header.magic) );
+    header.byte_order = IMAGE_CACHE_BYTE_ORDER;
+    header.header_size = sizeof(header);
+    memcpy( header.source_digest, key->source_digest,
+            sizeof(header.source_digest) );
+    header.total_size = key->total_size;
+    header.page_size = key->page_size;
+    header.target_offset = key->target_offset;
+    header.flags = key->flags;
+    header.bin_offset = key->bin_offset;
+    header.block_start = bout->info.block_start;
+    header.block_end = bout->info.block_end;
+    header.data_start = bout->info.data_start;
+    header.data_end = bout->info.data_end;
+    header.valid_start = bout->info.valid_start;
+    header.valid_end = bout->info.valid_end;
+    image_cache_digest( &header, bout->data, header.image_digest );
+    image_cache_remember( &header, bout->data );
+    if( '\0' == key->path[0] ) {
+        return 0;
+    }
+
+    // other processes may share the cache directory and store the same entry
+    snprintf( temp, sizeof(temp), "%s.%ld.tmp", key->path, (long) getpid() );
+    fp = fopen( temp, "wb" );
+    if( NULL == fp ) {
+        DEBUG( "Unable to create %s\n", temp );
+        return -1;
+    }
+
+    if( 1 != fwrite(&header, sizeof(header), 1, fp) ||
+            length != fwrite(bout->data, sizeof(uint16_t), length, fp) ) {
+        DEBUG( "Error writing %s\n", temp );
+        fclose( fp );
+        remove( temp );
+        return -1;
+    }
+    if( 0 != fclose(fp) ) {
+        DEBUG( "Error writing %s\n", temp );
+        remove( temp );
+        return -1;
+    }
+
+#ifdef _WIN32
+    // rename does not replace an existing file here, eg a corrupt entry
+    remove( key->path );
+#endif
+    if( 0 != rename(temp, key->path) ) {
+        DEBUG( "Unable to rename %s\n", temp );
+        remove( temp );
+        return -1;
+    }
+
+    DEBUG( "Cached image as %s\n", key->path );
+    return 0;
+}
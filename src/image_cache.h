@@ -0,0 +1,90 @@
+/*
+ * dfu-programmer
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+#ifndef __IMAGE_CACHE_H__
+#define __IMAGE_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "intel_hex.h"
+#include "sha256.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMAGE_CACHE_PATH_MAX    1024
+
+/* at most this many images are kept in memory, see image_cache_keep */
+#define IMAGE_CACHE_MEMORY_MAX  8
+
+/* flags in the key, what the source file was read as */
+#define IMAGE_CACHE_BIN         0x01
+
+typedef struct {
+    uint8_t source_digest[SHA256_DIGEST_SIZE]; // SHA-256 of the source file
+    uint32_t total_size;        // memory size of the buffer
+    uint32_t page_size;         // flash page size of the buffer
+    uint32_t target_offset;     // address of buffer[0]
+    uint32_t flags;             // IMAGE_CACHE_BIN ...
+    uint32_t bin_offset;        // address of a binary file, 0 otherwise
+    char path[IMAGE_CACHE_PATH_MAX];    // cache entry for this key, empty
+                                        // when only memory is used
+} image_cache_key_t;
+
+int32_t image_cache_key( image_cache_key_t *key, const char *cache_dir,
+        const char *filename, const intel_buffer_out_t *bout,
+        uint32_t target_offset, bool bin, uint32_t bin_offset );
+/* hash the source file and fill in the key for an image of it made with
+ * bout's sizes, target_offset and (for --bin) bin_offset.  STDIN can not be
+ * cached since it can only be read once.  cache_dir may be NULL while
+ * images are kept in memory.
+ * return 0 on success, -1 if the file can not be cached
+ */
+
+void image_cache_keep( uint32_t count );
+/* also keep the count most recently used images in memory, for a process
+ * that flashes one device after another.  0 (the default) frees them and
+ * only uses the cache directory.  at most IMAGE_CACHE_MEMORY_MAX are kept.
+ */
+
+int32_t image_cache_load( const image_cache_key_t *key,
+        intel_buffer_out_t *bout );
+/* load the cached image for key into bout, which has been set up with
+ * intel_init_buffer_out.  the entry header must match the key and the
+ * SHA-256 over the header and image must match before it is used.
+ * return 0 when bout holds the cached image, 1 when there is no usable
+ * entry (bout is left blank)
+ */
+
+int32_t image_cache_store( const image_cache_key_t *key,
+        const intel_buffer_out_t *bout );
+/* write bout as the cache entry for key.  the entry is written to a
+ * temporary file and renamed, so readers never see a partial entry.
+ * return 0 on success, -1 if the entry could not be written
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -37,6 +37,10 @@
 #include <string.h>
 
 #include "intel_hex.h"
+#include "compress.h"
+#include "elf.h"
+#include "srec.h"
+#include "dfuse.h"
 #include "util.h"
 
 struct intel_record {
@@ -49,6 +53,40 @@ struct intel_record {
 
 #define IHEX_COLS 16
 #define IHEX_64KB_PAGE 0x10000
+#define IHEX_EOF_RECORD ":00000001FF\n"
+
+/* ':' + count, address, type, up to 255 data bytes and checksum + '\n' */
+#define IHEX_MAX_LINE_LENGTH    (1 + 2 * (1 + 2 + 1 + 255 + 1) + 1)
+#define IHEX_OUT_BUFFER_SIZE    0x10000
+#define IHEX_BIN_CHUNK_SIZE     0x10000
+
+/* validation compares four uint16_t image entries (lanes) per 64 bit word */
+#define IHEX_LANES_LOW      0x00FF00FF00FF00FFULL
+#define IHEX_LANES_HALF     0x0000FFFF0000FFFFULL
+#define IHEX_LANES_CARRY    0x0100010001000100ULL
+#define IHEX_LANES_ONE      0x0001000100010001ULL
+#define IHEX_VALIDATE_BLOCK 64
+
+/* blank scans test this many bytes (four 64 bit words) per step */
+#define IHEX_SCAN_BLOCK     32
+
+struct ihex_writer {
+    FILE *fp;           // where the hex output is flushed to
+    size_t used;        // number of characters waiting in data
+    char data[IHEX_OUT_BUFFER_SIZE];
+};
+
+struct intel_hex_stream {
+    struct ihex_writer out;
+    struct intel_record record;     // the line being filled
+    uint32_t offset_address;        // offset written by the last 04 record
+    uint32_t next;                  // next buffer index, UINT32_MAX at first
+    uint32_t target_offset;
+    uint8_t record_width;
+    bool force_full;
+    bool minimal_04;
+    bool failed;                    // a line could not be written
+};
 
 
 #define IHEX_DEBUG_THRESHOLD    50
@@ -70,7 +108,10 @@ static int intel_validate_checksum( struct intel_record *record );
 static int32_t ihex_make_line( struct intel_record *record, char *str );
 /* provide record type a list of values, they are converted into a line and put at str
  * values are 2 address bytes, the record type and any values. A checksum
- * is added to the end and the line length is prepended.
+ * is added to the end and the line length is prepended.  The line is not
+ * null terminated, the number of characters written (including the trailing
+ * newline) is returned, 0 for an empty record or -1 on error.  str must have
+ * room for IHEX_MAX_LINE_LENGTH characters.
  */
 
 static int32_t ihex_make_checksum( struct intel_record *record );
@@ -78,23 +119,39 @@ static int32_t ihex_make_checksum( struct intel_record *record );
  * return 0
  */
 
-static int32_t ihex_make_record_04_offset( uint32_t offset, char *str );
+static int32_t ihex_make_record_04_offset( uint32_t offset,
+                                           struct intel_record *record );
 /* make an 04 record type offset, where the desired offset address is found by
  * multiplying value by 0x1000 (or the 64kb page size).  Therefore, the given
- * offset value must be a clean multiple of 0x10000.  the offset value
- * is placed in the buffer at str
+ * offset value must be a clean multiple of 0x10000.  the offset record
+ * is placed in record
+ */
+
+static int32_t ihex_write_record( struct ihex_writer *out,
+                                  struct intel_record *record );
+/* format record into the output buffer, flushing the buffer first if it
+ * cannot hold another line.  return 0 on success, -1 on error
  */
 
-//static int32_t ihex_process_record( struct intel_record *record,
-//        const uint8_t job, uint32_t next_address );
-/* call this function when a record needs to be processed (specify w/ job)
- * and a new blank record needs to be created
+static int32_t ihex_flush( struct ihex_writer *out );
+/* write everything waiting in the output buffer with a single fwrite.
+ * return 0 on success, -1 on a write error
  */
 
 static void ihex_clear_record( struct intel_record *record, uint32_t address );
 /* wipes out a record (resets it to zero)
  */
 
+static void intel_validate_page( const intel_buffer_in_t *buin,
+                                 const intel_buffer_out_t *bout,
+                                 int32_t start, int32_t end,
+                                 int32_t *invalid_data_region,
+                                 int32_t *invalid_outside_data_region );
+/* add the number of bytes from start to end (within a single page) that do
+ * not match the image to the two counters, a word of image entries at a
+ * time.  the first mismatch on the page is reported.
+ */
+
 
 // ________  F U N C T I O N S  _______________________________
 static int intel_validate_checksum( struct intel_record *record ) {
@@ -272,6 +329,13 @@ int32_t intel_process_data( intel_buffer_out_t *bout, char value,
 
 int32_t intel_hex_to_buffer( char *filename, intel_buffer_out_t *bout,
                              uint32_t target_offset, bool quiet ) {
+    return intel_hex_stream_to_buffer( filename, bout, target_offset, quiet,
+                                       NULL, NULL );
+}
+
+int32_t intel_hex_stream_to_buffer( char *filename, intel_buffer_out_t *bout,
+                                    uint32_t target_offset, bool quiet,
+                                    intel_record_hook_t hook, void *context ) {
     FILE *fp = NULL;
     struct intel_record record;
     // unsigned int count, type, checksum, address; char data[256]
@@ -281,6 +345,7 @@ int32_t intel_hex_to_buffer( char *filename, intel_buffer_out_t *bout,
     int32_t  invalid_address_count = 0;     // used for error checking
     int32_t retval;             // return value
     int i = 0;
+    int c;
 
     if ( (0 >= bout->info.total_size) ) {
         DEBUG( "Must provide valid memory size in bout.\n" );
@@ -297,7 +362,8 @@ int32_t intel_hex_to_buffer( char *filename, intel_buffer_out_t *bout,
     if( 0 == strcmp("STDIN", filename) ) {
         fp = stdin;
     } else {
-        fp = fopen( filename, "r" );
+        // binary mode for ELF files, the text readers handle "\r\n" themselves
+        fp = fopen( filename, "rb" );
         if( NULL == fp ) {
             if( !quiet ) fprintf( stderr, "Error opening %s\n", filename );
             retval = -3;
@@ -305,6 +371,31 @@ int32_t intel_hex_to_buffer( char *filename, intel_buffer_out_t *bout,
         }
     }
 
+    // gzip or zstd compressed files are decoded as they are read
+    if( NULL == (fp = compress_open(fp, filename, quiet)) ) {
+        retval = -3;
+        goto error;
+    }
+
+    // the format is detected from the first record, ':' for intel hex
+    c = fgetc( fp );
+    if( EOF != c ) {
+        ungetc( c, fp );
+    }
+    if( 'S' == c ) {
+        DEBUG( "Reading Motorola S-records.\n" );
+        retval = srec_to_buffer( fp, bout, target_offset, quiet );
+        goto error;
+    } else if( 'D' == c ) {
+        DEBUG( "Reading a DfuSe file.\n" );
+        retval = dfuse_to_buffer( fp, bout, target_offset, quiet );
+        goto error;
+    } else if( 0x7f == c ) {
+        DEBUG( "Reading an ELF file.\n" );
+        retval = elf_to_buffer( fp, bout, target_offset, quiet );
+        goto error;
+    }
+
     // iterate through ihex file and assign values to memory and user
     do {
         // read the data
@@ -324,6 +415,18 @@ int32_t intel_hex_to_buffer( char *filename, intel_buffer_out_t *bout,
         // process the data
         switch( record.type ) {
             case 0:
+                address = 0x7fffffff &
+                    (address_offset + ((uint32_t) record.address));
+                if( NULL != hook && address >= (0x7fffffff & target_offset) &&
+                        address - (0x7fffffff & target_offset) <
+                        bout->info.total_size &&
+                        0 != hook(context, bout,
+                            address - (0x7fffffff & target_offset),
+                            record.count) ) {
+                    DEBUG( "Reading stopped at line %u.\n", line_count - 1 );
+                    retval = -6;
+                    goto error;
+                }
                 for( address = address_offset + ((uint32_t) record.address),
                         i = 0; i < record.count; i++, address++ ) {
                     if ( 0 != intel_process_data(bout, record.data[i],
@@ -385,10 +488,120 @@ error:
     return retval;
 }
 
+int32_t intel_bin_to_buffer( char *filename, intel_buffer_out_t *bout,
+                             uint32_t target_offset, uint32_t bin_offset,
+                             bool quiet ) {
+    FILE *fp = NULL;
+    uint8_t chunk[IHEX_BIN_CHUNK_SIZE];
+    size_t length;
+    size_t i;
+    uint32_t address;           // address of the next byte from the file
+    uint32_t raddress;          // relative address = address - target offset
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    int32_t  invalid_address_count = 0;
+    int32_t retval;
+
+    if ( (0 >= bout->info.total_size) ) {
+        DEBUG( "Must provide valid memory size in bout.\n" );
+        retval = -1;
+        goto error;
+    }
+
+    if (NULL == filename) {
+        if( !quiet ) fprintf( stderr, "Invalid filename.\n" );
+        retval = -2;
+        goto error;
+    }
+
+    if( 0 == strcmp("STDIN", filename) ) {
+        fp = stdin;
+    } else {
+        fp = fopen( filename, "rb" );
+        if( NULL == fp ) {
+            if( !quiet ) fprintf( stderr, "Error opening %s\n", filename );
+            retval = -3;
+            goto error;
+        }
+    }
+
+    if( NULL == (fp = compress_open(fp, filename, quiet)) ) {
+        retval = -3;
+        goto error;
+    }
+
+    // same masking as intel_process_data
+    target_offset &= 0x7fffffff;
+    address = 0x7fffffff & bin_offset;
+
+    while( 0 < (length = fread(chunk, 1, sizeof(chunk), fp)) ) {
+        for( i = 0; i < length; i++, address++ ) {
+            raddress = address - target_offset;
+            if( address < target_offset || raddress >= bout->info.total_size ) {
+                if( !invalid_address_count ) {
+                    DEBUG( "Valid address region from 0x%X to 0x%X.\n",
+                        target_offset, target_offset + bout->info.total_size - 1);
+                    if( !quiet )
+                        fprintf( stderr,
+                            "WARNING (byte 0x%X): 0x%02x address outside valid region,\n"
+                            " suppressing additional address error messages.\n",
+                            address - (0x7fffffff & bin_offset), address );
+                }
+                invalid_address_count++;
+                continue;
+            }
+            bout->data[raddress] = chunk[i];
+            if( raddress < first ) first = raddress;
+            last = raddress;
+        }
+    }
+
+    if( ferror(fp) ) {
+        if( !quiet ) fprintf( stderr, "Error reading %s\n", filename );
+        retval = -4;
+        goto error;
+    }
+
+    if( UINT32_MAX != first ) {
+        if( first < bout->info.data_start ) {
+            bout->info.data_start = first;
+        }
+        if( last > bout->info.data_end ) {
+            bout->info.data_end = last;
+        }
+    }
+
+    if ( invalid_address_count ) {
+        if( !quiet )
+            fprintf( stderr, "Total of 0x%X bytes in invalid addressed.\n",
+                    invalid_address_count );
+    }
+
+    retval = invalid_address_count;
+
+error:
+    if( NULL != fp ) {
+        fclose( fp );
+        fp = NULL;
+    }
+
+    return retval;
+}
+
 // ___ CONVERT TO INTEL HEX __________________________
+static const char ihex_hex_digits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+static inline char *ihex_put_byte( char *str, uint8_t value ) {
+    *str++ = ihex_hex_digits[value >> 4];
+    *str++ = ihex_hex_digits[value & 0x0f];
+    return str;
+}
+
 static void ihex_clear_record( struct intel_record *record, uint32_t address ) {
     record->count = 0;
-    record->address = ((uint16_t) (address % 0xffff));
+    record->address = ((uint16_t) (address & 0xffff));
     record->type = 0;
     record->data[0] = 0;
     record->checksum = 0;
@@ -408,156 +621,273 @@ static int32_t ihex_make_checksum( struct intel_record *record ) {
 }
 
 static int32_t ihex_make_line( struct intel_record *record, char *str ) {
+    char *pos = str;
     uint8_t i;
     if( record->type > 5 ) {
         DEBUG( "Record type 0x%X unknown.\n", record->type );
         return -1;
-    } else if( record->count > IHEX_COLS ) {
-        DEBUG( "Each line must have no more than 16 values.\n" );
-        return -1;
     }
 
     if( record->count == 0 ) {
-        // if there is no data set the string to empty, return
-        *str = 0;
+        // if there is no data there is no line
         return 0;
     }
 
     ihex_make_checksum(record);          // make the checksum
 
-    sprintf( str, ":%02X%04X%02X",      // ':bbaaaarr'
-            record->count, record->address, record->type );
+    *pos++ = ':';                        // ':bbaaaarr'
+    pos = ihex_put_byte( pos, record->count );
+    pos = ihex_put_byte( pos, (uint8_t) (record->address >> 8) );
+    pos = ihex_put_byte( pos, (uint8_t) (0xff & record->address) );
+    pos = ihex_put_byte( pos, record->type );
 
     for ( i = 0; i < record->count; i++ ) {
-        sprintf( str + 9 + 2*i, "%02X", record->data[i] );
+        pos = ihex_put_byte( pos, record->data[i] );
     }
-    sprintf( str + 9 + 2*i, "%02X", record->checksum );
+    pos = ihex_put_byte( pos, record->checksum );
+    *pos++ = '\n';
 
-    return 0;
+    return (int32_t) (pos - str);
 }
 
-static int32_t ihex_make_record_04_offset( uint32_t offset, char *str ) {
-    struct intel_record record;
+static int32_t ihex_make_record_04_offset( uint32_t offset,
+                                           struct intel_record *record ) {
     if ( offset & 0xffff ) {
         DEBUG( "ihex 04 type offset must be divisible by 0x%X, not 0x%X.\n",
                 0x10000, offset );
         return -1;
     }
-    record.type = 4;
-    record.count = 2;
-    record.address = 0;
-    record.data[0] = (uint8_t) (0xff & (offset >> 24));
-    record.data[1] = (uint8_t) (0xff & (offset >> 16));
-    return ihex_make_line( &record, str );
-}
-
-//static int32_t ihex_process_record( struct intel_record *record,
-//        const uint8_t job, uint32_t next_address ) {
-//    char line[80];
-//    if( record->count ) {
-//        if( 0 != ihex_make_line(record, line) ) {
-//            DEBUG( "Error making a line.\n" );
-//            return -2;
-//        } else {
-//            ihex_clear_record( record, next_address );
-//        }
-//        if( job==0 ) {
-//            fprintf( stdout, "%s\n", line );
-//        }
-//    }
-//    return 0;
-//}
+    record->type = 4;
+    record->count = 2;
+    record->address = 0;
+    record->data[0] = (uint8_t) (0xff & (offset >> 24));
+    record->data[1] = (uint8_t) (0xff & (offset >> 16));
+    return 0;
+}
+
+static int32_t ihex_flush( struct ihex_writer *out ) {
+    if( out->used && out->used != fwrite(out->data, 1, out->used, out->fp) ) {
+        DEBUG( "Error writing 0x%X bytes of hex output.\n",
+               (unsigned int) out->used );
+        out->used = 0;
+        return -1;
+    }
+    out->used = 0;
+    return 0;
+}
+
+static int32_t ihex_reserve( struct ihex_writer *out, size_t length ) {
+    if( sizeof(out->data) - out->used < length ) {
+        return ihex_flush( out );
+    }
+    return 0;
+}
+
+static int32_t ihex_write_record( struct ihex_writer *out,
+                                  struct intel_record *record ) {
+    int32_t length;
+
+    if( 0 != ihex_reserve(out, IHEX_MAX_LINE_LENGTH) ) {
+        return -1;
+    }
+
+    length = ihex_make_line( record, &out->data[out->used] );
+    if( length < 0 ) {
+        return -1;
+    }
+    out->used += (size_t) length;
+    return 0;
+}
 
 int32_t intel_hex_from_buffer( intel_buffer_in_t *buin,
-                               bool force_full, uint32_t target_offset ) {
-    char line[80];
-    uint32_t offset_address = 0;    // offset address written to a previous line
+                               bool force_full, uint32_t target_offset,
+                               uint8_t record_width, bool minimal_04 ) {
+    intel_hex_stream_t *stream;
+    int32_t retval;
+    int32_t result;
+
+    stream = intel_hex_stream_open( force_full, target_offset, record_width,
+                                    minimal_04 );
+    if( NULL == stream ) {
+        return -1;
+    }
+
+    retval = intel_hex_stream_write( stream, buin, buin->info.data_end );
+    result = intel_hex_stream_close( stream );
+
+    return (0 != retval) ? retval : result;
+}
+
+intel_hex_stream_t *intel_hex_stream_open( bool force_full,
+        uint32_t target_offset, uint8_t record_width, bool minimal_04 ) {
+    intel_hex_stream_t *stream;
+
+    stream = (intel_hex_stream_t *) malloc( sizeof(intel_hex_stream_t) );
+    if( NULL == stream ) {
+        DEBUG( "ERROR: allocating the hex writer.\n" );
+        return NULL;
+    }
+
+    stream->out.fp = stdout;
+    stream->out.used = 0;
+    ihex_clear_record( &stream->record, 0 );
+    stream->offset_address = 0;
+    stream->next = UINT32_MAX;
+    stream->target_offset = target_offset;
+    stream->record_width = (0 == record_width) ? IHEX_COLS : record_width;
+    stream->force_full = force_full;
+    stream->minimal_04 = minimal_04;
+    stream->failed = false;
+
+    return stream;
+}
+
+int32_t intel_hex_stream_write( intel_hex_stream_t *stream,
+                                intel_buffer_in_t *buin, uint32_t end ) {
+    struct intel_record *record = &stream->record;
+    struct intel_record record_04;
     uint32_t address = 0;   // relative offset from previously set addr
-    uint32_t i = buin->info.data_start;
-    uint16_t i_scan;
-    struct intel_record record;
+    uint32_t i;
 
-    ihex_clear_record( &record, i + target_offset );
+    if( stream->failed ) {
+        return -2;
+    }
 
     // target_offset = 0x8000 0000 or 0x8080 0000
-    // use buin->info.data_start to buin->info.data_stop as range
+    // use buin->info.data_start to end as range, continuing from the
+    // previous call
     // if target offset > page size, use process 04
     // reasons to complete current line:
-    //      last value, next page blank, last page value, #cols reached
-
-    for( i = buin->info.data_start; i <= buin->info.data_end; i++ ) {
-        address = i + target_offset;
-        if( i % buin->info.page_size == 0 && !(force_full) ) {
+    //      last value, next page blank, last page value, #cols reached,
+    //      64kb boundary reached (unless minimal_04 is set)
+    // buin->data may be a window starting at buin->base, bytes before it
+    // are only asked for with force_full and are blank
+
+    i = (UINT32_MAX == stream->next) ? buin->info.data_start : stream->next;
+    for( ; i <= end; i++ ) {
+        address = i + stream->target_offset;
+        if( i % buin->info.page_size == 0 && !(stream->force_full) ) {
             /* you are at the start of a memory page, if force_full is not set
              * then check if there is any data on the page, if there is none,
              * then write current line and increment to the next page
              */
-            for( i_scan = 0; i_scan < buin->info.page_size; i_scan++ ) {
-                if( buin->data[i + i_scan] != 0xFF )
-                    break;
-            }
-            if( i_scan == buin->info.page_size ) {
+            if( buin->info.page_size ==
+                    intel_find_data(&buin->data[i - buin->base],
+                                    buin->info.page_size) ) {
                 // no data found: write current, jump to next page
-                if( 0 != ihex_make_line(&record, line) ) {
+                if( 0 != ihex_write_record(&stream->out, record) ) {
                     DEBUG( "Error making a line.\n" );
-                    return -2;
-                } else {
-                    if( *line )
-                        fprintf( stdout, "%s\n", line );
-                    ihex_clear_record( &record, address + i_scan - offset_address );
+                    goto error;
                 }
+                ihex_clear_record( record, 0 );
                 i += buin->info.page_size - 1;
                 continue;
             }
         }
-        if( address - offset_address >= 0x10000 ) {
-            offset_address = (address / IHEX_64KB_PAGE) * IHEX_64KB_PAGE;
+        if( record->count == stream->record_width ||
+                (!stream->minimal_04 &&
+                 address - stream->offset_address >= IHEX_64KB_PAGE) ) {
             // complete the line, before adding this next point
-
-            if( 0 != ihex_make_line(&record, line) ) {
+            if( 0 != ihex_write_record(&stream->out, record) ) {
                 DEBUG( "Error making a line.\n" );
-                return -2;
-            } else {
-                if( *line )
-                    fprintf( stdout, "%s\n", line );
-                ihex_clear_record( &record, address - offset_address );
-            }
-
-            // reset offset address
-            if( 0 != ihex_make_record_04_offset(offset_address, line) ) {
-                DEBUG( "Error making a class 4 offset.\n" );
-                return -2;
-            } else {
-                if( *line )
-                    fprintf( stdout, "%s\n", line );
+                goto error;
             }
+            ihex_clear_record( record, 0 );
         }
-        if( record.count == IHEX_COLS ) {
-            if( 0 != ihex_make_line(&record, line) ) {
-                DEBUG( "Error making a line.\n" );
-                return -2;
-            } else {
-                if( *line )
-                    fprintf( stdout, "%s\n", line );
-                ihex_clear_record( &record, address - offset_address );
+        if( 0 == record->count ) {
+            if( address - stream->offset_address >= IHEX_64KB_PAGE ) {
+                // the record starts outside the current 64kb segment
+                stream->offset_address =
+                    (address / IHEX_64KB_PAGE) * IHEX_64KB_PAGE;
+                if( 0 != ihex_make_record_04_offset(stream->offset_address,
+                                                    &record_04)
+                        || 0 != ihex_write_record(&stream->out, &record_04) ) {
+                    DEBUG( "Error making a class 4 offset.\n" );
+                    goto error;
+                }
             }
+            record->address = (uint16_t) (address - stream->offset_address);
         }
-        record.data[ record.count ] = buin->data[i];
-        record.count ++;
+        record->data[ record->count ] = (i < buin->base) ?
+            UINT8_MAX : buin->data[i - buin->base];
+        record->count ++;
     }
-    if( record.count ) {
-        if( 0 != ihex_make_line(&record, line) ) {
-            DEBUG( "Error making a line.\n" );
-            return -2;
-        } else {
-            if( *line )
-                fprintf( stdout, "%s\n", line );
-            ihex_clear_record( &record, address - offset_address );
-        }
+    stream->next = i;
+    return 0;
+
+error:
+    stream->failed = true;
+    return -2;
+}
+
+int32_t intel_hex_stream_close( intel_hex_stream_t *stream ) {
+    int32_t retval = 0;
+
+    if( stream->failed ) {
+        // only send what was made before the error
+    } else if( stream->record.count &&
+            0 != ihex_write_record(&stream->out, &stream->record) ) {
+        DEBUG( "Error making a line.\n" );
+        retval = -2;
+    } else if( 0 != ihex_reserve(&stream->out, sizeof(IHEX_EOF_RECORD) - 1) ) {
+        retval = -3;
+    } else {
+        // ihex_make_line skips empty records, so the EOF record is added as is
+        memcpy( &stream->out.data[stream->out.used], IHEX_EOF_RECORD,
+                sizeof(IHEX_EOF_RECORD) - 1 );
+        stream->out.used += sizeof(IHEX_EOF_RECORD) - 1;
+    }
+
+    if( (0 != ihex_flush(&stream->out) || 0 != fflush(stream->out.fp))
+            && 0 == retval ) {
+        retval = -3;
     }
-    fprintf( stdout, ":00000001FF\n" );
+    free( stream );
+
+    return retval;
+}
+
+int32_t intel_bin_from_buffer( intel_buffer_in_t *buin ) {
+    size_t length = (size_t) buin->info.data_end + 1;
 
+    // anything already waiting in stdout goes first
+    if( 0 != fflush(stdout) ||
+            length != fwrite(buin->data, 1, length, stdout) ||
+            0 != fflush(stdout) ) {
+        DEBUG( "Error writing 0x%X bytes of binary output.\n", (uint32_t) length );
+        return -1;
+    }
+    return 0;
+}
+
+int32_t intel_bin_from_buffer_out( intel_buffer_out_t *bout, uint32_t end ) {
+    uint8_t chunk[IHEX_BIN_CHUNK_SIZE];
+    size_t length = (size_t) end + 1;
+    size_t count;
+    size_t i;
+    size_t j;
+
+    if( 0 != fflush(stdout) ) {
+        goto error;
+    }
+    for( i = 0; i < length; i += count ) {
+        count = (length - i < sizeof(chunk)) ? length - i : sizeof(chunk);
+        for( j = 0; j < count; j++ ) {
+            uint16_t value = bout->data[i + j];
+            chunk[j] = (uint8_t) ((value > UINT8_MAX) ? 0xff : value);
+        }
+        if( count != fwrite(chunk, 1, count, stdout) ) {
+            goto error;
+        }
+    }
+    if( 0 != fflush(stdout) ) {
+        goto error;
+    }
     return 0;
+
+error:
+    DEBUG( "Error writing 0x%X bytes of binary output.\n", (uint32_t) length );
+    return -1;
 }
 
 int32_t intel_init_buffer_out( intel_buffer_out_t *bout,
@@ -603,6 +933,7 @@ int32_t intel_init_buffer_in( intel_buffer_in_t *buin,
     buin->info.valid_end = total_size - 1;
     buin->info.block_start = 0;
     buin->info.block_end = 0;
+    buin->base = 0;
 
     buin->data = (uint8_t *) malloc( total_size );
     if( NULL == buin->data ) {
@@ -616,10 +947,124 @@ int32_t intel_init_buffer_in( intel_buffer_in_t *buin,
     return 0;
 }
 
+static inline uint64_t ihex_lanes_nonzero( uint64_t lanes ) {
+    // each lane holds at most 0xFF, so adding 0xFF carries into bit 8 only
+    // when the lane is nonzero and never into the next lane
+    return ((lanes + IHEX_LANES_LOW) & IHEX_LANES_CARRY) >> 8;
+}
+
+static inline int32_t ihex_lanes_count( uint64_t lanes ) {
+    return (int32_t) ((lanes * IHEX_LANES_ONE) >> 48);
+}
+
+static inline bool intel_validate_byte( const intel_buffer_in_t *buin,
+                                        const intel_buffer_out_t *bout,
+                                        int32_t i ) {
+    return (bout->data[i] <= UINT8_MAX) ?
+        ((uint8_t) bout->data[i]) == buin->data[i] : 0xff == buin->data[i];
+}
+
+static inline uint64_t intel_validate_word( const intel_buffer_in_t *buin,
+                                            const intel_buffer_out_t *bout,
+                                            int32_t i, uint64_t *blank ) {
+    uint64_t image;
+    uint64_t read;
+    uint32_t bytes;
+
+    // both loads keep entry k in lane k whatever the host byte order
+    memcpy( &image, &bout->data[i], sizeof(image) );
+    memcpy( &bytes, &buin->data[i], sizeof(bytes) );
+    read = bytes;
+    read = (read | (read << 16)) & IHEX_LANES_HALF;
+    read = (read | (read << 8)) & IHEX_LANES_LOW;
+
+    // a lane with a nonzero high byte is unassigned and must read 0xff
+    *blank = ihex_lanes_nonzero( (image >> 8) & IHEX_LANES_LOW );
+    return ((image | (*blank * 0xff)) & IHEX_LANES_LOW) ^ read;
+}
+
+static void intel_validate_report( const intel_buffer_in_t *buin,
+                                   const intel_buffer_out_t *bout,
+                                   int32_t start, int32_t end ) {
+    int32_t i;
+
+    for( i = start; i <= end; i++ ) {
+        if( intel_validate_byte(buin, bout, i) ) {
+            continue;
+        }
+        if( bout->data[i] <= UINT8_MAX ) {
+            DEBUG( "Image did not validate at byte: 0x%X of 0x%X.\n", i,
+                    bout->info.valid_end - bout->info.valid_start + 1 );
+            DEBUG( "Wanted 0x%02x but read 0x%02x.\n",
+                    0xff & bout->data[i], buin->data[i] );
+        } else {
+            DEBUG( "Outside program region: byte 0x%X expected 0xFF.\n", i );
+            DEBUG( "but read 0x%02X.\n", buin->data[i] );
+        }
+        return;
+    }
+}
+
+static void intel_validate_page( const intel_buffer_in_t *buin,
+                                 const intel_buffer_out_t *bout,
+                                 int32_t start, int32_t end,
+                                 int32_t *invalid_data_region,
+                                 int32_t *invalid_outside_data_region ) {
+    bool reported = false;
+    int32_t i;
+
+    for( i = start; i + IHEX_VALIDATE_BLOCK - 1 <= end;
+            i += IHEX_VALIDATE_BLOCK ) {
+        uint64_t any = 0;
+        uint64_t blank;
+        int32_t j;
+
+        // the common case: the whole block matches, no branches per word
+        for( j = i; j < i + IHEX_VALIDATE_BLOCK; j += 4 ) {
+            any |= intel_validate_word( buin, bout, j, &blank );
+        }
+        if( 0 == any ) {
+            continue;
+        }
+
+        for( j = i; j < i + IHEX_VALIDATE_BLOCK; j += 4 ) {
+            uint64_t wrong = intel_validate_word( buin, bout, j, &blank );
+
+            if( 0 == wrong ) {
+                continue;
+            }
+            wrong = ihex_lanes_nonzero( wrong );
+            *invalid_data_region += ihex_lanes_count( wrong & ~blank );
+            *invalid_outside_data_region += ihex_lanes_count( wrong & blank );
+            if( !reported ) {
+                intel_validate_report( buin, bout, j, j + 3 );
+                reported = true;
+            }
+        }
+    }
+
+    for( ; i <= end; i++ ) {
+        if( intel_validate_byte(buin, bout, i) ) {
+            continue;
+        }
+        if( bout->data[i] <= UINT8_MAX ) {
+            (*invalid_data_region)++;
+        } else {
+            (*invalid_outside_data_region)++;
+        }
+        if( !reported ) {
+            intel_validate_report( buin, bout, i, i );
+            reported = true;
+        }
+    }
+}
+
 int32_t intel_validate_buffer( intel_buffer_in_t *buin,
                                intel_buffer_out_t *bout,
                                bool quiet) {
-    int32_t i;
+    int32_t page_size = (int32_t) bout->info.page_size;
+    int32_t start;
+    int32_t end;
     int32_t invalid_data_region = 0;
     int32_t invalid_outside_data_region = 0;
 
@@ -627,37 +1072,29 @@ int32_t intel_validate_buffer( intel_buffer_in_t *buin,
             bout->info.valid_start, bout->info.valid_end );
 
     if( !quiet ) fprintf( stderr, "Validating...  " );
-    for( i = bout->info.valid_start; i <= bout->info.valid_end; i++ ) {
-        if(  bout->data[i] <= UINT8_MAX ) {
-            // Memory should have been programmed here
-            if( ((uint8_t) bout->data[i]) != buin->data[i] ) {
-                if ( !invalid_data_region ) {
-                    if( !quiet ) fprintf( stderr, "ERROR\n" );
-                    DEBUG( "Image did not validate at byte: 0x%X of 0x%X.\n", i,
-                            bout->info.valid_end - bout->info.valid_start + 1 );
-                    DEBUG( "Wanted 0x%02x but read 0x%02x.\n",
-                            0xff & bout->data[i], buin->data[i] );
-                    DEBUG( "suppressing additional warnings.\n");
-                }
-                invalid_data_region++;
-            }
-        } else {
-            // Memory should be blank here
-            if( 0xff != buin->data[i] ) {
-                if ( !invalid_data_region ) {
-                    DEBUG( "Outside program region: byte 0x%X expected 0xFF.\n", i);
-                    DEBUG( "but read 0x%02X.  suppressing additional warnings.\n",
-                            buin->data[i] );
-                }
-                invalid_outside_data_region++;
-            }
+    if( page_size <= 0 ) {
+        page_size = (int32_t) bout->info.total_size;
+    }
+
+    // compare a page at a time so the first mismatch of each can be reported
+    for( start = bout->info.valid_start;
+            start <= (int32_t) bout->info.valid_end; start = end + 1 ) {
+        end = start - (start % page_size) + page_size - 1;
+        if( end > (int32_t) bout->info.valid_end ) {
+            end = bout->info.valid_end;
         }
+        intel_validate_page( buin, bout, start, end,
+                             &invalid_data_region,
+                             &invalid_outside_data_region );
     }
 
     if( !quiet ) {
         if ( 0 == invalid_data_region + invalid_outside_data_region ) {
             fprintf( stderr, "Success\n" );
         } else {
+            if( invalid_data_region ) {
+                fprintf( stderr, "ERROR\n" );
+            }
             fprintf( stderr,
                     "%d invalid bytes in program region, %d outside region.\n",
                     invalid_data_region, invalid_outside_data_region );
@@ -668,23 +1105,157 @@ int32_t intel_validate_buffer( intel_buffer_in_t *buin,
         -1 * invalid_data_region : invalid_outside_data_region;
 }
 
+size_t intel_find_data( const uint8_t *data, size_t length ) {
+    size_t i = 0;
+
+    // skip whole blocks of blank bytes, 0xff in every byte is ~0 per word
+    for( ; i + IHEX_SCAN_BLOCK <= length; i += IHEX_SCAN_BLOCK ) {
+        uint64_t word[IHEX_SCAN_BLOCK / sizeof(uint64_t)];
+
+        memcpy( word, &data[i], sizeof(word) );
+        if( UINT64_MAX != (word[0] & word[1] & word[2] & word[3]) ) {
+            break;
+        }
+    }
+    for( ; i < length; i++ ) {
+        if( 0xff != data[i] ) {
+            break;
+        }
+    }
+    return i;
+}
+
+size_t intel_find_data_last( const uint8_t *data, size_t length ) {
+    size_t i = length;
+
+    for( ; i >= IHEX_SCAN_BLOCK; i -= IHEX_SCAN_BLOCK ) {
+        uint64_t word[IHEX_SCAN_BLOCK / sizeof(uint64_t)];
+
+        memcpy( word, &data[i - IHEX_SCAN_BLOCK], sizeof(word) );
+        if( UINT64_MAX != (word[0] & word[1] & word[2] & word[3]) ) {
+            break;
+        }
+    }
+    while( i-- > 0 ) {
+        if( 0xff != data[i] ) {
+            return i;
+        }
+    }
+    return length;
+}
+
+static inline uint64_t ihex_lanes_assigned( const uint16_t *data ) {
+    uint64_t image;
+
+    // an entry is assigned when its high byte is zero
+    memcpy( &image, data, sizeof(image) );
+    return ihex_lanes_nonzero( (image >> 8) & IHEX_LANES_LOW ) ^ IHEX_LANES_ONE;
+}
+
+size_t intel_find_assigned( const uint16_t *data, size_t length ) {
+    size_t i = 0;
+
+    for( ; i + IHEX_SCAN_BLOCK / 2 <= length; i += IHEX_SCAN_BLOCK / 2 ) {
+        if( 0 != (ihex_lanes_assigned(&data[i]) |
+                  ihex_lanes_assigned(&data[i + 4]) |
+                  ihex_lanes_assigned(&data[i + 8]) |
+                  ihex_lanes_assigned(&data[i + 12])) ) {
+            break;
+        }
+    }
+    for( ; i < length; i++ ) {
+        if( data[i] <= UINT8_MAX ) {
+            break;
+        }
+    }
+    return i;
+}
+
+size_t intel_find_assigned_last( const uint16_t *data, size_t length ) {
+    size_t i = length;
+
+    for( ; i >= IHEX_SCAN_BLOCK / 2; i -= IHEX_SCAN_BLOCK / 2 ) {
+        const uint16_t *block = &data[i - IHEX_SCAN_BLOCK / 2];
+
+        if( 0 != (ihex_lanes_assigned(&block[0]) |
+                  ihex_lanes_assigned(&block[4]) |
+                  ihex_lanes_assigned(&block[8]) |
+                  ihex_lanes_assigned(&block[12])) ) {
+            break;
+        }
+    }
+    while( i-- > 0 ) {
+        if( data[i] <= UINT8_MAX ) {
+            return i;
+        }
+    }
+    return length;
+}
+
+int32_t intel_merge_buffer( intel_buffer_out_t *bout,
+                            const intel_buffer_out_t *image,
+                            bool overwrite, uint32_t *overlap ) {
+    size_t i;
+    size_t end;
+    int32_t replaced = 0;
+
+    if( image->info.total_size != bout->info.total_size ) {
+        DEBUG( "Merged images must have the same size.\n" );
+        return -2;
+    }
+    if( UINT32_MAX == image->info.data_start ) {
+        return 0;   // nothing assigned
+    }
+
+    end = image->info.data_end + 1;
+    for( i = image->info.data_start; i < end; i++ ) {
+        i += intel_find_assigned( &image->data[i], end - i );
+        if( i == end ) {
+            break;
+        }
+        if( bout->data[i] <= UINT8_MAX ) {
+            if( !overwrite ) {
+                *overlap = (uint32_t) i;
+                return -1;
+            }
+            replaced++;
+        }
+        bout->data[i] = image->data[i];
+    }
+
+    if( image->info.data_start < bout->info.data_start ) {
+        bout->info.data_start = image->info.data_start;
+    }
+    if( image->info.data_end > bout->info.data_end ) {
+        bout->info.data_end = image->info.data_end;
+    }
+
+    return replaced;
+}
+
 int32_t intel_flash_prep_buffer( intel_buffer_out_t *bout ) {
+    TRACE( "%s( %p )\n", __FUNCTION__, bout );
+
+    if( 0 == bout->info.valid_end ) {
+        return 0;
+    }
+    return intel_flash_prep_pages( bout, 0, bout->info.valid_end - 1 );
+}
+
+int32_t intel_flash_prep_pages( intel_buffer_out_t *bout,
+                                uint32_t start, uint32_t end ) {
     uint16_t *page;
     int32_t i;
 
-    TRACE( "%s( %p )\n", __FUNCTION__, bout );
+    TRACE( "%s( %p, 0x%X, 0x%X )\n", __FUNCTION__, bout, start, end );
 
-    // increment pointer by page_size * sizeof(int16) until page_start >= end
-    for( page = bout->data;
-            page < &bout->data[bout->info.valid_end];
+    // increment pointer by page_size * sizeof(int16) until page_start > end
+    for( page = &bout->data[start - start % bout->info.page_size];
+            page <= &bout->data[end];
             page = &page[bout->info.page_size] ) {
         // check if there is valid data on this page
-        for( i = 0; i < bout->info.page_size; i++ ) {
-            if( page[i] <= UINT8_MAX )
-                break;
-        }
-
-        if( bout->info.page_size != i ) {
+        if( bout->info.page_size !=
+                intel_find_assigned(page, bout->info.page_size) ) {
             /* There was valid data in the block & we need to make
              * sure there is no unassigned data.  */
             for( i = 0; i < bout->info.page_size; i++ ) {
@@ -47,6 +47,8 @@ typedef struct {
 typedef struct {
     intel_buffer_info_t info;
     uint8_t *data;
+    uint32_t base;              // the addr of data[0], 0 unless only a window
+                                // of the memory is held
 } intel_buffer_in_t;
 
 
@@ -64,7 +66,9 @@ int32_t intel_process_data( intel_buffer_out_t *bout,
 int32_t intel_hex_to_buffer( char *filename, intel_buffer_out_t *bout,
         uint32_t target_offset, bool quiet );
 /*  Used to read in a file in intel hex format and return a chunk of
- *  memory containing the memory image described in the file.
+ *  memory containing the memory image described in the file.  Files that
+ *  start with an 'S' are read as Motorola S-records and ELF executables are
+ *  loaded with elf_to_buffer instead.
  *
  *  \param filename the name of the intel hex file to process
  *  \param target_offset is the flash memory address location of buffer[0]
@@ -90,11 +94,76 @@ int32_t intel_hex_to_buffer( char *filename, intel_buffer_out_t *bout,
  *              data_start field in intel_buffer_out_t
  */
 
+typedef int32_t (*intel_record_hook_t)( void *context,
+        intel_buffer_out_t *bout, uint32_t address, uint32_t length );
+/* called with the buffer address and byte count of each intel hex data
+ * record that starts inside the buffer, before it is stored.  a non-zero
+ * return stops reading the file
+ */
+
+int32_t intel_hex_stream_to_buffer( char *filename, intel_buffer_out_t *bout,
+        uint32_t target_offset, bool quiet,
+        intel_record_hook_t hook, void *context );
+/*  the same as intel_hex_to_buffer, calling hook for each data record as it
+ *  is read so the caller can use the part of the image that is complete,
+ *  eg to start programming while the rest of STDIN is still arriving.  the
+ *  other formats are read whole without calling hook.  returns -6 if hook
+ *  stopped the read.
+ */
+
+int32_t intel_bin_to_buffer( char *filename, intel_buffer_out_t *bout,
+        uint32_t target_offset, uint32_t bin_offset, bool quiet );
+/*  Used to read a raw binary file into bout.  The first byte of the file is
+ *  placed at address bin_offset, target_offset is the address of buffer[0].
+ *  "STDIN" reads from stdin.  The return value is the same as for
+ *  intel_hex_to_buffer: 0 on success, the number of bytes outside the
+ *  buffer if positive, an error if negative.
+ */
+
+int32_t intel_bin_from_buffer( intel_buffer_in_t *buin );
+/*  Write buin->data from 0 to info.data_end to stdout as a raw binary.  The
+ *  image is passed to stdio in one call, which writes a block this size
+ *  straight from the buffer.  Returns 0 on success, -1 on a write error.
+ */
+
+int32_t intel_bin_from_buffer_out( intel_buffer_out_t *bout, uint32_t end );
+/*  Write bout->data from 0 to end to stdout as a raw binary, unassigned
+ *  values as 0xff.  The values are narrowed to bytes a chunk at a time.
+ *  Returns 0 on success, -1 on a write error.
+ */
+
 int32_t intel_hex_from_buffer( intel_buffer_in_t *buin,
-        bool force_full, uint32_t target_offset );
+        bool force_full, uint32_t target_offset,
+        uint8_t record_width, bool minimal_04 );
 /*  Used to convert a buffer to an intel hex formatted file.
  *  target offset is the address location of buffer 0
  *  force_full sets whether to keep writing entirely blank pages.
+ *  record_width is the number of data bytes per record (1 to 255), 0 selects
+ *  the default of 16.
+ *  minimal_04 lets a record run across a 64kb boundary, so an 04 record is
+ *  only written when a new record starts in a different 64kb segment.
+ */
+
+typedef struct intel_hex_stream intel_hex_stream_t;
+
+intel_hex_stream_t *intel_hex_stream_open( bool force_full,
+        uint32_t target_offset, uint8_t record_width, bool minimal_04 );
+/*  Start writing intel hex to stdout a part of the buffer at a time, with
+ *  the same options as intel_hex_from_buffer.  Returns NULL if the writer
+ *  could not be allocated.
+ */
+
+int32_t intel_hex_stream_write( intel_hex_stream_t *stream,
+        intel_buffer_in_t *buin, uint32_t end );
+/*  Write buin->data up to end, from info.data_start on the first call and
+ *  where the previous call stopped after that.  end must be the last byte
+ *  of a page unless it is the last call.  buin->data can hold only the
+ *  bytes from buin->base to end.  Returns 0 or -2 on error.
+ */
+
+int32_t intel_hex_stream_close( intel_hex_stream_t *stream );
+/*  Finish the last line, add the EOF record and free stream.
+ *  Returns 0, -2 or -3 on error.
  */
 
 int32_t intel_init_buffer_out(intel_buffer_out_t *bout,
@@ -124,6 +193,32 @@ int32_t intel_validate_buffer(  intel_buffer_in_t *buin,
  * not validate, negative number if bytes inside region that do not validate
  */
 
+size_t intel_find_data( const uint8_t *data, size_t length );
+/* return the index of the first byte of data that is not 0xFF (blank),
+ * or length if the whole range is blank.  blank runs are skipped a word
+ * at a time, so use this rather than a byte loop to find or skip pages.
+ */
+
+size_t intel_find_data_last( const uint8_t *data, size_t length );
+/* return the index of the last byte of data that is not 0xFF,
+ * or length if the whole range is blank
+ */
+
+size_t intel_find_assigned( const uint16_t *data, size_t length );
+size_t intel_find_assigned_last( const uint16_t *data, size_t length );
+/* the same for a buffer_out image: return the index of the first / last
+ * entry that holds data (is not unassigned), or length if there is none
+ */
+
+int32_t intel_merge_buffer( intel_buffer_out_t *bout,
+                            const intel_buffer_out_t *image,
+                            bool overwrite, uint32_t *overlap );
+/* copy the assigned data of image (of the same size) into bout.  if an
+ * address already has data in bout, its index is put in overlap and -1 is
+ * returned unless overwrite is set, then image replaces it.  otherwise the
+ * number of addresses that were replaced is returned, -2 if the sizes differ.
+ */
+
 int32_t intel_flash_prep_buffer( intel_buffer_out_t *bout );
 /* prepare the buffer so that valid data fills each page that contains data.
  * unassigned data in buffer is given a value of 0xff (blank memory)
@@ -131,6 +226,12 @@ int32_t intel_flash_prep_buffer( intel_buffer_out_t *bout );
  * return 0 on success, -1 if assigning data would extend flash above size
  */
 
+int32_t intel_flash_prep_pages( intel_buffer_out_t *bout,
+        uint32_t start, uint32_t end );
+/* intel_flash_prep_buffer for only the pages holding start to end, which
+ * are relative to bout->data.  returns 0
+ */
+
 
 #ifdef __cplusplus
 }
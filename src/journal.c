@@ -0,0 +1,193 @@
+/*
+ * dfu-programmer
+ *
+ * journal.c
+ *
+ * Records the blocks of an image that flash --journal has written, so a
+ * run that was cut off can carry on from the last one instead of erasing
+ * and writing everything again.
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "journal.h"
+#include "sha256.h"
+#include "util.h"
+
+#define JOURNAL_VERSION         1
+#define JOURNAL_HASH_CHUNK      0x1000
+
+#define JOURNAL_DEBUG_THRESHOLD 50
+#define JOURNAL_TRACE_THRESHOLD 55
+
+#define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               JOURNAL_DEBUG_THRESHOLD, __VA_ARGS__ )
+#define TRACE(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               JOURNAL_TRACE_THRESHOLD, __VA_ARGS__ )
+
+// ________  P R O T O T Y P E S  _______________________________
+static void journal_digest( const char *target, const intel_buffer_out_t *bout,
+        uint8_t digest[SHA256_DIGEST_SIZE] );
+/* SHA-256 of the target name and the image, a blank byte (unassigned) is
+ * told apart from an 0xFF one
+ */
+
+
+// ________  F U N C T I O N S  _______________________________
+static void journal_digest( const char *target, const intel_buffer_out_t *bout,
+        uint8_t digest[SHA256_DIGEST_SIZE] ) {
+    sha256_context_t ctx;
+    uint8_t chunk[2 * JOURNAL_HASH_CHUNK];
+    size_t used = 0;
+    size_t i;
+
+    sha256_init( &ctx );
+    sha256_update( &ctx, (const uint8_t *) target, strlen(target) + 1 );
+    for( i = 0; i < bout->info.total_size; i++ ) {
+        chunk[used++] = (bout->data[i] > UINT8_MAX) ? 0 : 1;
+        chunk[used++] = (uint8_t) bout->data[i];
+        if( sizeof(chunk) == used ) {
+            sha256_update( &ctx, chunk, used );
+            used = 0;
+        }
+    }
+    sha256_update( &ctx, chunk, used );
+    sha256_final( &ctx, digest );
+}
+
+int32_t journal_open( flash_journal_t *journal, const char *path,
+                      const char *target, const intel_buffer_out_t *bout ) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    char line[sizeof(journal->header)];
+    char *end;
+    unsigned long start;
+    unsigned long last;
+    size_t length;
+    FILE *fp;
+    int i;
+
+    TRACE( "%s( %p, %s, %s, %p )\n", __FUNCTION__, journal, path, target,
+           bout );
+
+    memset( journal, 0, sizeof(*journal) );
+    journal->path = path;
+
+    journal_digest( target, bout, digest );
+    length = (size_t) snprintf( journal->header, sizeof(journal->header),
+                                "dfu-programmer journal %d %.40s ",
+                                JOURNAL_VERSION, target );
+    for( i = 0; i < SHA256_DIGEST_SIZE; i++ ) {
+        length += (size_t) snprintf( &journal->header[length],
+                                     sizeof(journal->header) - length,
+                                     "%02x", digest[i] );
+    }
+    snprintf( &journal->header[length], sizeof(journal->header) - length,
+              "\n" );
+
+    fp = fopen( path, "r" );
+    if( NULL == fp ) {
+        if( ENOENT == errno ) {
+            return 0;
+        }
+        fprintf( stderr, "Unable to read the journal %s.\n", path );
+        return -1;
+    }
+
+    if( NULL == fgets(line, sizeof(line), fp) ||
+            0 != strcmp(line, journal->header) ) {
+        DEBUG( "The journal is for another target or image.\n" );
+        fclose( fp );
+        return 0;
+    }
+
+    // the blocks were written in order, a line out of it is not used
+    while( NULL != fgets(line, sizeof(line), fp) ) {
+        length = strlen( line );
+        journal->torn = (0 == length || '\n' != line[length - 1]);
+        start = strtoul( line, &end, 16 );
+        if( end == line || ' ' != *end ) {
+            continue;
+        }
+        last = strtoul( end + 1, &end, 16 );
+        if( '\n' != *end || start > last || last >= bout->info.total_size ||
+                (journal->resume && start <= journal->last_end) ) {
+            DEBUG( "Skipping the journal line %s", line );
+            continue;
+        }
+        journal->resume = true;
+        journal->last_start = (uint32_t) start;
+        journal->last_end = (uint32_t) last;
+    }
+    fclose( fp );
+
+    return 0;
+}
+
+int32_t journal_begin( flash_journal_t *journal, bool resume ) {
+    TRACE( "%s( %p, %s )\n", __FUNCTION__, journal,
+           resume ? "true" : "false" );
+
+    journal->fp = fopen( journal->path, resume ? "a" : "w" );
+    if( NULL == journal->fp ) {
+        fprintf( stderr, "Unable to write the journal %s.\n", journal->path );
+        return -1;
+    }
+
+    if( resume ) {
+        // a line cut off by the stop is ended so the next one reads
+        if( journal->torn ) {
+            fputc( '\n', journal->fp );
+        }
+    } else {
+        fputs( journal->header, journal->fp );
+    }
+    if( 0 != fflush(journal->fp) ) {
+        fprintf( stderr, "Unable to write the journal %s.\n", journal->path );
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t journal_block( flash_journal_t *journal, uint32_t start,
+                       uint32_t end ) {
+    TRACE( "%s( %p, 0x%X, 0x%X )\n", __FUNCTION__, journal, start, end );
+
+    if( fprintf(journal->fp, "0x%X 0x%X\n", start, end) < 0 ||
+            0 != fflush(journal->fp) ) {
+        fprintf( stderr, "Unable to write the journal %s.\n", journal->path );
+        return -1;
+    }
+
+    return 0;
+}
+
+void journal_close( flash_journal_t *journal, bool finished ) {
+    if( NULL != journal->fp ) {
+        fclose( journal->fp );
+        journal->fp = NULL;
+    }
+    if( finished && NULL != journal->path ) {
+        remove( journal->path );
+    }
+}
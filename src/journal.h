@@ -0,0 +1,82 @@
+/*
+ * dfu-programmer
+ *
+ * journal.h
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "intel_hex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* flash --journal writes the image in blocks of this size (rounded up to
+ * whole pages) and records each one once it has been written
+ */
+#define JOURNAL_BLOCK_SIZE      0x2000
+
+/* a journal file is a line naming the target and the SHA-256 of the image,
+ * followed by a line "0xSTART 0xEND" for every block written, in order
+ */
+typedef struct {
+    const char *path;
+    FILE *fp;
+    char header[128];           // the first line, for this target and image
+    bool resume;                // the file holds blocks of the same image
+    bool torn;                  // its last line was cut short
+    uint32_t last_start;        // the last block it holds, if resume
+    uint32_t last_end;
+} flash_journal_t;
+
+int32_t journal_open( flash_journal_t *journal, const char *path,
+                      const char *target, const intel_buffer_out_t *bout );
+/* hash target and the prepared image in bout and read the journal at path,
+ * if there is one.  resume is set when it is for the same target and image
+ * and holds at least one block, lines that do not read are skipped.
+ * returns 0, or -1 if the file is there but can not be read
+ */
+
+int32_t journal_begin( flash_journal_t *journal, bool resume );
+/* open the journal for writing blocks, appending to the blocks it holds to
+ * resume, otherwise starting it again with only the header.
+ * returns 0, or -1 if it can not be written
+ */
+
+int32_t journal_block( flash_journal_t *journal, uint32_t start,
+                       uint32_t end );
+/* record that start to end (inclusive) has been written.  the line is
+ * flushed before it returns, so it survives the process being stopped.
+ * returns 0, or -1 if it can not be written
+ */
+
+void journal_close( flash_journal_t *journal, bool finished );
+/* close the journal, removing the file once the image is finished */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
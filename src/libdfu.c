@@ -19,6 +19,7 @@
  */
 
 #include <libusb-1.0/libusb.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
@@ -27,7 +28,11 @@
 #include "arguments.h"
 #include "commands.h"
 #include "atmel.h"
+#include "image_cache.h"
 #include "libdfu.h"
+#include "report.h"
+#include "serve.h"
+#include "util.h"
 #include "config.h"
 
 // NOTE: Technically not thread safe... but since it's not changed when used as a library, it's safe.
@@ -35,19 +40,283 @@ int debug;
 
 static const char *progname = PACKAGE;
 
+/* what a served job needs, libusb stays initialized between jobs */
+typedef struct {
+    libusb_context *usbContext;
+    struct serve_arguments *serve;
+} serve_state_t;
+
+/* a device kept open for the in-memory calls */
+struct dfu_programmer_handle {
+    libusb_context *usbContext;
+    dfu_device_t device;
+    struct programmer_arguments args;
+};
+
+static libusb_context *open_libusb(void);
+/* initialize libusb with the debug level, NULL if it can not be */
+
+static int run_session(libusb_context *usbContext,
+                       struct programmer_arguments * args, size_t count,
+                       double *opened);
+/* open the device for args[0] and run count commands on it.  opened is
+ * set to the dfu_time the device was ready at, 0 if it never was
+ */
+
+static int32_t serve_job(void *context, int argc, char **argv,
+                         serve_timing_t *timing);
+/* parse and run one job of the server */
+
+static int open_device(libusb_context *usbContext,
+                       struct programmer_arguments * args,
+                       dfu_device_t *dfu_device);
+/* find and open the device args is for, returns SUCCESS or
+ * DEVICE_ACCESS_ERROR
+ */
+
+static int close_device(dfu_device_t *dfu_device,
+                        struct programmer_arguments * args, int retval);
+/* release and close the device after the command args, returns retval or
+ * DEVICE_ACCESS_ERROR if the interface could not be released
+ */
+
+static bool runs_without_device(const struct programmer_arguments * args);
+/* whether args is a command that needs no device, compile or a flash --plan
+ */
+
+static bool runs_without_device(const struct programmer_arguments * args)
+{
+    if (com_compile == args->command)
+    {
+        return true;
+    }
+    return (com_flash == args->command || com_eflash == args->command ||
+            com_user == args->command) && args->com_flash_data.plan;
+}
+
 int dfu_programmer(struct programmer_arguments * args)
 {
-    int retval = SUCCESS;
-    dfu_device_t dfu_device;
-    struct libusb_device *device = NULL;
+    int retval;
+
+    if (runs_without_device(args))
+    {
+        if (args->json)
+        {
+            report_start();
+        }
+        if (com_compile == args->command)
+        {
+            report_phase("compile");
+            retval = execute_compile(args);
+        }
+        else
+        {
+            report_phase("plan");
+            retval = execute_plan(args);
+        }
+        report_finish(stderr, retval);
+        return retval;
+    }
+
+    return dfu_programmer_session(args, 1);
+}
+
+int dfu_programmer_session(struct programmer_arguments * args, size_t count)
+{
+    int retval;
     libusb_context *usbContext;
+    double opened;
+
+    if (0 == count)
+    {
+        return SUCCESS;
+    }
+
+    usbContext = open_libusb();
+    if (NULL == usbContext)
+    {
+        return DEVICE_ACCESS_ERROR;
+    }
+
+    retval = run_session(usbContext, args, count, &opened);
+
+    libusb_exit(usbContext);
+
+    return retval;
+}
+
+int dfu_programmer_serve(struct serve_arguments * serve)
+{
+    int retval;
+    serve_state_t state;
+
+    state.serve = serve;
+    state.usbContext = open_libusb();
+    if (NULL == state.usbContext)
+    {
+        return DEVICE_ACCESS_ERROR;
+    }
+    image_cache_keep(serve->keep);
+
+    retval = serve_jobs(serve->socket, serve_job, &state, serve->quiet);
+
+    image_cache_keep(0);
+    libusb_exit(state.usbContext);
+
+    return retval;
+}
+
+void dfu_programmer_progress(progress_callback_t callback, void *context)
+{
+    progress_set_callback(callback, context);
+}
+
+dfu_programmer_handle_t *dfu_programmer_open(const char *target, bool quiet,
+                                             int *status)
+{
+    dfu_programmer_handle_t *handle;
+
+    handle = (dfu_programmer_handle_t *) calloc(1, sizeof(*handle));
+    if (NULL == handle)
+    {
+        *status = UNSPECIFIED_ERROR;
+        return NULL;
+    }
+
+    if (0 != parse_target(&handle->args, target))
+    {
+        fprintf(stderr, "Unsupported target '%s'.\n", target);
+        *status = ARGUMENT_ERROR;
+        goto error;
+    }
+    handle->args.quiet = quiet;
+
+    handle->usbContext = open_libusb();
+    if (NULL == handle->usbContext)
+    {
+        *status = DEVICE_ACCESS_ERROR;
+        goto error;
+    }
+
+    *status = open_device(handle->usbContext, &handle->args, &handle->device);
+    if (SUCCESS != *status)
+    {
+        libusb_exit(handle->usbContext);
+        goto error;
+    }
+
+    return handle;
+
+error:
+    free(handle);
+    return NULL;
+}
+
+void dfu_programmer_close(dfu_programmer_handle_t *handle)
+{
+    if (NULL == handle)
+    {
+        return;
+    }
+
+    handle->args.command = com_none;
+    close_device(&handle->device, &handle->args, SUCCESS);
+    libusb_exit(handle->usbContext);
+    free(handle);
+}
+
+int dfu_programmer_info(dfu_programmer_handle_t *handle,
+                        dfu_programmer_info_t *info)
+{
+    struct programmer_arguments *args = &handle->args;
+    int retval = SUCCESS;
+
+    memset(info, 0, sizeof(*info));
+    info->device_type = args->device_type_string;
+    info->vendor_id = args->vendor_id;
+    info->chip_id = args->chip_id;
+    info->memory_size = args->memory_address_top + 1;
+    info->flash_bottom = args->flash_address_bottom;
+    info->flash_top = args->flash_address_top;
+    info->bootloader_bottom = args->bootloader_bottom;
+    info->bootloader_top = args->bootloader_top;
+    info->flash_page_size = args->flash_page_size;
+    info->eeprom_size = args->eeprom_memory_size;
+    info->eeprom_page_size = args->eeprom_page_size;
+
+    // the bootloader only has configuration values to read on Atmel parts
+    memset(&info->config, 0xff, sizeof(info->config));
+    if (!(args->device_type & GRP_STM32))
+    {
+        if (ADC_AVR32 == args->device_type)
+        {
+            handle->device.security_bit_state = atmel_getsecure(&handle->device);
+        }
+        if (0 != atmel_read_config(&handle->device, &info->config))
+        {
+            retval = DEVICE_ACCESS_ERROR;
+        }
+    }
+
+    return retval;
+}
+
+int dfu_programmer_flash_extents(dfu_programmer_handle_t *handle,
+                                 enum atmel_memory_unit_enum segment,
+                                 const image_extent_t *extents, size_t count,
+                                 unsigned int flags)
+{
+    struct programmer_arguments args = handle->args;
+
+    if (NULL == extents || 0 == count)
+    {
+        return ARGUMENT_ERROR;
+    }
+
+    args.command = com_flash;
+    args.com_flash_data.segment = segment;
+    args.com_flash_data.extents = extents;
+    args.com_flash_data.extent_count = count;
+    args.com_flash_data.erase_first = (flags & DFU_PROGRAMMER_ERASE) != 0;
+    args.com_flash_data.force = (flags & DFU_PROGRAMMER_FORCE) != 0;
+    args.com_flash_data.suppress_validation =
+        (flags & DFU_PROGRAMMER_NO_VALIDATE) != 0;
+    args.com_flash_data.if_changed = (flags & DFU_PROGRAMMER_IF_CHANGED) != 0;
+    args.suppressBootloader = (flags & DFU_PROGRAMMER_SUPPRESS_BOOTLOADER) != 0;
 
-    memset(&dfu_device, 0, sizeof(dfu_device));
+    return execute_command(&handle->device, &args);
+}
+
+int dfu_programmer_flash(dfu_programmer_handle_t *handle,
+                         enum atmel_memory_unit_enum segment,
+                         uint32_t address, const uint8_t *data, size_t length,
+                         unsigned int flags)
+{
+    image_extent_t extent;
+
+    extent.address = address;
+    extent.data = data;
+    extent.length = length;
+
+    return dfu_programmer_flash_extents(handle, segment, &extent, 1, flags);
+}
+
+int dfu_programmer_read(dfu_programmer_handle_t *handle,
+                        enum atmel_memory_unit_enum segment,
+                        uint32_t address, uint8_t *buffer, size_t length)
+{
+    return read_memory(&handle->device, &handle->args, segment, address,
+                       buffer, length);
+}
+
+static libusb_context *open_libusb(void)
+{
+    libusb_context *usbContext;
 
     if (libusb_init(&usbContext))
     {
         fprintf(stderr, "%s: can't init libusb.\n", progname);
-        return DEVICE_ACCESS_ERROR;
+        return NULL;
     }
 
     if (debug >= 200)
@@ -59,9 +328,78 @@ int dfu_programmer(struct programmer_arguments * args)
 #endif
     }
 
+    return usbContext;
+}
+
+static int32_t serve_job(void *context, int argc, char **argv,
+                         serve_timing_t *timing)
+{
+    serve_state_t *state = (serve_state_t *) context;
+    struct programmer_arguments args[MAX_CHAINED_COMMANDS];
+    int saved_debug = debug;
+    int32_t retval;
+    int32_t count;
+    double start;
+    double opened = 0;
+    int32_t i;
+
+    memset(args, 0, sizeof(args));
+
+    start = dfu_time();
+    count = parse_command_chain(args, MAX_CHAINED_COMMANDS, argc, argv);
+    timing->parse = dfu_time() - start;
+    if (count <= 0)
+    {
+        retval = (count < 0) ? ARGUMENT_ERROR : SUCCESS;
+        goto done;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if ((com_flash == args[i].command || com_eflash == args[i].command ||
+             com_user == args[i].command) &&
+            NULL == args[i].com_flash_data.cache_dir)
+        {
+            args[i].com_flash_data.cache_dir = state->serve->cache_dir;
+        }
+    }
+
+    start = dfu_time();
+    if (1 == count && runs_without_device(&args[0]))
+    {
+        retval = dfu_programmer(&args[0]);
+        opened = start;
+    }
+    else
+    {
+        retval = run_session(state->usbContext, args, count, &opened);
+    }
+    if (0 == opened)
+    {
+        timing->open = dfu_time() - start;
+    }
+    else
+    {
+        timing->open = opened - start;
+        timing->run = dfu_time() - opened;
+    }
+
+done:
+    debug = saved_debug;
+    return retval;
+}
+
+static int open_device(libusb_context *usbContext,
+                       struct programmer_arguments * args,
+                       dfu_device_t *dfu_device)
+{
+    struct libusb_device *device;
+
+    memset(dfu_device, 0, sizeof(*dfu_device));
+
     device = dfu_device_init(args->vendor_id, args->chip_id,
                                 args->bus_id, args->device_address,
-                                &dfu_device,
+                                dfu_device,
                                 args->initial_abort,
                                 args->honor_interfaceclass,
                                 usbContext);
@@ -69,18 +407,21 @@ int dfu_programmer(struct programmer_arguments * args)
     if (NULL == device)
     {
         fprintf(stderr, "%s: no device present.\n", progname);
-        retval = DEVICE_ACCESS_ERROR;
-        goto error;
+        return DEVICE_ACCESS_ERROR;
     }
 
-    retval = execute_command(&dfu_device, args);
+    dfu_device->type = args->device_type;
+    return SUCCESS;
+}
 
-error:
-    if (NULL != dfu_device.handle)
+static int close_device(dfu_device_t *dfu_device,
+                        struct programmer_arguments * args, int retval)
+{
+    if (NULL != dfu_device->handle)
     {
         int rv;
 
-        rv = libusb_release_interface(dfu_device.handle, dfu_device.interface);
+        rv = libusb_release_interface(dfu_device->handle, dfu_device->interface);
         /* The RESET command sometimes causes the usb_release_interface command to fail.
            It is not obvious why this happens but it may be a glitch due to the hardware
            reset in the attached device. In any event, since reset causes a USB detach
@@ -90,17 +431,58 @@ error:
                          args->com_launch_config.noreset == 0))
         {
             fprintf(stderr, "%s: failed to release interface %d.\n",
-                    progname, dfu_device.interface);
+                    progname, dfu_device->interface);
             retval = DEVICE_ACCESS_ERROR;
         }
     }
 
-    if (NULL != dfu_device.handle)
+    if (NULL != dfu_device->handle)
     {
-        libusb_close(dfu_device.handle);
+        libusb_close(dfu_device->handle);
+        dfu_device->handle = NULL;
     }
 
-    libusb_exit(usbContext);
+    return retval;
+}
+
+static int run_session(libusb_context *usbContext,
+                       struct programmer_arguments * args, size_t count,
+                       double *opened)
+{
+    int retval;
+    dfu_device_t dfu_device;
+    bool json = false;
+    size_t i;
+
+    *opened = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        json = json || args[i].json;
+    }
+    if (json)
+    {
+        report_start();
+    }
+
+    report_phase("enumerate");
+    retval = open_device(usbContext, args, &dfu_device);
+    if (SUCCESS == retval)
+    {
+        // the device stays open and idle between the commands
+        *opened = dfu_time();
+        for (i = 0; i < count && SUCCESS == retval; i++)
+        {
+            report_phase(command_name(args[i].command));
+            retval = execute_command(&dfu_device, &args[i]);
+        }
+        args = &args[i - 1];
+    }
+
+    retval = close_device(&dfu_device, args, retval);
+
+    // the report is the last line, after anything the commands printed
+    report_finish(stderr, retval);
 
     return retval;
 }
@@ -5,9 +5,94 @@ extern "C" {
 #endif
 
 #include "arguments.h"
+#include "progress.h"
 
 int dfu_programmer(struct programmer_arguments * args);
 
+/* run count commands in order on one open device, stopping at the first
+ * that fails, the device is found using args[0]
+ */
+int dfu_programmer_session(struct programmer_arguments * args, size_t count);
+
+/* keep libusb and parsed images between jobs, run the jobs sent to the
+ * serve->socket Unix domain socket until one says quit, see serve.h
+ */
+int dfu_programmer_serve(struct serve_arguments * serve);
+
+/* have callback called with context as memory is read or programmed, with
+ * the bytes done, the rate and the time left, see progress.h.  NULL stops it
+ */
+void dfu_programmer_progress(progress_callback_t callback, void *context);
+
+/* ----- in-memory API --------------------------------------------------
+ * for programs that hold the image themselves.  a device is opened once,
+ * any number of calls are made on it and it is closed.  the calls return
+ * SUCCESS or one of the exit statuses in arguments.h.  addresses are from
+ * the start of the memory, so 0 is its first byte whatever the device maps
+ * it to.
+ */
+
+/* an open device */
+typedef struct dfu_programmer_handle dfu_programmer_handle_t;
+
+/* flags for the flash calls, as the command line options of the same name */
+#define DFU_PROGRAMMER_ERASE                0x01    /* --erase-first      */
+#define DFU_PROGRAMMER_FORCE                0x02    /* --force            */
+#define DFU_PROGRAMMER_NO_VALIDATE          0x04    /* --suppress-validation */
+#define DFU_PROGRAMMER_IF_CHANGED           0x08    /* --if-changed       */
+#define DFU_PROGRAMMER_SUPPRESS_BOOTLOADER  0x10    /* --suppress-bootloader-mem */
+
+/* what is known about a device, from its target and its bootloader */
+typedef struct {
+    const char *device_type;        /* "AVR", "XMEGA", "STM32" ...        */
+    uint16_t vendor_id;
+    uint16_t chip_id;
+    uint32_t memory_size;           /* flash, with the bootloader region  */
+    uint32_t flash_bottom;          /* the flash that can be programmed,  */
+    uint32_t flash_top;             /*     inclusive                      */
+    uint32_t bootloader_bottom;
+    uint32_t bootloader_top;
+    size_t flash_page_size;
+    size_t eeprom_size;             /* 0 if there is no eeprom            */
+    size_t eeprom_page_size;
+    atmel_device_info_t config;     /* as the get command reads them, all
+                                       -1 on devices without them         */
+} dfu_programmer_info_t;
+
+/* find and open the device for target, named as on the command line
+ * ("atmega32u4", or "atmega32u4:bus,address" for one of several).  quiet
+ * leaves out the messages the commands print to STDERR.  returns NULL with
+ * status set if it can not be opened
+ */
+dfu_programmer_handle_t *dfu_programmer_open(const char *target, bool quiet,
+                                             int *status);
+
+/* release the device, handle can not be used after this */
+void dfu_programmer_close(dfu_programmer_handle_t *handle);
+
+/* fill in info, reading the configuration from an Atmel bootloader */
+int dfu_programmer_info(dfu_programmer_handle_t *handle,
+                        dfu_programmer_info_t *info);
+
+/* program length bytes of data at address, as the flash command would with
+ * a file holding them (blank check, write and validate as flags say)
+ */
+int dfu_programmer_flash(dfu_programmer_handle_t *handle,
+                         enum atmel_memory_unit_enum segment,
+                         uint32_t address, const uint8_t *data, size_t length,
+                         unsigned int flags);
+
+/* the same with an image of count extents, programmed as one */
+int dfu_programmer_flash_extents(dfu_programmer_handle_t *handle,
+                                 enum atmel_memory_unit_enum segment,
+                                 const image_extent_t *extents, size_t count,
+                                 unsigned int flags);
+
+/* read length bytes of the memory from address into buffer */
+int dfu_programmer_read(dfu_programmer_handle_t *handle,
+                        enum atmel_memory_unit_enum segment,
+                        uint32_t address, uint8_t *buffer, size_t length);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,18 +24,28 @@
 int main( int argc, char **argv )
 {
     int status;
-    struct programmer_arguments args;
+    struct programmer_arguments args[MAX_CHAINED_COMMANDS];
+    struct serve_arguments serve;
 
-    memset( &args, 0, sizeof(args) );
+    memset( args, 0, sizeof(args) );
 
-    status = parse_arguments(&args, argc, argv);
+    status = parse_serve_arguments(&serve, argc, argv);
+    if( status < 0 ) {
+        return ARGUMENT_ERROR;
+    } else if( status == 0 ) {
+        return dfu_programmer_serve(&serve);
+    }
+
+    status = parse_command_chain(args, MAX_CHAINED_COMMANDS, argc, argv);
     if( status < 0 ) {
         /* Exit with an error. */
         return ARGUMENT_ERROR;
-    } else if (status > 0) {
+    } else if (status == 0) {
         /* It was handled by parse_arguments. */
         return SUCCESS;
+    } else if (status == 1) {
+        return dfu_programmer(&args[0]);
     }
 
-    return dfu_programmer(&args);
+    return dfu_programmer_session(args, status);
 }
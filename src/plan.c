@@ -0,0 +1,281 @@
+/*
+ * dfu-programmer
+ *
+ * plan.c
+ *
+ * Counts the DFU requests that programming an image sends, recorded from
+ * the usual programming code by the flash --plan option, and estimates how
+ * long a device would take over them.
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "plan.h"
+#include "dfu.h"
+#include "util.h"
+
+#define PLAN_ATMEL_HEADER       6       // ld_prog_start and the range
+#define PLAN_STM32_SET_ADDRESS  0x21
+#define PLAN_STM32_ERASE        0x41
+#define PLAN_STM32_SECTOR       0x4000  // what a sector erase clears
+
+#define PLAN_DEBUG_THRESHOLD    50
+#define PLAN_TRACE_THRESHOLD    55
+
+#define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               PLAN_DEBUG_THRESHOLD, __VA_ARGS__ )
+#define TRACE(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               PLAN_TRACE_THRESHOLD, __VA_ARGS__ )
+
+/* how long a family takes over the parts of a request.  the figures are
+ * rough, from the datasheet page write and erase times and a full speed
+ * control transfer per request, and are meant for comparing one image or
+ * option with another rather than for predicting a run to the second
+ */
+typedef struct {
+    atmel_device_class_t type;
+    const char *name;
+    double request_ms;          // a control transfer, setup to status
+    double byte_us;             // moving a payload byte over the bus
+    double program_us;          // writing an image byte to flash
+    double erase_ms;            // erasing a kB of flash
+    double check_us;            // blank checking a byte
+} plan_model_t;
+
+static const plan_model_t plan_models[] = {
+    { ADC_8051,  "8051",  1.0, 20.0, 39.0, 30.0, 0.5 },
+    { ADC_AVR,   "AVR",   1.0, 20.0, 35.0, 31.0, 0.5 },
+    { ADC_AVR32, "AVR32", 1.0, 12.0, 10.0, 10.0, 0.1 },
+    { ADC_XMEGA, "XMEGA", 1.0, 12.0, 23.0, 25.0, 0.2 },
+    { DC_STM32,  "STM32", 1.0,  8.0,  4.0, 16.0, 0.1 }
+};
+
+// ________  P R O T O T Y P E S  _______________________________
+static const plan_model_t *plan_model( atmel_device_class_t type );
+/* the latency model of a family, the last one for an unknown type */
+
+static plan_stage_t *plan_current( plan_t *plan );
+/* the stage being counted, one named "start" until the first is begun */
+
+static void plan_block( plan_t *plan, plan_stage_t *stage, uint32_t size );
+/* count a block of size image bytes */
+
+static void plan_atmel( plan_t *plan, plan_stage_t *stage,
+                        const uint8_t *data, size_t length );
+static void plan_stm32( plan_t *plan, plan_stage_t *stage, uint16_t value,
+                        const uint8_t *data, size_t length );
+/* classify a DFU_DNLOAD to the family's bootloader */
+
+
+// ________  F U N C T I O N S  _______________________________
+static const plan_model_t *plan_model( atmel_device_class_t type ) {
+    size_t i;
+
+    for( i = 0; i < sizeof(plan_models) / sizeof(plan_models[0]); i++ ) {
+        if( type & plan_models[i].type ) {
+            return &plan_models[i];
+        }
+    }
+    return &plan_models[i - 1];
+}
+
+static plan_stage_t *plan_current( plan_t *plan ) {
+    if( 0 == plan->count ) {
+        plan_stage( plan, "start" );
+    }
+    return &plan->stages[plan->count - 1];
+}
+
+void plan_init( plan_t *plan, atmel_device_class_t type,
+                uint32_t flash_size ) {
+    memset( plan, 0, sizeof(*plan) );
+    plan->type = type;
+    plan->flash_size = flash_size;
+}
+
+void plan_stage( plan_t *plan, const char *name ) {
+    if( PLAN_STAGES_MAX == plan->count ) {
+        return;
+    }
+    plan->stages[plan->count].name = name;
+    plan->count++;
+}
+
+static void plan_block( plan_t *plan, plan_stage_t *stage, uint32_t size ) {
+    uint32_t i;
+
+    stage->blocks++;
+    stage->data_out += size;
+    stage->seconds += plan_model(plan->type)->program_us * size / 1e6;
+
+    // keep the sizes in order, largest first
+    i = 0;
+    while( i < plan->size_count && plan->sizes[i].size > size ) {
+        i++;
+    }
+    if( i < plan->size_count && plan->sizes[i].size == size ) {
+        plan->sizes[i].count++;
+    } else if( PLAN_SIZES_MAX == plan->size_count ) {
+        plan->other_sizes++;
+    } else {
+        memmove( &plan->sizes[i + 1], &plan->sizes[i],
+                 (plan->size_count - i) * sizeof(plan->sizes[0]) );
+        plan->sizes[i].size = size;
+        plan->sizes[i].count = 1;
+        plan->size_count++;
+    }
+}
+
+static void plan_atmel( plan_t *plan, plan_stage_t *stage,
+                        const uint8_t *data, size_t length ) {
+    const plan_model_t *model = plan_model( plan->type );
+    uint32_t start;
+    uint32_t end;
+
+    if( length < 2 ) {
+        stage->commands++;
+        return;
+    }
+
+    start = (length < PLAN_ATMEL_HEADER) ? 0 : ((data[2] << 8) | data[3]);
+    end = (length < PLAN_ATMEL_HEADER) ? 0 : ((data[4] << 8) | data[5]);
+
+    if( 0x01 == data[0] && PLAN_ATMEL_HEADER < length ) {
+        plan_block( plan, stage, end - start + 1 );
+    } else if( 0x06 == data[0] && 0x03 == data[1] ) {
+        // a memory unit on the AVR32 group, a page on the AVR
+        if( 5 == length || ADC_AVR == plan->type ) {
+            stage->page_selects++;
+        } else {
+            stage->unit_selects++;
+        }
+    } else if( 0x04 == data[0] && 0x00 == data[1] ) {
+        stage->erases++;
+        stage->seconds += model->erase_ms * plan->flash_size / 1024 / 1e3;
+    } else if( 0x03 == data[0] && 0x01 == data[1] ) {
+        stage->blank_checks++;
+        if( PLAN_ATMEL_HEADER <= length && start <= end ) {
+            stage->seconds += model->check_us * (end - start + 1) / 1e6;
+        }
+    } else {
+        stage->commands++;
+    }
+}
+
+static void plan_stm32( plan_t *plan, plan_stage_t *stage, uint16_t value,
+                        const uint8_t *data, size_t length ) {
+    const plan_model_t *model = plan_model( plan->type );
+
+    if( 2 <= value && 0 < length ) {
+        plan_block( plan, stage, (uint32_t) length );
+    } else if( 0 == value && 0 < length && PLAN_STM32_SET_ADDRESS == data[0] ) {
+        stage->address_resets++;
+    } else if( 0 == value && 0 < length && PLAN_STM32_ERASE == data[0] ) {
+        stage->erases++;
+        stage->seconds += model->erase_ms / 1024 / 1e3 *
+                          ((1 == length) ? plan->flash_size : PLAN_STM32_SECTOR);
+    } else {
+        stage->commands++;
+    }
+}
+
+int32_t plan_record( void *context, uint8_t request, uint16_t value,
+        const uint8_t *data, size_t length ) {
+    plan_t *plan = (plan_t *) context;
+    plan_stage_t *stage = plan_current( plan );
+    const plan_model_t *model = plan_model( plan->type );
+
+    TRACE( "%s( %u, %u, %u )\n", __FUNCTION__, request, value, length );
+
+    stage->requests++;
+    stage->seconds += model->request_ms / 1e3 + model->byte_us * length / 1e6;
+
+    if( DFU_GETSTATUS == request ) {
+        stage->statuses++;
+    } else if( DFU_UPLOAD == request ) {
+        stage->reads++;
+        stage->bytes_in += length;
+    } else {
+        stage->bytes_out += length;
+        if( plan->type & GRP_STM32 ) {
+            plan_stm32( plan, stage, value, data, length );
+        } else {
+            plan_atmel( plan, stage, data, length );
+        }
+    }
+
+    return 0;
+}
+
+void plan_print( FILE *fp, const plan_t *plan, const char *what ) {
+    plan_stage_t total;
+    const plan_stage_t *stage;
+    uint32_t i;
+
+    memset( &total, 0, sizeof(total) );
+
+    fprintf( fp, "Plan for %s, %s timing:\n", what,
+             plan_model(plan->type)->name );
+    fprintf( fp, "  %-12s %8s %8s %10s %10s %9s\n", "stage", "requests",
+             "polls", "bytes out", "bytes in", "seconds" );
+    for( i = 0; i < plan->count; i++ ) {
+        stage = &plan->stages[i];
+        fprintf( fp, "  %-12s %8u %8u %10lu %10lu %9.3f\n", stage->name,
+                 stage->requests, stage->statuses,
+                 (unsigned long) stage->bytes_out,
+                 (unsigned long) stage->bytes_in, stage->seconds );
+
+        total.requests += stage->requests;
+        total.statuses += stage->statuses;
+        total.erases += stage->erases;
+        total.blank_checks += stage->blank_checks;
+        total.unit_selects += stage->unit_selects;
+        total.page_selects += stage->page_selects;
+        total.address_resets += stage->address_resets;
+        total.blocks += stage->blocks;
+        total.reads += stage->reads;
+        total.commands += stage->commands;
+        total.bytes_out += stage->bytes_out;
+        total.data_out += stage->data_out;
+        total.bytes_in += stage->bytes_in;
+        total.seconds += stage->seconds;
+    }
+    fprintf( fp, "  %-12s %8u %8u %10lu %10lu %9.3f\n", "total",
+             total.requests, total.statuses, (unsigned long) total.bytes_out,
+             (unsigned long) total.bytes_in, total.seconds );
+
+    fprintf( fp, "Erases %u, blank checks %u, memory unit selects %u, "
+                 "page selects %u,\naddress pointer resets %u, "
+                 "reads %u, other commands %u.\n", total.erases,
+             total.blank_checks, total.unit_selects, total.page_selects,
+             total.address_resets, total.reads, total.commands );
+    fprintf( fp, "Data blocks %u carrying 0x%lX bytes", total.blocks,
+             (unsigned long) total.data_out );
+    for( i = 0; i < plan->size_count; i++ ) {
+        fprintf( fp, "%s %u x %u", (0 == i) ? ":" : ",",
+                 plan->sizes[i].count, plan->sizes[i].size );
+    }
+    if( 0 != plan->other_sizes ) {
+        fprintf( fp, ", %u of other sizes", plan->other_sizes );
+    }
+    fprintf( fp, ".\nAbout %.2f seconds, a rough figure for comparing "
+                 "images.\n", total.seconds );
+}
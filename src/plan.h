@@ -0,0 +1,99 @@
+/*
+ * dfu-programmer
+ *
+ * plan.h
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __PLAN_H__
+#define __PLAN_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "dfu-device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A plan counts the requests flashing an image would send, by running the
+ * usual programming code against a device that records them (see
+ * dfu_download), and estimates how long they take on the device family.
+ */
+
+#define PLAN_STAGES_MAX         8       /* erase, blank check, write ...   */
+#define PLAN_SIZES_MAX          8       /* data block sizes told apart     */
+
+/* what one stage of the plan sends */
+typedef struct {
+    const char *name;
+    uint32_t requests;          // control transfers, status polls included
+    uint32_t statuses;          // DFU_GETSTATUS polls
+    uint32_t erases;
+    uint32_t blank_checks;
+    uint32_t unit_selects;      // Atmel memory unit selects
+    uint32_t page_selects;      // Atmel 64kB page selects
+    uint32_t address_resets;    // STM32 address pointer sets
+    uint32_t blocks;            // DNLOAD blocks of image data
+    uint32_t reads;             // UPLOAD blocks
+    uint32_t commands;          // any other DNLOAD
+    uint64_t bytes_out;         // DNLOAD payloads, headers included
+    uint64_t data_out;          // image bytes in the data blocks
+    uint64_t bytes_in;          // UPLOAD payloads
+    double seconds;             // the estimate
+} plan_stage_t;
+
+typedef struct {
+    atmel_device_class_t type;
+    uint32_t flash_size;        // what an erase clears, for the estimate
+    plan_stage_t stages[PLAN_STAGES_MAX];
+    uint32_t count;
+    struct {
+        uint32_t size;
+        uint32_t count;
+    } sizes[PLAN_SIZES_MAX];    // data blocks by size, largest first
+    uint32_t size_count;
+    uint32_t other_sizes;       // blocks of sizes that did not fit
+} plan_t;
+
+void plan_init( plan_t *plan, atmel_device_class_t type,
+                uint32_t flash_size );
+/* start an empty plan for a device of type */
+
+void plan_stage( plan_t *plan, const char *name );
+/* count the requests from now on as the named stage (a string literal).
+ * after PLAN_STAGES_MAX stages they are added to the last one
+ */
+
+int32_t plan_record( void *context, uint8_t request, uint16_t value,
+        const uint8_t *data, size_t length );
+/* a dfu_recorder_t counting a request into the plan_t context, always 0 */
+
+void plan_print( FILE *fp, const plan_t *plan, const char *what );
+/* write the plan for what ("flash data from 0x0 to 0xFF" or so) to fp: each
+ * stage with its requests and estimate, then the totals of every kind of
+ * request
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * dfu-programmer
+ *
+ * progress.c
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "progress.h"
+#include "util.h"
+
+#define PROGRESS_METER  "0%%                            100%%  "
+#define PROGRESS_LINE   96      // the longest bar line drawn
+
+static progress_callback_t progress_callback = NULL;
+static void *progress_context = NULL;
+
+static progress_t current;
+static bool active = false;
+static bool drawing = false;    // the bar is on the terminal
+static double started;          // dfu_time of progress_begin
+static double drawn;            // dfu_time of the last redraw
+static int drawn_length;        // of the bar line on the terminal
+
+// ________  P R O T O T Y P E S  _______________________________
+static void progress_measure( void );
+/* update the time, rate and ETA of the current transfer */
+
+static void progress_append( char *line, size_t *length,
+                             const char *format, ... );
+/* add to the bar line of *length characters, stopping at PROGRESS_LINE
+ */
+
+static void progress_draw( const bool final );
+/* redraw the bar line, with the rate and ETA while running, or the rate
+ * (or an X on failure) once final
+ */
+
+
+// ________  F U N C T I O N S  _______________________________
+static void progress_measure( void ) {
+    current.seconds = dfu_time() - started;
+    current.rate = 0;
+    current.eta = -1;
+    if( 0 < current.seconds && 0 < current.done ) {
+        current.rate = current.done / current.seconds;
+        current.eta = (current.total - current.done) / current.rate;
+    }
+}
+
+static void progress_append( char *line, size_t *length,
+                             const char *format, ... ) {
+    va_list va;
+    int result;
+
+    if( PROGRESS_LINE <= *length ) {
+        return;
+    }
+    va_start( va, format );
+    result = vsnprintf( &line[*length], PROGRESS_LINE + 1 - *length,
+                        format, va );
+    va_end( va );
+    if( 0 > result ) {
+        line[*length] = '\0';
+    } else if( PROGRESS_LINE - *length <= (size_t) result ) {
+        // cut short, vsnprintf wrote what fits
+        *length = PROGRESS_LINE;
+    } else {
+        *length += (size_t) result;
+    }
+}
+
+static void progress_draw( const bool final ) {
+    char line[PROGRESS_LINE + 1];
+    uint32_t steps = PROGRESS_STEPS;
+    size_t length;
+
+    if( 0 < current.total ) {
+        steps = (uint32_t) (((uint64_t) current.done * PROGRESS_STEPS) /
+                            current.total);
+        if( PROGRESS_STEPS < steps ) {
+            steps = PROGRESS_STEPS;
+        }
+    }
+
+    line[0] = '[';
+    memset( &line[1], '>', steps );
+    length = steps + 1;
+    if( final && progress_failed == current.state ) {
+        progress_append( line, &length, " X  " );
+    } else {
+        if( !final ) {
+            memset( &line[length], ' ', PROGRESS_STEPS - steps );
+            length += PROGRESS_STEPS - steps;
+        }
+        line[length++] = ']';
+        line[length] = '\0';
+        if( 0 < current.rate ) {
+            progress_append( line, &length, "  %.1f KiB/s",
+                             current.rate / 1024 );
+        }
+        if( !final && 0 <= current.eta ) {
+            progress_append( line, &length, ", %.0fs left", current.eta );
+        }
+        progress_append( line, &length, "  " );
+    }
+
+    // blank the line drawn before, the new one can be shorter
+    fprintf( stderr, "\r%*s\r%s", drawn_length, "", line );
+    fflush( stderr );
+    drawn_length = (int) length;
+}
+
+void progress_set_callback( progress_callback_t callback, void *context ) {
+    progress_callback = callback;
+    progress_context = context;
+}
+
+void progress_begin( const char *action, const uint32_t total,
+                     const bool quiet, const bool bar ) {
+    memset( &current, 0, sizeof(current) );
+    current.action = action;
+    current.total = total;
+    current.eta = -1;
+    current.state = progress_running;
+    started = drawn = dfu_time();
+    drawn_length = 1;
+    active = true;
+    drawing = !quiet && bar && isatty( 2 );
+
+    if( !quiet ) {
+        if( drawing ) {
+            fprintf( stderr, PROGRESS_METER );
+        }
+        fprintf( stderr, "%s 0x%X bytes...\n", action, total );
+        if( drawing ) {
+            fprintf( stderr, "[" );
+            fflush( stderr );
+        }
+    }
+    if( NULL != progress_callback ) {
+        progress_callback( &current, progress_context );
+    }
+}
+
+void progress_update( const uint32_t done ) {
+    double now;
+
+    if( !active ) {
+        return;
+    }
+
+    current.done = (done < current.total) ? done : current.total;
+    progress_measure();
+    if( drawing ) {
+        now = dfu_time();
+        if( PROGRESS_REDRAW <= now - drawn ) {
+            progress_draw( false );
+            drawn = now;
+        }
+    }
+    if( NULL != progress_callback ) {
+        progress_callback( &current, progress_context );
+    }
+}
+
+void progress_end( const bool success ) {
+    if( !active ) {
+        return;
+    }
+
+    if( success ) {
+        current.done = current.total;
+    }
+    current.state = success ? progress_done : progress_failed;
+    progress_measure();
+    current.eta = success ? 0 : -1;
+    if( drawing ) {
+        progress_draw( true );
+    }
+    if( NULL != progress_callback ) {
+        progress_callback( &current, progress_context );
+    }
+    active = false;
+}
@@ -0,0 +1,82 @@
+/*
+ * dfu-programmer
+ *
+ * progress.h
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __PROGRESS_H__
+#define __PROGRESS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROGRESS_STEPS          32      /* width of the bar on a terminal  */
+#define PROGRESS_REDRAW         0.1     /* seconds between bar redraws     */
+
+enum progress_state_enum {
+    progress_running,
+    progress_done,
+    progress_failed
+};
+
+typedef struct {
+    const char *action;             // "Reading", "Programming"
+    uint32_t done;                  // bytes moved so far
+    uint32_t total;                 // bytes to move
+    double seconds;                 // since the transfer began
+    double rate;                    // bytes per second, 0 until known
+    double eta;                     // seconds left, negative until known
+    enum progress_state_enum state;
+} progress_t;
+
+/* called as a transfer begins, after each block and when it ends */
+typedef void (*progress_callback_t)( const progress_t *progress,
+                                     void *context );
+
+void progress_set_callback( progress_callback_t callback, void *context );
+/* have callback called with context for every transfer from now on, NULL
+ * to stop.  it is called whether or not the output is quiet
+ */
+
+void progress_begin( const char *action, const uint32_t total,
+                     const bool quiet, const bool bar );
+/* start a transfer of total bytes.  unless quiet this prints
+ * "action 0x... bytes...", and with bar (and STDERR a terminal) the meter
+ * above it and the bar below it, which has to be ended with progress_end
+ */
+
+void progress_update( const uint32_t done );
+/* done bytes of the transfer have been moved, the bar is redrawn at most
+ * every PROGRESS_REDRAW seconds.  does nothing outside a transfer
+ */
+
+void progress_end( const bool success );
+/* end the transfer, leaving the full bar and the rate, or the bar so far and
+ * an X on failure.  the caller goes on to print Success or ERROR
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
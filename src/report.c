@@ -0,0 +1,146 @@
+/*
+ * dfu-programmer
+ *
+ * report.c
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "report.h"
+#include "util.h"
+
+typedef struct {
+    const char *name;
+    double start;           // seconds since report_start
+    double end;
+    uint64_t bytes;
+    uint32_t transfers;
+    uint32_t retries;
+    int32_t status;
+} report_phase_t;
+
+static bool recording = false;
+static time_t started;      // wall clock time of report_start
+static double origin;       // dfu_time of report_start
+static report_phase_t phases[REPORT_PHASES_MAX];
+static uint32_t count = 0;
+
+// ________  P R O T O T Y P E S  _______________________________
+static report_phase_t *report_current( void );
+/* the phase being recorded, one named "start" until the first is begun */
+
+
+// ________  F U N C T I O N S  _______________________________
+static report_phase_t *report_current( void ) {
+    if( 0 == count ) {
+        report_phase( "start" );
+    }
+    return &phases[count - 1];
+}
+
+void report_start( void ) {
+    recording = true;
+    started = time( NULL );
+    origin = dfu_time();
+    count = 0;
+}
+
+void report_phase( const char *name ) {
+    double now;
+
+    if( !recording ) {
+        return;
+    }
+
+    // a command that starts with its own phase carries on with it
+    if( 0 < count && 0 == strcmp(name, phases[count - 1].name) ) {
+        return;
+    }
+
+    now = dfu_time() - origin;
+    if( 0 < count ) {
+        phases[count - 1].end = now;
+        if( REPORT_PHASES_MAX == count ) {
+            return;
+        }
+    }
+
+    memset( &phases[count], 0, sizeof(phases[count]) );
+    phases[count].name = name;
+    phases[count].start = now;
+    count++;
+}
+
+void report_transfer( void ) {
+    if( recording ) {
+        report_current()->transfers++;
+    }
+}
+
+void report_bytes( size_t length ) {
+    if( recording ) {
+        report_current()->bytes += length;
+    }
+}
+
+void report_retry( void ) {
+    if( recording ) {
+        report_current()->retries++;
+    }
+}
+
+void report_finish( FILE *fp, int32_t status ) {
+    uint64_t bytes = 0;
+    uint32_t transfers = 0;
+    uint32_t retries = 0;
+    uint32_t i;
+
+    if( !recording ) {
+        return;
+    }
+
+    report_current()->end = dfu_time() - origin;
+    report_current()->status = status;
+    for( i = 0; i < count; i++ ) {
+        bytes += phases[i].bytes;
+        transfers += phases[i].transfers;
+        retries += phases[i].retries;
+    }
+
+    fprintf( fp, "{\"status\":%d,\"started\":%lu,\"seconds\":%.6f,"
+                 "\"bytes\":%lu,\"transfers\":%u,\"retries\":%u,\"phases\":[",
+             status, (unsigned long) started, phases[count - 1].end,
+             (unsigned long) bytes, transfers, retries );
+    for( i = 0; i < count; i++ ) {
+        fprintf( fp, "%s{\"name\":\"%s\",\"start\":%.6f,\"end\":%.6f,"
+                     "\"bytes\":%lu,\"transfers\":%u,\"retries\":%u,"
+                     "\"status\":%d}", (0 == i) ? "" : ",", phases[i].name,
+                 phases[i].start, phases[i].end,
+                 (unsigned long) phases[i].bytes, phases[i].transfers,
+                 phases[i].retries, phases[i].status );
+    }
+    fprintf( fp, "]}\n" );
+    fflush( fp );
+
+    recording = false;
+}
@@ -0,0 +1,66 @@
+/*
+ * dfu-programmer
+ *
+ * report.h
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __REPORT_H__
+#define __REPORT_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* phases after this many are added to the last one */
+#define REPORT_PHASES_MAX       64
+
+void report_start( void );
+/* start recording phases for --json, until report_finish.  the calls below
+ * do nothing while no report is being recorded
+ */
+
+void report_phase( const char *name );
+/* end the current phase, it succeeded, and start the named one, unless the
+ * current phase has that name already.  name must be a string literal (it is
+ * kept, not copied)
+ */
+
+void report_transfer( void );
+/* count a control transfer in the current phase */
+
+void report_bytes( size_t length );
+/* count data moved by a DFU download or upload in the current phase */
+
+void report_retry( void );
+/* count a request that had to be repeated in the current phase */
+
+void report_finish( FILE *fp, int32_t status );
+/* end the current phase with status (the exit status of the run) and write
+ * every phase as a line of JSON to fp, then stop recording
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,363 @@
+/*
+ * dfu-programmer
+ *
+ * serve.c
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#include "arguments.h"
+#include "serve.h"
+#include "util.h"
+
+#define SERVE_DEBUG_THRESHOLD   50
+#define SERVE_COPY_CHUNK        0x10000
+
+#define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               SERVE_DEBUG_THRESHOLD, __VA_ARGS__ )
+
+#ifndef _WIN32
+// ________  P R O T O T Y P E S  _______________________________
+static int serve_listen( const char *path );
+/* create the socket at path, replacing an old socket (but nothing else)
+ * there.  returns the listening descriptor or -1
+ */
+
+static int32_t serve_read_line( int fd, char *line, size_t size );
+/* read a line from fd a byte at a time, so nothing after it is consumed.
+ * returns its length without the newline, or -1 if it is too long or the
+ * client went away first
+ */
+
+static int serve_split( char *line, char **argv, int max );
+/* split line in place into at most max arguments after argv[0], which the
+ * caller sets.  returns argc, or -1 for an unterminated quote or too many
+ */
+
+static int32_t serve_write( int fd, const void *data, size_t length );
+/* write all of data, returns 0 or -1 */
+
+static int32_t serve_copy( int from, int to, size_t length );
+/* copy length bytes from the start of the file from to to */
+
+static int32_t serve_run( int client, serve_job_t job, void *context,
+                          int argc, char **argv, int32_t *status );
+/* run a job with its stdout and stderr going to temporary files, then send
+ * the result line and both files to the client
+ */
+
+
+// ________  F U N C T I O N S  _______________________________
+static int serve_listen( const char *path ) {
+    struct sockaddr_un address;
+    struct stat info;
+    mode_t mask;
+    int fd;
+    int result;
+
+    if( strlen(path) >= sizeof(address.sun_path) ) {
+        fprintf( stderr, "The socket path %s is too long.\n", path );
+        return -1;
+    }
+    memset( &address, 0, sizeof(address) );
+    address.sun_family = AF_UNIX;
+    strcpy( address.sun_path, path );
+
+    if( 0 == stat(path, &info) ) {
+        if( !S_ISSOCK(info.st_mode) ) {
+            fprintf( stderr, "%s exists and is not a socket.\n", path );
+            return -1;
+        }
+        unlink( path );
+    }
+
+    fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd < 0 ) {
+        fprintf( stderr, "Unable to create a socket: %s\n", strerror(errno) );
+        return -1;
+    }
+    // a job can read and write any file the server can, so only its owner
+    // may connect
+    mask = umask( 077 );
+    result = bind( fd, (struct sockaddr *) &address, sizeof(address) );
+    umask( mask );
+    if( 0 != result || 0 != listen(fd, 4) ) {
+        fprintf( stderr, "Unable to listen on %s: %s\n", path,
+                 strerror(errno) );
+        close( fd );
+        return -1;
+    }
+
+    return fd;
+}
+
+static int32_t serve_read_line( int fd, char *line, size_t size ) {
+    size_t length = 0;
+    ssize_t result;
+    char c;
+
+    while( length < size ) {
+        result = read( fd, &c, 1 );
+        if( result < 0 && EINTR == errno ) {
+            continue;
+        } else if( result <= 0 ) {
+            return -1;
+        } else if( '\n' == c ) {
+            if( 0 < length && '\r' == line[length - 1] ) {
+                length--;
+            }
+            line[length] = '\0';
+            return (int32_t) length;
+        }
+        line[length++] = c;
+    }
+
+    return -1;
+}
+
+static int serve_split( char *line, char **argv, int max ) {
+    int argc = 1;
+    char *in = line;
+    char *out;
+
+    while( true ) {
+        while( ' ' == *in || '\t' == *in ) {
+            in++;
+        }
+        if( '\0' == *in ) {
+            return argc;
+        }
+        if( argc > max ) {
+            return -1;
+        }
+
+        // copy the argument to its own start, dropping the quotes
+        argv[argc++] = out = in;
+        while( '\0' != *in && ' ' != *in && '\t' != *in ) {
+            if( '"' == *in ) {
+                for( in++; '"' != *in; in++ ) {
+                    if( '\0' == *in ) {
+                        return -1;
+                    }
+                    *out++ = *in;
+                }
+                in++;
+            } else {
+                *out++ = *in++;
+            }
+        }
+        if( '\0' != *in ) {
+            in++;
+        }
+        *out = '\0';
+    }
+}
+
+static int32_t serve_write( int fd, const void *data, size_t length ) {
+    const uint8_t *next = (const uint8_t *) data;
+    ssize_t result;
+
+    while( 0 < length ) {
+        result = write( fd, next, length );
+        if( result < 0 && EINTR == errno ) {
+            continue;
+        } else if( result <= 0 ) {
+            return -1;
+        }
+        next += result;
+        length -= (size_t) result;
+    }
+
+    return 0;
+}
+
+static int32_t serve_copy( int from, int to, size_t length ) {
+    uint8_t chunk[SERVE_COPY_CHUNK];
+    ssize_t result;
+
+    if( 0 != lseek(from, 0, SEEK_SET) ) {
+        return -1;
+    }
+    while( 0 < length ) {
+        result = read( from, chunk, (length < sizeof(chunk)) ?
+                                    length : sizeof(chunk) );
+        if( result < 0 && EINTR == errno ) {
+            continue;
+        } else if( result <= 0 || 0 != serve_write(to, chunk, result) ) {
+            return -1;
+        }
+        length -= (size_t) result;
+    }
+
+    return 0;
+}
+
+static int32_t serve_run( int client, serve_job_t job, void *context,
+                          int argc, char **argv, int32_t *status ) {
+    int32_t retval = -1;
+    serve_timing_t timing;
+    FILE *output = tmpfile();
+    FILE *log = tmpfile();
+    char line[256];
+    double start;
+    off_t output_length;
+    off_t log_length;
+    int saved_stdout = -1;
+    int saved_stderr = -1;
+
+    if( NULL == output || NULL == log ) {
+        DEBUG( "Unable to create the job's output files.\n" );
+        goto done;
+    }
+
+    // the commands write to stdout and stderr as usual
+    fflush( stdout );
+    fflush( stderr );
+    saved_stdout = dup( STDOUT_FILENO );
+    saved_stderr = dup( STDERR_FILENO );
+    if( saved_stdout < 0 || saved_stderr < 0 ) {
+        goto done;
+    }
+    dup2( fileno(output), STDOUT_FILENO );
+    dup2( fileno(log), STDERR_FILENO );
+
+    memset( &timing, 0, sizeof(timing) );
+    start = dfu_time();
+    *status = job( context, argc, argv, &timing );
+
+    fflush( stdout );
+    fflush( stderr );
+    dup2( saved_stdout, STDOUT_FILENO );
+    dup2( saved_stderr, STDERR_FILENO );
+
+    output_length = lseek( fileno(output), 0, SEEK_END );
+    log_length = lseek( fileno(log), 0, SEEK_END );
+    snprintf( line, sizeof(line), "{\"status\":%d,\"output\":%ld,"
+              "\"log\":%ld,\"seconds\":{\"parse\":%.6f,\"open\":%.6f,"
+              "\"run\":%.6f,\"total\":%.6f}}\n", *status,
+              (long) output_length, (long) log_length, timing.parse,
+              timing.open, timing.run, dfu_time() - start );
+
+    if( 0 != serve_write(client, line, strlen(line)) ||
+            0 != serve_copy(fileno(output), client, output_length) ||
+            0 != serve_copy(fileno(log), client, log_length) ) {
+        DEBUG( "The client went away before the result was sent.\n" );
+        goto done;
+    }
+    retval = 0;
+
+done:
+    if( 0 <= saved_stdout ) close( saved_stdout );
+    if( 0 <= saved_stderr ) close( saved_stderr );
+    if( NULL != output ) fclose( output );
+    if( NULL != log ) fclose( log );
+    return retval;
+}
+
+int32_t serve_jobs( const char *path, serve_job_t job, void *context,
+                    bool quiet ) {
+    char line[SERVE_LINE_MAX + 1];
+    char program[] = "dfu-programmer";
+    char *argv[SERVE_ARGS_MAX + 1];
+    char summary[64];
+    uint32_t jobs = 0;
+    int32_t status;
+    int server;
+    int client;
+    int null;
+    int argc;
+    bool quit = false;
+
+    server = serve_listen( path );
+    if( server < 0 ) {
+        return ARGUMENT_ERROR;
+    }
+
+    // a client going away must not end the server, and jobs have no STDIN
+    signal( SIGPIPE, SIG_IGN );
+    null = open( "/dev/null", O_RDONLY );
+    if( 0 <= null ) {
+        dup2( null, STDIN_FILENO );
+        close( null );
+    }
+    if( !quiet ) {
+        fprintf( stderr, "Serving jobs on %s\n", path );
+    }
+
+    while( !quit ) {
+        client = accept( server, NULL, NULL );
+        if( client < 0 ) {
+            if( EINTR != errno ) {
+                fprintf( stderr, "Unable to accept a job: %s\n",
+                         strerror(errno) );
+                break;
+            }
+            continue;
+        }
+
+        argv[0] = program;
+        if( serve_read_line(client, line, SERVE_LINE_MAX) < 0 ||
+                (argc = serve_split(line, argv, SERVE_ARGS_MAX)) < 0 ) {
+            const char *error = "{\"status\":2,\"error\":\"bad job line\"}\n";
+            serve_write( client, error, strlen(error) );
+        } else if( 2 == argc && 0 == strcmp("quit", argv[1]) ) {
+            const char *done = "{\"status\":0}\n";
+            serve_write( client, done, strlen(done) );
+            quit = true;
+        } else {
+            // parsing the job blanks its arguments
+            snprintf( summary, sizeof(summary), "%s %s",
+                      (1 < argc) ? argv[1] : "", (2 < argc) ? argv[2] : "" );
+            jobs++;
+            if( 0 == serve_run(client, job, context, argc, argv, &status) &&
+                    !quiet ) {
+                fprintf( stderr, "job %u: %s ... status %d\n", jobs, summary,
+                         status );
+            }
+        }
+        close( client );
+    }
+
+    close( server );
+    unlink( path );
+    return SUCCESS;
+}
+
+#else
+
+int32_t serve_jobs( const char *path, serve_job_t job, void *context,
+                    bool quiet ) {
+    fprintf( stderr, "serve needs Unix domain sockets, "
+                     "which this build does not support.\n" );
+    return ARGUMENT_ERROR;
+}
+
+#endif
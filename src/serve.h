@@ -0,0 +1,67 @@
+/*
+ * dfu-programmer
+ *
+ * serve.h
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __SERVE_H__
+#define __SERVE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the longest job line and the most arguments it can have */
+#define SERVE_LINE_MAX          4096
+#define SERVE_ARGS_MAX          256
+
+/* how long the parts of a job took, in seconds */
+typedef struct {
+    double parse;           // parsing the command line
+    double open;            // finding and opening the device
+    double run;             // running the commands on it
+} serve_timing_t;
+
+/* runs one job, argv is a command line as it would be given to main.
+ * returns the exit status the command line would have had
+ */
+typedef int32_t (*serve_job_t)( void *context, int argc, char **argv,
+                                serve_timing_t *timing );
+
+int32_t serve_jobs( const char *path, serve_job_t job, void *context,
+                    bool quiet );
+/* listen on a Unix domain socket at path and run the jobs sent to it one at
+ * a time, until a job of just "quit".  a client connects, sends a single
+ * line holding the arguments (split at spaces, "" quotes one with spaces)
+ * and reads back a JSON line with the result and timings, followed by the
+ * "output" bytes the job wrote to stdout and the "log" bytes of stderr.
+ * jobs have no STDIN, images are given by path.  jobs run with the rights of
+ * the server, so the socket is made accessible to its owner only and anyone
+ * who can connect is trusted.  an existing socket at path is replaced.  returns 0 after quit, or an error code if the socket could
+ * not be set up (always on Windows, which has no Unix sockets here)
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * dfu-programmer
+ *
+ * sha256.c
+ *
+ * A small SHA-256 implementation, used to identify memory images by their
+ * content.
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sha256.h"
+
+#define ROTR(x, n)  (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// ________  P R O T O T Y P E S  _______________________________
+static void sha256_transform( sha256_context_t *ctx, const uint8_t *block );
+/* add one 64 byte block to the state */
+
+
+// ________  F U N C T I O N S  _______________________________
+static void sha256_transform( sha256_context_t *ctx, const uint8_t *block ) {
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, h;
+    uint32_t t1, t2;
+    int i;
+
+    for( i = 0; i < 16; i++ ) {
+        w[i] = ((uint32_t) block[4 * i] << 24) |
+               ((uint32_t) block[4 * i + 1] << 16) |
+               ((uint32_t) block[4 * i + 2] << 8) |
+                (uint32_t) block[4 * i + 3];
+    }
+    for( ; i < 64; i++ ) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = ctx->state[0]; b = ctx->state[1]; c = ctx->state[2]; d = ctx->state[3];
+    e = ctx->state[4]; f = ctx->state[5]; g = ctx->state[6]; h = ctx->state[7];
+
+    for( i = 0; i < 64; i++ ) {
+        t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) +
+             ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) +
+             ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c;
+    ctx->state[3] += d; ctx->state[4] += e; ctx->state[5] += f;
+    ctx->state[6] += g; ctx->state[7] += h;
+}
+
+void sha256_init( sha256_context_t *ctx ) {
+    ctx->state[0] = 0x6a09e667;
+    ctx->state[1] = 0xbb67ae85;
+    ctx->state[2] = 0x3c6ef372;
+    ctx->state[3] = 0xa54ff53a;
+    ctx->state[4] = 0x510e527f;
+    ctx->state[5] = 0x9b05688c;
+    ctx->state[6] = 0x1f83d9ab;
+    ctx->state[7] = 0x5be0cd19;
+    ctx->length = 0;
+}
+
+void sha256_update( sha256_context_t *ctx, const uint8_t *data, size_t length ) {
+    size_t used = (size_t) (ctx->length % SHA256_BLOCK_SIZE);
+    size_t fill;
+
+    ctx->length += length;
+
+    if( used ) {
+        fill = SHA256_BLOCK_SIZE - used;
+        if( length < fill ) {
+            memcpy( &ctx->block[used], data, length );
+            return;
+        }
+        memcpy( &ctx->block[used], data, fill );
+        sha256_transform( ctx, ctx->block );
+        data += fill;
+        length -= fill;
+    }
+
+    // whole blocks are hashed straight from the caller's data
+    while( length >= SHA256_BLOCK_SIZE ) {
+        sha256_transform( ctx, data );
+        data += SHA256_BLOCK_SIZE;
+        length -= SHA256_BLOCK_SIZE;
+    }
+
+    if( length ) {
+        memcpy( ctx->block, data, length );
+    }
+}
+
+void sha256_final( sha256_context_t *ctx, uint8_t digest[SHA256_DIGEST_SIZE] ) {
+    uint64_t bits = ctx->length * 8;
+    size_t used = (size_t) (ctx->length % SHA256_BLOCK_SIZE);
+    int i;
+
+    ctx->block[used++] = 0x80;
+    if( used > SHA256_BLOCK_SIZE - 8 ) {
+        memset( &ctx->block[used], 0, SHA256_BLOCK_SIZE - used );
+        sha256_transform( ctx, ctx->block );
+        used = 0;
+    }
+    memset( &ctx->block[used], 0, SHA256_BLOCK_SIZE - 8 - used );
+    for( i = 0; i < 8; i++ ) {
+        ctx->block[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t) (bits >> (8 * i));
+    }
+    sha256_transform( ctx, ctx->block );
+
+    for( i = 0; i < 32; i++ ) {
+        digest[i] = (uint8_t) (ctx->state[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
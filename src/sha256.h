@@ -0,0 +1,56 @@
+/*
+ * dfu-programmer
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA256_DIGEST_SIZE  32
+#define SHA256_BLOCK_SIZE   64
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;                    // bytes hashed so far
+    uint8_t block[SHA256_BLOCK_SIZE];   // partial block waiting for data
+} sha256_context_t;
+
+void sha256_init( sha256_context_t *ctx );
+/* start a new SHA-256 (FIPS 180-4) digest */
+
+void sha256_update( sha256_context_t *ctx, const uint8_t *data, size_t length );
+/* add length bytes of data to the digest */
+
+void sha256_final( sha256_context_t *ctx, uint8_t digest[SHA256_DIGEST_SIZE] );
+/* pad the message and write the 32 byte digest, ctx must be initialized
+ * again before it is reused
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,401 @@
+/*
+ * dfu-programmer
+ *
+ * srec.c
+ *
+ * Reads and writes Motorola S-record files (S19/S28/S37).  Data is put into
+ * and taken from the same buffers that are used for intel hex files.
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "srec.h"
+#include "util.h"
+
+struct srec_record {
+    uint8_t type;       // record type, 0 to 9
+    uint8_t count;      // number of data bytes (not the byte count field)
+    uint32_t address;   // two, three or four byte address
+    uint8_t data[256];
+};
+
+#define SREC_COLS 16
+#define SREC_HEADER_RECORD "S0030000FC\n"
+
+/* 'Stcc' + up to 255 address, data and checksum bytes + "\r\n" */
+#define SREC_MAX_LINE_LENGTH    (4 + 2 * 255 + 2)
+#define SREC_OUT_BUFFER_SIZE    0x10000
+
+struct srec_writer {
+    FILE *fp;           // where the output is flushed to
+    size_t used;        // number of characters waiting in data
+    char data[SREC_OUT_BUFFER_SIZE];
+};
+
+#define SREC_DEBUG_THRESHOLD    50
+#define SREC_TRACE_THRESHOLD    55
+
+#define DEBUG(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               SREC_DEBUG_THRESHOLD, __VA_ARGS__ )
+#define TRACE(...)  dfu_debug( __FILE__, __FUNCTION__, __LINE__, \
+                               SREC_TRACE_THRESHOLD, __VA_ARGS__ )
+
+// ________  P R O T O T Y P E S  _______________________________
+static int32_t srec_address_length( uint8_t type );
+/* return the number of address bytes used by a record type, or -1 if the
+ * type is not a valid S-record type
+ */
+
+static int32_t srec_read_record( FILE *fp, struct srec_record *record );
+/* read and validate the next record from fp.  blank lines are skipped.
+ * return 0 on success, 1 at the end of the file, negative on error
+ */
+
+static int32_t srec_make_line( struct srec_record *record, char *str );
+/* format record into str including the checksum and trailing newline.  the
+ * line is not null terminated, the number of characters is returned.  str
+ * must have room for SREC_MAX_LINE_LENGTH characters.
+ */
+
+static int32_t srec_write_record( struct srec_writer *out,
+                                  struct srec_record *record );
+/* format record into the output buffer, flushing the buffer first if it
+ * cannot hold another line.  return 0 on success, -1 on error
+ */
+
+static int32_t srec_flush( struct srec_writer *out );
+/* write everything waiting in the output buffer with a single fwrite.
+ * return 0 on success, -1 on a write error
+ */
+
+
+// ________  F U N C T I O N S  _______________________________
+static const char srec_hex_digits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+static int32_t srec_address_length( uint8_t type ) {
+    switch( type ) {
+        case 0: case 1: case 5: case 9:
+            return 2;
+        case 2: case 6: case 8:
+            return 3;
+        case 3: case 7:
+            return 4;
+        default:
+            return -1;
+    }
+}
+
+static int srec_nibble( char c ) {
+    if( '0' <= c && c <= '9' ) return c - '0';
+    if( 'A' <= c && c <= 'F' ) return c - 'A' + 10;
+    if( 'a' <= c && c <= 'f' ) return c - 'a' + 10;
+    return -1;
+}
+
+static int32_t srec_get_byte( const char *str ) {
+    int upper = srec_nibble( str[0] );
+    int lower = srec_nibble( str[1] );
+
+    if( upper < 0 || lower < 0 ) {
+        return -1;
+    }
+    return (upper << 4) | lower;
+}
+
+static int32_t srec_read_record( FILE *fp, struct srec_record *record ) {
+    char line[SREC_MAX_LINE_LENGTH + 2];
+    size_t length;
+    int32_t address_length;
+    int32_t value;
+    uint8_t count;
+    uint8_t sum;
+    uint8_t i;
+
+    do {
+        if( NULL == fgets(line, sizeof(line), fp) )         return 1;
+        length = strlen( line );
+        if( '\n' != line[length - 1] && !feof(fp) ) {
+            DEBUG( "Line is too long.\n" );                 return -1;
+        }
+        while( length && ('\n' == line[length - 1] ||
+                          '\r' == line[length - 1]) ) {
+            line[--length] = '\0';
+        }
+    } while( 0 == length );
+
+    /* 'Stcc' - record type and byte count */
+    if( length < 4 || 'S' != line[0] ||
+            line[1] < '0' || line[1] > '9' ) {
+        DEBUG( "Not an S-record.\n" );                      return -2;
+    }
+    record->type = (uint8_t) (line[1] - '0');
+    address_length = srec_address_length( record->type );
+    if( address_length < 0 ) {
+        DEBUG( "Unsupported record type S%u.\n", record->type );
+        return -3;
+    }
+
+    if( 0 > (value = srec_get_byte(&line[2])) )            return -4;
+    count = (uint8_t) value;
+    if( count < address_length + 1 ||
+            length != 4 + 2 * ((size_t) count) ) {
+        DEBUG( "Byte count 0x%02X does not match the line length.\n", count );
+        return -5;
+    }
+
+    /* the checksum byte is included in the sum, a valid record sums to 0xff */
+    sum = count;
+    record->address = 0;
+    record->count = (uint8_t) (count - address_length - 1);
+    for( i = 0; i < count; i++ ) {
+        if( 0 > (value = srec_get_byte(&line[4 + 2 * i])) ) return -4;
+        sum += (uint8_t) value;
+        if( i < address_length ) {
+            record->address = (record->address << 8) | ((uint32_t) value);
+        } else if( i - address_length < record->count ) {
+            record->data[i - address_length] = (uint8_t) value;
+        }
+    }
+
+    if( 0xff != sum ) {
+        DEBUG( "Checksum error.\n" );                       return -6;
+    }
+
+    return 0;
+}
+
+int32_t srec_to_buffer( FILE *fp, intel_buffer_out_t *bout,
+                        uint32_t target_offset, bool quiet ) {
+    struct srec_record record;
+    uint32_t address;
+    uint32_t line_count = 0;                // used for debugging srec file
+    int32_t  invalid_address_count = 0;     // used for error checking
+    int32_t result;
+    int i;
+
+    do {
+        line_count++;
+        result = srec_read_record( fp, &record );
+        if( 1 == result ) {
+            if( !quiet )
+                fprintf( stderr, "Error: no S7, S8 or S9 termination record.\n" );
+            return -4;
+        } else if( 0 != result ) {
+            if( !quiet )
+                fprintf( stderr, "Error reading line %u.\n", line_count );
+            return -5;
+        }
+
+        switch( record.type ) {
+            case 1:
+            case 2:
+            case 3:
+                for( address = record.address, i = 0;
+                        i < record.count; i++, address++ ) {
+                    if( 0 != intel_process_data(bout, record.data[i],
+                                target_offset, address) ) {
+                        // address was invalid
+                        if( !invalid_address_count && !quiet ) {
+                            fprintf( stderr,
+                                "WARNING (line %u): 0x%02x address outside valid region,\n",
+                                line_count, address );
+                            fprintf( stderr,
+                                " suppressing additional address error messages.\n" );
+                        }
+                        invalid_address_count++;
+                    }
+                }
+                break;
+            default:
+                /* header, count and termination records carry no data */
+                break;
+        }
+    } while( record.type < 7 );
+
+    if( invalid_address_count && !quiet ) {
+        fprintf( stderr, "Total of 0x%X bytes in invalid addressed.\n",
+                invalid_address_count );
+    }
+
+    return invalid_address_count;
+}
+
+// ___ CONVERT TO S-RECORDS __________________________
+static inline char *srec_put_byte( char *str, uint8_t value ) {
+    *str++ = srec_hex_digits[value >> 4];
+    *str++ = srec_hex_digits[value & 0x0f];
+    return str;
+}
+
+static int32_t srec_make_line( struct srec_record *record, char *str ) {
+    char *pos = str;
+    int32_t address_length = srec_address_length( record->type );
+    uint8_t count;
+    uint8_t sum;
+    uint8_t value;
+    int32_t i;
+
+    if( address_length < 0 ||
+            record->count > 255 - address_length - 1 ) {
+        DEBUG( "Can not make an S%u record with 0x%X bytes.\n",
+                record->type, record->count );
+        return -1;
+    }
+
+    count = (uint8_t) (record->count + address_length + 1);
+    sum = count;
+
+    *pos++ = 'S';
+    *pos++ = (char) ('0' + record->type);
+    pos = srec_put_byte( pos, count );
+    for( i = address_length - 1; i >= 0; i-- ) {
+        value = (uint8_t) (0xff & (record->address >> (8 * i)));
+        sum += value;
+        pos = srec_put_byte( pos, value );
+    }
+    for( i = 0; i < record->count; i++ ) {
+        sum += record->data[i];
+        pos = srec_put_byte( pos, record->data[i] );
+    }
+    pos = srec_put_byte( pos, (uint8_t) ~sum );
+    *pos++ = '\n';
+
+    return (int32_t) (pos - str);
+}
+
+static int32_t srec_flush( struct srec_writer *out ) {
+    if( out->used && out->used != fwrite(out->data, 1, out->used, out->fp) ) {
+        DEBUG( "Error writing 0x%X bytes of S-record output.\n",
+               (unsigned int) out->used );
+        out->used = 0;
+        return -1;
+    }
+    out->used = 0;
+    return 0;
+}
+
+static int32_t srec_write_record( struct srec_writer *out,
+                                  struct srec_record *record ) {
+    int32_t length;
+
+    if( sizeof(out->data) - out->used < SREC_MAX_LINE_LENGTH ) {
+        if( 0 != srec_flush(out) ) {
+            return -1;
+        }
+    }
+
+    length = srec_make_line( record, &out->data[out->used] );
+    if( length < 0 ) {
+        return -1;
+    }
+    out->used += (size_t) length;
+    return 0;
+}
+
+int32_t srec_from_buffer( intel_buffer_in_t *buin,
+                          bool force_full, uint32_t target_offset,
+                          uint8_t record_width ) {
+    struct srec_writer out;
+    struct srec_record record;
+    uint32_t last_address = target_offset + buin->info.data_end;
+    uint32_t i;
+    uint8_t data_type;
+    uint8_t max_width;
+    int32_t retval = 0;
+
+    // use the smallest address that reaches the end of the data
+    if( last_address <= 0xffff ) {
+        data_type = 1;
+    } else if( last_address <= 0xffffff ) {
+        data_type = 2;
+    } else {
+        data_type = 3;
+    }
+    max_width = (uint8_t) (255 - srec_address_length(data_type) - 1);
+
+    if( 0 == record_width ) {
+        record_width = SREC_COLS;
+    } else if( record_width > max_width ) {
+        DEBUG( "Record width limited to %u for S%u records.\n",
+                max_width, data_type );
+        record_width = max_width;
+    }
+
+    out.fp = stdout;
+    out.used = 0;
+
+    memcpy( out.data, SREC_HEADER_RECORD, sizeof(SREC_HEADER_RECORD) - 1 );
+    out.used += sizeof(SREC_HEADER_RECORD) - 1;
+
+    record.type = data_type;
+    record.count = 0;
+
+    for( i = buin->info.data_start; i <= buin->info.data_end; i++ ) {
+        if( i % buin->info.page_size == 0 && !(force_full) ) {
+            /* skip pages with no data, completing the current record */
+            if( buin->info.page_size ==
+                    intel_find_data(&buin->data[i], buin->info.page_size) ) {
+                if( record.count && 0 != srec_write_record(&out, &record) ) {
+                    retval = -2;
+                    goto finally;
+                }
+                record.count = 0;
+                i += buin->info.page_size - 1;
+                continue;
+            }
+        }
+        if( record.count == record_width ) {
+            if( 0 != srec_write_record(&out, &record) ) {
+                retval = -2;
+                goto finally;
+            }
+            record.count = 0;
+        }
+        if( 0 == record.count ) {
+            record.address = i + target_offset;
+        }
+        record.data[ record.count ] = buin->data[i];
+        record.count ++;
+    }
+    if( record.count && 0 != srec_write_record(&out, &record) ) {
+        retval = -2;
+        goto finally;
+    }
+
+    // S7 / S8 / S9 termination record with a zero start address
+    record.type = (uint8_t) (10 - data_type);
+    record.count = 0;
+    record.address = 0;
+    if( 0 != srec_write_record(&out, &record) ) {
+        retval = -2;
+        goto finally;
+    }
+
+finally:
+    if( (0 != srec_flush(&out) || 0 != fflush(out.fp)) && 0 == retval ) {
+        retval = -3;
+    }
+
+    return retval;
+}
@@ -0,0 +1,61 @@
+/*
+ * dfu-programmer
+ *
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __SREC_H__
+#define __SREC_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "intel_hex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int32_t srec_to_buffer( FILE *fp, intel_buffer_out_t *bout,
+        uint32_t target_offset, bool quiet );
+/*  Read Motorola S-records from an open file into bout, the same way
+ *  intel_hex_to_buffer does for intel hex.  S1/S2/S3 data records are
+ *  added with intel_process_data, S0/S5/S6 records are checked and ignored
+ *  and reading stops at the S7/S8/S9 termination record.
+ *
+ *  \return 0 = success
+ *          + = the number of data bytes outside the buffer that were ignored
+ *          - = error reading or validating a record
+ */
+
+int32_t srec_from_buffer( intel_buffer_in_t *buin,
+        bool force_full, uint32_t target_offset, uint8_t record_width );
+/*  Used to convert a buffer to a Motorola S-record file on stdout.  The
+ *  smallest of S1/S2/S3 records that can hold the highest address is used,
+ *  with the matching S9/S8/S7 termination record.
+ *  target offset is the address location of buffer 0
+ *  force_full sets whether to keep writing entirely blank pages.
+ *  record_width is the number of data bytes per record, 0 selects 16.  It is
+ *  limited to what fits in a record with the chosen address size.
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -30,6 +30,8 @@
 #include "dfu.h"
 #include "stm32.h"
 #include "util.h"
+#include "report.h"
+#include "progress.h"
 
 
 //___ M A C R O S   ( P R I V A T E ) ________________________________________
@@ -79,18 +81,19 @@ static int32_t stm32_read_block( dfu_device_t *device,
   /* read a block of memory, assumes address pointer is already set
    */
 
-static inline void print_progress( intel_buffer_info_t *info,
-                    uint32_t *progress );
-  /* calculate how many progress indicator steps to print and print them
-   * update progress value
-   */
-
 static int32_t stm32_erase( dfu_device_t *device, uint8_t *command,
                             uint8_t command_length, bool quiet );
   /* erase, erase page, and read unprotect all share this functionality
    * although with different commands
    */
 
+static int32_t stm32_write_blocks( dfu_device_t *device,
+                                   intel_buffer_out_t *bout );
+  /* write the assigned data from info.data_start to info.data_end in
+   * blocks, updating the progress.  returns SUCCESS, DEVICE_ACCESS_ERROR if
+   * the address can not be set or FLASH_WRITE_ERROR
+   */
+
 
 //___ V A R I A B L E S ______________________________________________________
 extern int debug;       /* defined in libdfu.c */
@@ -261,16 +264,6 @@ static int32_t stm32_read_block( dfu_device_t *device,
   return 0;
 }
 
-static inline void print_progress( intel_buffer_info_t *info,
-                                     uint32_t *progress ) {
-  if ( !(debug > STM32_DEBUG_THRESHOLD) ) {
-    while ( ((info->block_end - info->data_start + 1) * 32) > *progress ) {
-      fprintf( stderr, ">" );
-      *progress += info->data_end - info->data_start + 1;
-    }
-  }
-}
-
 static int32_t stm32_erase( dfu_device_t *device, uint8_t *command,
                             uint8_t command_length, bool quiet ) {
   int32_t status;
@@ -373,7 +366,6 @@ int32_t stm32_read_flash( dfu_device_t *device, intel_buffer_in_t *buin,
   uint32_t address_offset;  // keep record of sent progress as bytes * 32
   uint16_t  xfer_size = 0;      // the size of a transfer
   uint8_t mem_section = 0;       // tracks the current memory page
-  uint32_t progress = 0;      // used to indicate progress
   int32_t status;
   int32_t retval = UNSPECIFIED_ERROR;   // the return value for this function
 
@@ -384,18 +376,9 @@ int32_t stm32_read_flash( dfu_device_t *device, intel_buffer_in_t *buin,
     return ARGUMENT_ERROR;
   }
 
-  if( !quiet ) {
-    if( debug <= STM32_DEBUG_THRESHOLD ) {
-      /* NOTE: From here on we should go to finally on error */
-      fprintf( stderr, "[================================] " );
-    }
-    fprintf( stderr, "Reading 0x%X bytes...\n",
-        buin->info.data_end - buin->info.data_start + 1 );
-    if( debug <= STM32_DEBUG_THRESHOLD ) {
-      /* NOTE: From here on we should go to finally on error */
-      fprintf( stderr, "[" );
-    }
-  }
+  /* NOTE: From here on we should go to finally on error */
+  progress_begin( "Reading", buin->info.data_end - buin->info.data_start + 1,
+      quiet, debug <= STM32_DEBUG_THRESHOLD );
 
   /* read the data */
   buin->info.block_start = buin->info.data_start;
@@ -431,7 +414,7 @@ int32_t stm32_read_flash( dfu_device_t *device, intel_buffer_in_t *buin,
     }
 
     if( (status = stm32_read_block( device, xfer_size,
-            &buin->data[buin->info.block_start] )) ) {
+            &buin->data[buin->info.block_start - buin->base] )) ) {
       DEBUG( "Error reading block 0x%X to 0x%X: err %d.\n",
           buin->info.block_start, buin->info.block_end, status );
       retval = ( status == -10 ) ? DEVICE_ACCESS_ERROR : FLASH_READ_ERROR;
@@ -447,21 +430,16 @@ int32_t stm32_read_flash( dfu_device_t *device, intel_buffer_in_t *buin,
       reset_address_flag = 1;
     }
 
-    if( !quiet ) print_progress( &buin->info, &progress );
+    progress_update( buin->info.block_end - buin->info.data_start + 1 );
   }
   retval = SUCCESS;
 
 finally:
+  progress_end( SUCCESS == retval );
   if ( !quiet ) {
     if( SUCCESS == retval ) {
-      if ( debug <= STM32_DEBUG_THRESHOLD ) {
-        fprintf( stderr, "] " );
-      }
       fprintf( stderr, "SUCCESS\n" );
     } else {
-      if ( debug <= STM32_DEBUG_THRESHOLD ) {
-        fprintf( stderr, " X  ");
-      }
       fprintf( stderr, "ERROR\n" );
       if( retval==DEVICE_ACCESS_ERROR )
         fprintf( stderr,
@@ -474,6 +452,83 @@ finally:
   return retval;
 }
 
+static int32_t stm32_write_blocks( dfu_device_t *device,
+                                   intel_buffer_out_t *bout ) {
+  uint32_t i;
+  uint32_t address_offset;  // keep record of sent progress as bytes * 32
+  uint8_t  reset_address_flag;  // reset address offset required
+  uint16_t  xfer_size = 0;      // the size of a transfer
+  uint8_t mem_section = 0;   // tracks the current memory page
+  uint8_t buffer[STM32_MAX_TRANSFER_SIZE];     // buffer holding out data
+  int32_t status;
+
+  bout->info.block_start = bout->info.data_start;
+  reset_address_flag = 1;
+
+  while( bout->info.block_start <= bout->info.data_end ) {
+    if( reset_address_flag ) {
+      address_offset = bout->info.block_start;
+      if( (status = stm32_set_address_ptr(device,
+              STM32_FLASH_OFFSET + address_offset)) ) {
+        DEBUG("Error setting address 0x%X\n", address_offset);
+        return DEVICE_ACCESS_ERROR;
+      }
+      dfu_set_transaction_num( device, 2 ); /* sets block offset 0 */
+      reset_address_flag = 0;
+    }
+
+    /* find end address (info.block_end) for data section to write */
+    mem_section = bout->info.block_start / STM32_MIN_SECTOR_BOUND;
+    for( i = 0, bout->info.block_end = bout->info.block_start;
+         bout->info.block_end <= bout->info.data_end;
+         bout->info.block_end++, i++ ) {
+      xfer_size = bout->info.block_end - bout->info.block_start + 1;
+      // check if the current value is valid
+      if( bout->data[bout->info.block_end] > UINT8_MAX ) break;
+      // check if the current data packet is too big
+      if( xfer_size > STM32_MAX_TRANSFER_SIZE ) break;
+      // check if the current data value is outside of the memory sector
+      if( bout->info.block_end / STM32_MIN_SECTOR_BOUND - mem_section ) break;
+
+      buffer[i] = (uint8_t) bout->data[bout->info.block_end];
+    }
+    bout->info.block_end--; // bout->info.block_end was one step beyond the last data value to flash
+    xfer_size = bout->info.block_end - bout->info.block_start + 1;
+    if( xfer_size != STM32_MAX_TRANSFER_SIZE ) {
+      DEBUG("xfer_size %u not max %u, need addr reset\n",
+          xfer_size, STM32_MAX_TRANSFER_SIZE);
+      reset_address_flag = 1;
+    }
+
+    /* write the data */
+    DEBUG("Program data block: 0x%X to 0x%X, 0x%X bytes.\n",
+        bout->info.block_start, bout->info.block_end, xfer_size);
+
+    if( (status = stm32_write_block( device, xfer_size, buffer )) ) {
+      DEBUG( "Error flashing the block: err %d.\n", status );
+      return FLASH_WRITE_ERROR;
+    }
+
+    // increment bout->info.block_start to the next valid address
+    bout->info.block_start = bout->info.block_end + 1;
+    bout->info.block_start += intel_find_assigned(
+        &bout->data[bout->info.block_start],
+        bout->info.data_end - bout->info.block_end );
+    // bout->info.block_start is now on the first valid data for the next segment
+
+    if( reset_address_flag == 0 && (bout->info.block_start !=
+        (STM32_MAX_TRANSFER_SIZE * (dfu_get_transaction_num( device ) - 2))
+        + address_offset) ) {
+      DEBUG("block start does not match addr, reset req\n");
+      reset_address_flag = 1;
+    }
+
+    progress_update( bout->info.block_end - bout->info.data_start + 1 );
+  }
+
+  return SUCCESS;
+}
+
 int32_t stm32_write_flash( dfu_device_t *device, intel_buffer_out_t *bout,
     const bool eeprom, const bool force, const bool quiet ) {
   TRACE( "%s( %p, %p, %s, %s )\n", __FUNCTION__, device, bout,
@@ -481,14 +536,9 @@ int32_t stm32_write_flash( dfu_device_t *device, intel_buffer_out_t *bout,
           ((true == quiet) ? "true" : "false") );
 
   uint32_t i;
-  uint32_t progress = 0;    // keep record of sent progress as bytes * 32
-  uint32_t address_offset;  // keep record of sent progress as bytes * 32
-  uint8_t  reset_address_flag;  // reset address offset required
-  uint16_t  xfer_size = 0;      // the size of a transfer
-  uint8_t mem_section = 0;   // tracks the current memory page
   int32_t retval = UNSPECIFIED_ERROR;   // the return value for this function
-  uint8_t buffer[STM32_MAX_TRANSFER_SIZE];     // buffer holding out data
-  int32_t status;
+
+  report_phase( "write" );
 
   /* check arguments */
   if( (NULL == device) || (NULL == bout) ) {
@@ -515,12 +565,11 @@ int32_t stm32_write_flash( dfu_device_t *device, intel_buffer_out_t *bout,
 
   /* determine the limits of where actual data resides in the buffer */
   bout->info.data_start = UINT32_MAX;
-  for( i = 0; i < bout->info.total_size; i++ ) {
-    if( bout->data[i] <= UINT8_MAX ) {
-      bout->info.data_end = i;
-      if( bout->info.data_start == UINT32_MAX )
-        bout->info.data_start = i;
-    }
+  i = intel_find_assigned( bout->data, bout->info.total_size );
+  if( i != bout->info.total_size ) {
+    bout->info.data_start = i;
+    bout->info.data_end = intel_find_assigned_last( bout->data,
+                                                    bout->info.total_size );
   }
 
   /* debug info about data limits */
@@ -555,99 +604,18 @@ int32_t stm32_write_flash( dfu_device_t *device, intel_buffer_out_t *bout,
     return BUFFER_INIT_ERROR;
   }
 
-  if( !quiet ) {
-    if( debug <= STM32_DEBUG_THRESHOLD ) {
-      /* NOTE: from here on we should run finally block */
-      fprintf( stderr, "[================================] " );
-    }
-    fprintf( stderr, "Programming 0x%X bytes...\n",
-        bout->info.data_end - bout->info.data_start + 1 );
-    if( debug <= STM32_DEBUG_THRESHOLD ) {
-      /* NOTE: from here on we need to run finally block */
-      fprintf( stderr, "[" );
-    }
-  }
+  progress_begin( "Programming",
+      bout->info.data_end - bout->info.data_start + 1,
+      quiet, debug <= STM32_DEBUG_THRESHOLD );
 
   /* program the data */
-  bout->info.block_start = bout->info.data_start;
-  reset_address_flag = 1;
-
-  while( bout->info.block_start <= bout->info.data_end ) {
-    if( reset_address_flag ) {
-      address_offset = bout->info.block_start;
-      if( (status = stm32_set_address_ptr(device,
-              STM32_FLASH_OFFSET + address_offset)) ) {
-        DEBUG("Error setting address 0x%X\n", address_offset);
-        retval = DEVICE_ACCESS_ERROR;
-        goto finally;
-      }
-      dfu_set_transaction_num( device, 2 ); /* sets block offset 0 */
-      reset_address_flag = 0;
-    }
-
-    /* find end address (info.block_end) for data section to write */
-    mem_section = bout->info.block_start / STM32_MIN_SECTOR_BOUND;
-    for( i = 0, bout->info.block_end = bout->info.block_start;
-         bout->info.block_end <= bout->info.data_end;
-         bout->info.block_end++, i++ ) {
-      xfer_size = bout->info.block_end - bout->info.block_start + 1;
-      // check if the current value is valid
-      if( bout->data[bout->info.block_end] > UINT8_MAX ) break;
-      // check if the current data packet is too big
-      if( xfer_size > STM32_MAX_TRANSFER_SIZE ) break;
-      // check if the current data value is outside of the memory sector
-      if( bout->info.block_end / STM32_MIN_SECTOR_BOUND - mem_section ) break;
-
-      buffer[i] = (uint8_t) bout->data[bout->info.block_end];
-    }
-    bout->info.block_end--; // bout->info.block_end was one step beyond the last data value to flash
-    xfer_size = bout->info.block_end - bout->info.block_start + 1;
-    if( xfer_size != STM32_MAX_TRANSFER_SIZE ) {
-      DEBUG("xfer_size %u not max %u, need addr reset\n",
-          xfer_size, STM32_MAX_TRANSFER_SIZE);
-      reset_address_flag = 1;
-    }
-
-    /* write the data */
-    DEBUG("Program data block: 0x%X to 0x%X, 0x%X bytes.\n",
-        bout->info.block_start, bout->info.block_end, xfer_size);
-
-    if( (status = stm32_write_block( device, xfer_size, buffer )) ) {
-      DEBUG( "Error flashing the block: err %d.\n", status );
-      retval = FLASH_WRITE_ERROR;
-      goto finally;
-    }
-
-    // increment bout->info.block_start to the next valid address
-    for( bout->info.block_start = bout->info.block_end + 1;
-         bout->info.block_start <= bout->info.data_end;
-         bout->info.block_start++ ) {
-      if( (bout->data[bout->info.block_start] <= UINT8_MAX) ) break;
-    } // bout->info.block_start is now on the first valid data for the next segment
-
-    if( reset_address_flag == 0 && (bout->info.block_start !=
-        (STM32_MAX_TRANSFER_SIZE * (dfu_get_transaction_num( device ) - 2))
-        + address_offset) ) {
-      DEBUG("block start does not match addr, reset req\n");
-      reset_address_flag = 1;
-    }
-
-    // display progress in 32 increments (if not hidden)
-    if ( !quiet ) print_progress( &bout->info, &progress );
-  }
-  retval = SUCCESS;
+  retval = stm32_write_blocks( device, bout );
 
-finally:
+  progress_end( SUCCESS == retval );
   if ( !quiet ) {
     if( SUCCESS == retval ) {
-      if ( debug <= STM32_DEBUG_THRESHOLD ) {
-        fprintf( stderr, "] " );
-      }
       fprintf( stderr, "SUCCESS\n" );
     } else {
-      if ( debug <= STM32_DEBUG_THRESHOLD ) {
-        fprintf( stderr, " X  ");
-      }
       fprintf( stderr, "ERROR\n" );
       if( retval==DEVICE_ACCESS_ERROR )
         fprintf( stderr,
@@ -661,6 +629,48 @@ finally:
   return retval;
 }
 
+int32_t stm32_write_range( dfu_device_t *device, intel_buffer_out_t *bout,
+    const uint32_t start, const uint32_t end ) {
+  TRACE( "%s( %p, %p, 0x%X, 0x%X )\n", __FUNCTION__, device, bout,
+      start, end );
+
+  intel_buffer_info_t info;
+  uint32_t first;
+  int32_t retval;
+
+  if( (NULL == device) || (NULL == bout) || (start > end) ||
+      (end >= bout->info.total_size) ) {
+    DEBUG( "ERROR: Invalid arguments.\n" );
+    return ARGUMENT_ERROR;
+  }
+
+  intel_flash_prep_pages( bout, start, end );
+
+  first = intel_find_assigned( &bout->data[start], end - start + 1 );
+  if( first == end - start + 1 ) {
+    return SUCCESS;
+  }
+
+  /* the caller keeps the data limits of the whole image in bout->info */
+  info = bout->info;
+  bout->info.data_start = start + first;
+  bout->info.data_end = start + intel_find_assigned_last( &bout->data[start],
+                                                          end - start + 1 );
+  DEBUG( "Program range 0x%X to 0x%X.\n",
+      bout->info.data_start, bout->info.data_end );
+
+  if( (bout->info.data_start < bout->info.valid_start) ||
+      (bout->info.data_end > bout->info.valid_end) ) {
+    DEBUG( "ERROR: Data exists outside of the valid target flash region.\n" );
+    retval = BUFFER_INIT_ERROR;
+  } else {
+    retval = stm32_write_blocks( device, bout );
+  }
+
+  bout->info = info;
+  return retval;
+}
+
 int32_t stm32_get_commands( dfu_device_t *device ) {
   TRACE("%s( %p )\n", __FUNCTION__, device);
   int32_t result;
@@ -93,6 +93,14 @@ int32_t stm32_write_flash( dfu_device_t *device, intel_buffer_out_t *bout,
    * hide_progress bool sets whether to display progress
    */
 
+int32_t stm32_write_range( dfu_device_t *device, intel_buffer_out_t *bout,
+    const uint32_t start, const uint32_t end );
+  /* flash the data in bout from start to end (inclusive, whole pages) like
+   * stm32_write_flash, without any output, for writing an image a part at a
+   * time.  returns SUCCESS, BUFFER_INIT_ERROR if the data is outside the
+   * valid region or the error of the write
+   */
+
 int32_t stm32_get_commands( dfu_device_t *device );
   /* @brief get the commands list, should be length 4
    * @param device pointer
@@ -22,6 +22,9 @@
 #define __UTIL_H__
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,6 +33,25 @@ extern "C" {
 void dfu_debug( const char *file, const char *function, const int line,
                 const int level, const char *format, ... );
 
+#define DFU_CRC32_INIT  0xffffffff
+
+uint32_t dfu_crc32( uint32_t crc, const uint8_t *data, size_t length );
+/* continue a CRC-32 (IEEE 802.3) over length bytes of data and return it.
+ * start with DFU_CRC32_INIT.  a DFU file suffix stores the result as is,
+ * the usual CRC-32 (zip, ethernet) is the result xor 0xffffffff.
+ */
+
+uint8_t *dfu_read_all( FILE *fp, size_t *size );
+/* read the rest of fp into a newly allocated buffer, for file formats that
+ * need random access since STDIN can not seek.  the caller frees the buffer.
+ * return the buffer and its length in size, NULL on a read or memory error
+ */
+
+double dfu_time( void );
+/* seconds from an arbitrary fixed point, only differences are meaningful.
+ * it never goes backwards, for timing the phases of a command
+ */
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,53 @@
-import { describe, expect, test } from "@jest/globals";
+import { afterAll, beforeAll, describe, expect, test } from "@jest/globals";
+import { createHash } from "crypto";
+import { mkdtempSync, rmSync, writeFileSync } from "fs";
+import { tmpdir } from "os";
+import { join } from "path";
 import { runDfu } from "./util/dfu";
 
+// We currently use a consistent line ending for all platforms
+const EOL = "\n";
+
+// Conversions use a fixed target so the expected output does not depend on $TARGET
+const target = "atmega8u2";
+
+/**
+ * Give the tests of the current describe block a temporary directory, removed after them.
+ *
+ * Returns a function that makes the path of a file in it, writing the file if data is given.
+ */
+function tempFiles() {
+  let dir = "";
+  beforeAll(() => {
+    dir = mkdtempSync(join(tmpdir(), "dfu-programmer-"));
+  });
+  afterAll(() => rmSync(dir, { recursive: true, force: true }));
+
+  return (name: string, data?: string | Buffer) => {
+    const path = join(dir, name);
+    if (data !== undefined) writeFileSync(path, data);
+    return path;
+  };
+}
+
+/**
+ * An image of length bytes counting up from 0.
+ */
+function counting(length: number) {
+  return Buffer.from(Array.from({ length }, (_, i) => i & 0xff));
+}
+
+/**
+ * counting(0x28) as Intel HEX.
+ */
+const countingHex = [
+  ":10000000000102030405060708090A0B0C0D0E0F78",
+  ":10001000101112131415161718191A1B1C1D1E1F68",
+  ":080020002021222324252627BC",
+  ":00000001FF",
+  "",
+].join(EOL);
+
 /**
  * Standalone tests that should work without any hardware connected.
  */
@@ -44,3 +91,445 @@ describe("standalone", () => {
     // ...
   });
 });
+
+describe("bin2hex and hex2bin", () => {
+  const file = tempFiles();
+
+  test("bin2hex writes a binary as Intel HEX", async () => {
+    const res = runDfu([target, "bin2hex", file("counting.bin", counting(0x28))]);
+    expect(await res.exitCode).toBe(0);
+    const { stdout, stderr } = res;
+
+    expect(stdout).toBe(countingHex);
+    expect(stderr).toBe(`Read 0x28 bytes, making hex with address offset 0x0.${EOL}`);
+  });
+
+  test("hex2bin writes the bytes of Intel HEX", async () => {
+    const res = runDfu([target, "hex2bin", file("counting.hex", countingHex)]);
+    expect(await res.exitCode).toBe(0);
+    const { stdoutBytes, stderr } = res;
+
+    expect(stdoutBytes).toEqual(counting(0x28));
+    expect(stderr).toBe(`Dumping 0x28 bytes from address offset 0x0.${EOL}`);
+  });
+
+  test("bin2hex and hex2bin round trip an image with a blank gap", async () => {
+    const image = Buffer.from(Array.from({ length: 0x1000 }, (_, i) => (i * 7 + 3) & 0xff));
+    image.fill(0xff, 0x400, 0x900);
+
+    const toHex = runDfu([target, "bin2hex", "--quiet", file("gap.bin", image)]);
+    expect(await toHex.exitCode).toBe(0);
+    // the blank gap is left out
+    expect(toHex.stdout).not.toMatch(/FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF/);
+
+    const toBin = runDfu([target, "hex2bin", "--quiet", file("gap.hex", toHex.stdout)]);
+    expect(await toBin.exitCode).toBe(0);
+    expect(toBin.stdoutBytes).toEqual(image);
+  });
+
+  test("bin2hex fails for a missing file", async () => {
+    const res = runDfu([target, "bin2hex", file("missing.bin")]);
+    expect(await res.exitCode).toBe(2);
+    const { stdout, stderr } = res;
+
+    expect(stdout).toBe("");
+    expect(stderr).toBe(`Error opening ${file("missing.bin")}${EOL}`);
+  });
+});
+
+describe("hex record layout", () => {
+  const file = tempFiles();
+
+  test("--record-width sets the data bytes in each record", async () => {
+    const res = runDfu([target, "bin2hex", "--record-width=8", "--quiet", file("counting.bin", counting(0x28))]);
+    expect(await res.exitCode).toBe(0);
+
+    expect(res.stdout).toBe(
+      [
+        ":080000000001020304050607DC",
+        ":0800080008090A0B0C0D0E0F94",
+        ":0800100010111213141516174C",
+        ":0800180018191A1B1C1D1E1F04",
+        ":080020002021222324252627BC",
+        ":00000001FF",
+        "",
+      ].join(EOL)
+    );
+  });
+
+  test("--record-width is limited to 255", async () => {
+    const res = runDfu([target, "bin2hex", "--record-width=256", file("counting.bin", counting(0x28))]);
+    expect(await res.exitCode).toBe(2);
+
+    expect(res.stdout).toBe("");
+    expect(res.stderr).toMatch(/^record width must be from 1 to 255$/im);
+  });
+
+  // 0x10000 is 257 records of 255 bytes, the last of them starts at 0xFFFF
+  const segments = counting(0x10010);
+
+  test("records are split at 64kB boundaries", async () => {
+    const res = runDfu(["at90usb1287", "bin2hex", "--record-width=255", "--quiet", file("segments.bin", segments)]);
+    expect(await res.exitCode).toBe(0);
+    const lines = res.stdout.split(EOL);
+
+    expect(lines.slice(0, -5).every((line) => line.startsWith(":FF"))).toBe(true);
+    expect(lines.slice(-5)).toEqual([
+      ":01FFFF00FF02",
+      ":020000040001F9",
+      ":10000000000102030405060708090A0B0C0D0E0F78",
+      ":00000001FF",
+      "",
+    ]);
+  });
+
+  test("--minimal-04 lets a record run across a 64kB boundary", async () => {
+    const res = runDfu([
+      "at90usb1287",
+      "bin2hex",
+      "--record-width=255",
+      "--minimal-04",
+      "--quiet",
+      file("segments.bin", segments),
+    ]);
+    expect(await res.exitCode).toBe(0);
+    const lines = res.stdout.split(EOL);
+
+    // no record starts in the second segment, so it needs no 04 record
+    expect(lines.some((line) => line.startsWith(":02000004"))).toBe(false);
+    expect(lines.slice(-3)).toEqual([":11FFFF00FF000102030405060708090A0B0C0D0E0F7A", ":00000001FF", ""]);
+  });
+});
+
+describe("Motorola S-records", () => {
+  const file = tempFiles();
+
+  const srec = [
+    "S0030000FC",
+    "S1130000000102030405060708090A0B0C0D0E0F74",
+    "S1130010101112131415161718191A1B1C1D1E1F64",
+    "S10B00202021222324252627B8",
+    "S9030000FC",
+    "",
+  ].join(EOL);
+
+  test("bin2hex --srec writes S1 records", async () => {
+    const res = runDfu([target, "bin2hex", "--srec", file("counting.bin", counting(0x28))]);
+    expect(await res.exitCode).toBe(0);
+    const { stdout, stderr } = res;
+
+    expect(stdout).toBe(srec);
+    expect(stderr).toBe(`Read 0x28 bytes, making S-records with address offset 0x0.${EOL}`);
+  });
+
+  test("bin2hex --srec uses S2 records above 64kB", async () => {
+    const res = runDfu(["at90usb1287", "bin2hex", "--srec", "--quiet", file("segments.bin", counting(0x10010))]);
+    expect(await res.exitCode).toBe(0);
+    const lines = res.stdout.split(EOL);
+
+    expect(lines[1]).toBe("S214000000000102030405060708090A0B0C0D0E0F73");
+    expect(lines.slice(-3)).toEqual(["S214010000000102030405060708090A0B0C0D0E0F72", "S804000000FB", ""]);
+  });
+
+  test("S-records compile to the same requests as Intel HEX", async () => {
+    const fromHex = runDfu([target, "compile", "--quiet", file("counting.hex", countingHex)]);
+    const fromSrec = runDfu([target, "compile", "--quiet", file("counting.srec", srec)]);
+    expect(await fromHex.exitCode).toBe(0);
+    expect(await fromSrec.exitCode).toBe(0);
+
+    expect(fromSrec.stdoutBytes).toEqual(fromHex.stdoutBytes);
+  });
+
+  test("an S-record with a bad checksum is rejected", async () => {
+    const res = runDfu([target, "compile", file("bad.srec", srec.replace("2627B8", "2627B9"))]);
+    expect(await res.exitCode).toBe(4);
+    const { stdout, stderr } = res;
+
+    expect(stdout).toBe("");
+    expect(stderr).toMatch(/^Error reading line 4\.$/m);
+  });
+});
+
+/**
+ * A little endian 32 bit ELF executable for AVR with a PT_LOAD program header for each segment.
+ */
+function elf(segments: { address: number; data: Buffer }[], type = 2) {
+  const header = Buffer.alloc(52 + 32 * segments.length);
+  header.write("\x7fELF", 0, "latin1");
+  header[4] = 1; // 32 bit
+  header[5] = 1; // little endian
+  header[6] = 1; // version
+  header.writeUInt16LE(type, 16);
+  header.writeUInt16LE(0x53, 18); // AVR
+  header.writeUInt32LE(1, 20);
+  header.writeUInt32LE(52, 28); // program headers follow this one
+  header.writeUInt16LE(52, 40);
+  header.writeUInt16LE(32, 42);
+  header.writeUInt16LE(segments.length, 44);
+
+  let offset = header.length;
+  segments.forEach(({ address, data }, i) => {
+    const phdr = 52 + 32 * i;
+    header.writeUInt32LE(1, phdr); // PT_LOAD
+    header.writeUInt32LE(offset, phdr + 4);
+    header.writeUInt32LE(address, phdr + 8);
+    header.writeUInt32LE(address, phdr + 12);
+    header.writeUInt32LE(data.length, phdr + 16);
+    header.writeUInt32LE(data.length, phdr + 20);
+    header.writeUInt32LE(5, phdr + 24); // read and execute
+    header.writeUInt32LE(1, phdr + 28);
+    offset += data.length;
+  });
+
+  return Buffer.concat([header, ...segments.map(({ data }) => data)]);
+}
+
+describe("ELF input", () => {
+  const file = tempFiles();
+
+  const eeprom = Buffer.from([0xde, 0xad, 0xbe, 0xef]);
+  const program = elf([
+    { address: 0, data: counting(0x28) },
+    // where avr-gcc links the .eeprom section
+    { address: 0x810000, data: eeprom },
+  ]);
+
+  test("flash data of an ELF compiles to the same requests as Intel HEX", async () => {
+    const fromHex = runDfu([target, "compile", "--quiet", file("counting.hex", countingHex)]);
+    const fromElf = runDfu([target, "compile", "--quiet", file("program.elf", program)]);
+    expect(await fromHex.exitCode).toBe(0);
+    expect(await fromElf.exitCode).toBe(0);
+
+    expect(fromElf.stdoutBytes).toEqual(fromHex.stdoutBytes);
+  });
+
+  test("the eeprom segment of an ELF compiles like a binary of it", async () => {
+    const fromBin = runDfu([target, "compile", "--eeprom", "--bin", "--quiet", file("eeprom.bin", eeprom)]);
+    const fromElf = runDfu([target, "compile", "--eeprom", "--quiet", file("program.elf", program)]);
+    expect(await fromBin.exitCode).toBe(0);
+    expect(await fromElf.exitCode).toBe(0);
+
+    expect(fromElf.stdoutBytes).toEqual(fromBin.stdoutBytes);
+  });
+
+  test("an ELF object that is not linked is rejected", async () => {
+    const res = runDfu([target, "compile", file("object.elf", elf([{ address: 0, data: counting(0x28) }], 1))]);
+    expect(await res.exitCode).toBe(4);
+    const { stdout, stderr } = res;
+
+    expect(stdout).toBe("");
+    expect(stderr).toMatch(/^ELF file is not an executable \(not linked\?\)\.$/m);
+  });
+});
+
+/**
+ * The CRC of a DFU file suffix: CRC-32 of everything before it, without the final inversion.
+ */
+function dfuCrc(data: Buffer) {
+  let crc = 0xffffffff;
+  for (const byte of data) {
+    crc ^= byte;
+    for (let bit = 0; bit < 8; bit++) crc = crc & 1 ? (crc >>> 1) ^ 0xedb88320 : crc >>> 1;
+  }
+  return crc >>> 0;
+}
+
+describe("DfuSe files", () => {
+  const file = tempFiles();
+
+  test("bin2hex --dfuse writes one element in an alternate setting 0 image", async () => {
+    const res = runDfu([target, "bin2hex", "--dfuse", file("counting.bin", counting(0x28))]);
+    expect(await res.exitCode).toBe(0);
+    const { stdoutBytes: dfu, stderr } = res;
+
+    expect(stderr).toBe(`Read 0x28 bytes, making a DfuSe file with address offset 0x0.${EOL}`);
+
+    // prefix: signature, version, size without the suffix and one image
+    expect(dfu.toString("latin1", 0, 5)).toBe("DfuSe");
+    expect(dfu[5]).toBe(1);
+    expect(dfu.readUInt32LE(6)).toBe(dfu.length - 16);
+    expect(dfu[10]).toBe(1);
+
+    // image: alternate setting 0, its name and a single element
+    expect(dfu.toString("latin1", 11, 17)).toBe("Target");
+    expect(dfu[17]).toBe(0);
+    expect(dfu.toString("latin1", 22, 37)).toBe("Internal Flash\0");
+    expect(dfu.readUInt32LE(281)).toBe(1);
+    expect(dfu.readUInt32LE(285)).toBe(0);
+    expect(dfu.readUInt32LE(289)).toBe(0x28);
+    expect(dfu.subarray(293, 293 + 0x28)).toEqual(counting(0x28));
+
+    // suffix: device 0xFFFF, product 0x2FEE and vendor 0x03EB of the target, DFU 1.1a
+    expect(dfu.length).toBe(293 + 0x28 + 16);
+    expect(dfu.subarray(-16, -4).toString("hex")).toBe("ffffee2feb031a0155464410");
+    expect(dfu.readUInt32LE(dfu.length - 4)).toBe(dfuCrc(dfu.subarray(0, -4)));
+  });
+
+  test("a DfuSe file compiles to the same requests as Intel HEX", async () => {
+    const toDfu = runDfu([target, "bin2hex", "--dfuse", "--quiet", file("counting.bin", counting(0x28))]);
+    expect(await toDfu.exitCode).toBe(0);
+
+    const fromHex = runDfu([target, "compile", "--quiet", file("counting.hex", countingHex)]);
+    const fromDfu = runDfu([target, "compile", "--quiet", file("counting.dfu", toDfu.stdoutBytes)]);
+    expect(await fromHex.exitCode).toBe(0);
+    expect(await fromDfu.exitCode).toBe(0);
+
+    expect(fromDfu.stdoutBytes).toEqual(fromHex.stdoutBytes);
+  });
+
+  test("a DfuSe file with a bad CRC is rejected", async () => {
+    const toDfu = runDfu([target, "bin2hex", "--dfuse", "--quiet", file("counting.bin", counting(0x28))]);
+    expect(await toDfu.exitCode).toBe(0);
+    const corrupt = Buffer.from(toDfu.stdoutBytes);
+    corrupt[300] ^= 1;
+
+    const res = runDfu([target, "compile", file("corrupt.dfu", corrupt)]);
+    expect(await res.exitCode).toBe(4);
+    const { stdout, stderr } = res;
+
+    expect(stdout).toBe("");
+    expect(stderr).toMatch(/^DfuSe file CRC mismatch, 0x[0-9A-F]{8} expected 0x[0-9A-F]{8}\.$/m);
+  });
+});
+
+describe("compile", () => {
+  const file = tempFiles();
+
+  test("compile writes a flash bundle of the requests flash would send", async () => {
+    const res = runDfu([target, "compile", file("counting.hex", countingHex)]);
+    expect(await res.exitCode).toBe(0);
+    const { stdoutBytes: bundle, stderr } = res;
+
+    expect(stderr).toBe(`Compiled 0x80 bytes into 4 requests.${EOL}`);
+
+    // header: magic, version, header size, vendor and product of the target, then the memory layout
+    expect(bundle.toString("latin1", 0, 8)).toBe("DFUBUNDL");
+    const field = (offset: number) => bundle.readUInt32LE(offset);
+    expect([field(8), field(12)]).toEqual([1, 96]);
+    expect([bundle.readUInt16LE(16), bundle.readUInt16LE(18)]).toEqual([0x03eb, 0x2fee]);
+    // total size, page size, data start and end (a whole page), valid start and end
+    expect([28, 32, 36, 40, 44, 48].map(field)).toEqual([0x2000, 0x80, 0, 0x7f, 0, 0xfff]);
+
+    // the SHA-256 covers everything, with the digest itself taken as zeros
+    const digest = createHash("sha256")
+      .update(bundle.subarray(0, 64))
+      .update(Buffer.alloc(32))
+      .update(bundle.subarray(96))
+      .digest();
+    expect(bundle.subarray(64, 96)).toEqual(digest);
+
+    // requests: a download to select the memory and one for the page, each followed by a status
+    const requests = [];
+    for (let offset = 96; offset < 96 + field(56); ) {
+      const length = bundle.readUInt32LE(offset + 4);
+      requests.push([bundle[offset], bundle.readUInt16LE(offset + 2), length]);
+      offset += 8 + ((length + 3) & ~3);
+    }
+    expect(field(52)).toBe(requests.length);
+    expect(requests).toEqual([
+      [1, 0, 4],
+      [3, 0, 0],
+      [1, 1, 32 + 0x80 + 16],
+      [3, 0, 0],
+    ]);
+
+    // the expected image (data and mask) follows the requests
+    expect(field(60)).toBe(2 * 0x80);
+    expect(bundle.length).toBe(96 + field(56) + field(60));
+  });
+
+  test("compile is repeatable", async () => {
+    const hex = file("counting.hex", countingHex);
+    const first = runDfu([target, "compile", "--quiet", hex]);
+    const second = runDfu([target, "compile", "--quiet", hex]);
+    expect(await first.exitCode).toBe(0);
+    expect(await second.exitCode).toBe(0);
+
+    expect(second.stdoutBytes).toEqual(first.stdoutBytes);
+  });
+
+  test("compile can not be chained", async () => {
+    const res = runDfu([target, "compile", file("counting.hex", countingHex), "+", "get", "bootloader-version"]);
+    expect(await res.exitCode).toBe(2);
+    const { stdout, stderr } = res;
+
+    expect(stdout).toBe("");
+    expect(stderr).toBe(`compile can not be chained with other commands.${EOL}`);
+  });
+});
+
+describe("flash --plan", () => {
+  const file = tempFiles();
+
+  test("--plan counts the requests of a flash and estimates its time", async () => {
+    const res = runDfu([target, "flash", "--plan", file("counting.hex", countingHex)]);
+    expect(await res.exitCode).toBe(0);
+    const { stdout, stderr } = res;
+
+    expect(stderr).toBe("");
+    expect(stdout).toBe(
+      [
+        "Plan for flash data from 0x0 to 0x7F, AVR timing:",
+        "  stage        requests    polls  bytes out   bytes in   seconds",
+        "  blank check         4        2         10          0     0.004",
+        "  write               4        2        180          0     0.012",
+        "  validate           10        1         28       4096     0.092",
+        "  total              18        5        218       4096     0.109",
+        "Erases 0, blank checks 1, memory unit selects 0, page selects 3,",
+        "address pointer resets 0, reads 4, other commands 4.",
+        "Data blocks 1 carrying 0x80 bytes: 1 x 128.",
+        "About 0.11 seconds, a rough figure for comparing images.",
+        "",
+      ].join(EOL)
+    );
+  });
+
+  test("--plan follows the flash options", async () => {
+    const res = runDfu([
+      target,
+      "flash",
+      "--plan",
+      "--erase-first",
+      "--suppress-validation",
+      file("counting.hex", countingHex),
+    ]);
+    expect(await res.exitCode).toBe(0);
+
+    expect(res.stdout).toBe(
+      [
+        "Plan for flash data from 0x0 to 0x7F, AVR timing:",
+        "  stage        requests    polls  bytes out   bytes in   seconds",
+        "  erase               2        1          3          0     0.126",
+        "  blank check         4        2         10          0     0.004",
+        "  write               4        2        180          0     0.012",
+        "  total              10        5        193          0     0.142",
+        "Erases 1, blank checks 1, memory unit selects 0, page selects 2,",
+        "address pointer resets 0, reads 0, other commands 0.",
+        "Data blocks 1 carrying 0x80 bytes: 1 x 128.",
+        "About 0.14 seconds, a rough figure for comparing images.",
+        "",
+      ].join(EOL)
+    );
+  });
+
+  test("--plan writes as many requests as compile records", async () => {
+    const hex = file("counting.hex", countingHex);
+    const plan = runDfu([target, "flash", "--plan", "--suppress-validation", "--force", hex]);
+    const compile = runDfu([target, "compile", "--quiet", hex]);
+    expect(await plan.exitCode).toBe(0);
+    expect(await compile.exitCode).toBe(0);
+
+    const write = plan.stdout.match(/^ {2}write +(\d+) /m);
+    expect(write).not.toBe(null);
+    expect(Number(write?.[1])).toBe(compile.stdoutBytes.readUInt32LE(52));
+  });
+
+  test("--plan can not be chained", async () => {
+    const res = runDfu([target, "flash", "--plan", file("counting.hex", countingHex), "+", "get", "bootloader-version"]);
+    expect(await res.exitCode).toBe(2);
+    const { stdout, stderr } = res;
+
+    expect(stdout).toBe("");
+    expect(stderr).toBe(`--plan can not be chained with other commands.${EOL}`);
+  });
+});
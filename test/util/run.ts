@@ -16,6 +16,10 @@ export type Result = {
    * This is only populated if the child process exits with a zero exit code
    */
   stdout: string;
+  /**
+   * The stdout output from the child process as raw bytes, for binary output
+   */
+  stdoutBytes: Buffer;
   /**
    * The stderr output from the child process
    *
@@ -79,11 +83,13 @@ export function run(bin: string, args: string[] = []): Result {
       child.stdout.removeAllListeners("data");
     }),
     stdout: "",
+    stdoutBytes: Buffer.alloc(0),
     stderr: "",
   };
 
   child.stdout.on("data", (data) => {
     ret.stdout += data;
+    ret.stdoutBytes = Buffer.concat([ret.stdoutBytes, data]);
   });
   child.stderr.on("data", (data) => {
     ret.stderr += data;